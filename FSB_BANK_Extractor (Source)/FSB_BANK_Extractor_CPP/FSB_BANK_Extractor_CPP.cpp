@@ -47,16 +47,43 @@
 #include <algorithm> // For standard algorithms like std::min, std::transform, etc.
 #include <cmath>    // For mathematical functions, though not heavily used in this specific code snippet
 #include <memory>   // For smart pointers like std::unique_ptr, std::shared_ptr (not directly used in this snippet but good practice)
-#include <unordered_map> // For hash-based associative containers, used for character sanitization
+#include <unordered_map> // For hash-based associative containers, used for option lookup and output name suffixes
 #include <unordered_set> // For tracking used filenames to prevent overwrites
 #include <locale>   // For locale-specific information, used for UTF-8 support
 #include <codecvt>  // For code conversion facets, used for UTF-8 support (deprecated in C++17, alternatives exist)
 #include <chrono>   // For time-related functionalities, used for timestamping log messages
-#include <sstream>  // For string stream operations, used for formatting log timestamps
-#include <iomanip>  // For input/output manipulators, used for formatting log timestamps
+#include <sstream>  // For string stream operations, used for in-memory WAV files and JSON metadata
+#include <limits>   // For std::numeric_limits, used for the unknown-length marker in single-pass mode
+#include <array>    // For fixed-size lookup tables, used for the archive CRC-32 and file name sanitization tables
+#include <ctime>    // For std::time and std::tm, used for archive entry timestamps
+#include <cstdio>   // For std::snprintf, used for formatting tar header fields
+#include <mutex>    // For std::mutex, used to let several workers append to the same shard sequence
+#include <thread>   // For std::thread, used for frame-parallel FLAC encoding
+#include <functional> // For std::function, used for the chunk callbacks of the library API
+#include <stdexcept>  // For std::runtime_error and std::out_of_range
+#include <exception>  // For std::exception_ptr, used to pass FLAC encoder errors from the worker threads to the extracting thread
+#include <atomic>     // For std::atomic, used for the positions and futex words of the shared-memory ring
+#include <charconv>   // For std::to_chars, used for relative log timestamps
+#include <condition_variable> // For std::condition_variable, used to stop the metrics export thread without waiting for its interval
+#include <new>        // For std::align_val_t and std::bad_alloc, used by the allocation-counting build (FSB_EXTRACTOR_COUNT_ALLOCATIONS)
 
 #ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX     // Keeps <windows.h> from defining min and max macros, which break std::min, std::max and std::numeric_limits<T>::max()
+#endif
 #include <windows.h> // For Windows-specific API, used here to set console output code page to UTF-8
+#include <io.h>      // For _setmode and _fileno, used to switch standard output to binary mode for piped audio
+#include <fcntl.h>   // For _O_BINARY
+#include <malloc.h>  // For _aligned_malloc, used by the allocation-counting build
+#else
+#include <fcntl.h>   // For open, used to flush finished files to disk
+#include <unistd.h>  // For fdatasync, fsync and close (syncfs on Linux)
+#include <sys/mman.h> // For shm_open and mmap, used for the shared-memory output ring
+#ifdef __linux__
+#include <linux/futex.h> // For FUTEX_WAIT and FUTEX_WAKE, used to signal the shared-memory ring consumer
+#include <sys/syscall.h> // For SYS_futex and SYS_perf_event_open
+#include <linux/perf_event.h> // For perf_event_attr, used for the hardware counters of -perf-counters
+#endif
 #endif
 
 #include <fmod.hpp>       // Main header for the FMOD Engine API
@@ -72,11 +99,678 @@ namespace Constants {
     constexpr int BITS_IN_BYTE = 8;            // Number of bits in a byte
     constexpr unsigned int CHUNK_SIZE = 4096;   // Default chunk size for reading audio data from FSB files (in bytes)
     constexpr float MAX_SAMPLE_VALUE = 32767.0f; // Maximum sample value for 16-bit PCM (not directly used in core logic, might be for future scaling or normalization)
+    constexpr std::streamoff WAV_HEADER_SIZE = 44;      // Total size of the canonical PCM WAV header written by WriteWAVHeader (in bytes)
+    constexpr std::streamoff RIFF_SIZE_OFFSET = 4;      // Byte offset of the RIFF chunk size field in the WAV header
+    constexpr std::streamoff DATA_SIZE_OFFSET = 40;     // Byte offset of the data chunk size field in the WAV header
+    constexpr unsigned int UNKNOWN_LENGTH = std::numeric_limits<unsigned int>::max(); // Length marker used in single-pass mode: read until FMOD reports end of stream
+    constexpr size_t ARCHIVE_BUFFER_SIZE = 4 * 1024 * 1024; // Stream buffer size for archive output, so entries reach the file system as large sequential writes
+    constexpr size_t ARCHIVE_ENTRY_HEAD_SIZE = 64 * 1024;   // Leading bytes of a streamed archive entry kept in memory, where header patches cost no file seek
+    constexpr unsigned int FLAC_BLOCK_SIZE = 4096;      // Samples per channel in each FLAC frame
+    constexpr unsigned int FLAC_FRAMES_PER_THREAD = 4;  // FLAC frames buffered per encoding thread before a parallel batch is encoded
+    constexpr int SHM_CONSUMER_TIMEOUT_SECONDS = 10;    // Time the shared-memory producer waits on a full ring without the consumer reading before it gives up
+    constexpr size_t STREAMING_WAV_DATA_SIZE = 0xFFFFFFFFu - 36; // WAV data size announced on standard output when the length is unknown (RIFF size becomes 0xFFFFFFFF)
+    constexpr size_t SUMMARY_SLOWEST_SOUNDS = 5;        // Number of slowest sounds listed in the end-of-run summary
 }
 
 void Usage_Simple(); // Function declaration for displaying simple usage instructions in the console
 void Usage_Detail(); // Function declaration for displaying detailed usage instructions in the console
 void CheckFMODResult(FMOD_RESULT result, const std::string& message); // Function declaration to check FMOD API call results and throw exceptions on errors
+std::string EscapeJsonString(const std::string& text); // Function declaration to escape a string for embedding in a JSON document
+
+/**
+ * @namespace TraceEvents
+ * @brief Records the extraction phases of every thread and writes them as a Chrome Trace Event file ("-trace <file>").
+ *
+ * @details
+ * A Scope marks one phase (scan, open, getSubSound, GetSoundInfo, readData, write, ...). When tracing is
+ * enabled it takes a steady-clock timestamp on construction and appends a complete event to the calling thread's buffer on
+ * destruction; otherwise it does nothing beyond one relaxed atomic load. Buffers are registered once per thread under a mutex
+ * and only read by WriteJson, after every traced thread has finished. The file can be opened in Perfetto or chrome://tracing.
+ */
+namespace TraceEvents {
+    /**
+     * @struct Event
+     * @brief One completed phase.
+     */
+    struct Event {
+        const char* name; // Phase name (string literal)
+        int64_t begin;    // Start time in nanoseconds since tracing was enabled
+        int64_t end;      // End time in nanoseconds since tracing was enabled
+        int32_t subSound; // Sub-sound index, or -1 for phases outside a sub-sound
+        uint32_t label;   // 1-based index into ThreadBuffer::labels, or 0 for no label
+    };
+
+    /**
+     * @struct ThreadBuffer
+     * @brief Events recorded by one thread.
+     */
+    struct ThreadBuffer {
+        uint32_t threadId = 0;           // Track the events are shown on (threads with the same name share a track)
+        std::vector<Event> events;       // Completed phases, in order of completion
+        std::vector<std::string> labels; // Labels of events (file and sound names)
+    };
+
+    /**
+     * @struct Registry
+     * @brief Buffers of every thread that recorded events, and the track names.
+     */
+    struct Registry {
+        std::mutex mutex;                                       // Guards buffers and the track tables
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;     // Every buffer (kept after its thread ends)
+        std::vector<std::string> threadNames;                   // Name of each track (index = threadId - 1)
+        std::unordered_map<std::string, uint32_t> threadIds;    // Track of each thread name
+        std::unordered_map<uint32_t, std::vector<ThreadBuffer*>> idleBuffers; // Buffers of ended threads by track, taken over by the next thread with that name
+        std::chrono::steady_clock::time_point start;            // Time origin of the trace
+    };
+
+    inline Registry& State() {
+        static Registry registry;
+        return registry;
+    }
+
+    inline std::atomic<bool>& EnabledFlag() {
+        static std::atomic<bool> enabled{ false };
+        return enabled;
+    }
+
+    /**
+     * @brief Returns true if events are being recorded.
+     */
+    inline bool Enabled() {
+        return EnabledFlag().load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the time since tracing was enabled, in nanoseconds.
+     */
+    inline int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - State().start).count();
+    }
+
+    /**
+     * @struct LocalSlot
+     * @brief The calling thread's buffer; hands it back to the registry when the thread ends.
+     */
+    struct LocalSlot {
+        ThreadBuffer* buffer = nullptr;
+
+        ~LocalSlot() {
+            if (buffer) {
+                Registry& registry = State();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.idleBuffers[buffer->threadId].push_back(buffer);
+            }
+        }
+    };
+
+    /**
+     * @brief Returns the calling thread's buffer, registering it on first use.
+     *
+     * @param threadName Track name for a new buffer, or nullptr to number the thread ("thread <n>").
+     *
+     * @details
+     * A thread named like a thread that has ended continues that thread's buffer, so short-lived workers do not
+     * add a buffer each. Buffers start empty and grow with the events recorded.
+     */
+    inline ThreadBuffer& LocalBuffer(const char* threadName = nullptr) {
+        thread_local LocalSlot slot;
+        if (!slot.buffer) {
+            Registry& registry = State();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            std::string name = threadName ? threadName : "thread " + std::to_string(registry.threadNames.size() + 1);
+            auto track = registry.threadIds.find(name);
+            if (track == registry.threadIds.end()) {
+                registry.threadNames.push_back(name);
+                track = registry.threadIds.emplace(name, static_cast<uint32_t>(registry.threadNames.size())).first;
+            }
+            auto idle = registry.idleBuffers.find(track->second);
+            if (idle != registry.idleBuffers.end() && !idle->second.empty()) {
+                slot.buffer = idle->second.back();
+                idle->second.pop_back();
+            }
+            else {
+                registry.buffers.push_back(std::make_unique<ThreadBuffer>());
+                slot.buffer = registry.buffers.back().get();
+                slot.buffer->threadId = track->second;
+            }
+        }
+        return *slot.buffer;
+    }
+
+    /**
+     * @brief Names the calling thread's track. Must be called before the thread records its first event.
+     *
+     * @param name Track name; threads given the same name (e.g. successive FLAC workers) share one track.
+     * @param number Appended to the name if not negative.
+     */
+    inline void NameThread(const char* name, long long number = -1) {
+        if (Enabled()) {
+            LocalBuffer(number < 0 ? name : (std::string(name) + " " + std::to_string(number)).c_str());
+        }
+    }
+
+    /**
+     * @brief Starts recording, with the calling thread as the "main" track.
+     */
+    inline void Enable() {
+        State().start = std::chrono::steady_clock::now();
+        EnabledFlag().store(true, std::memory_order_relaxed);
+        LocalBuffer("main");
+    }
+
+    /**
+     * @class Scope
+     * @brief Records the phase from its construction to its destruction.
+     */
+    class Scope {
+    public:
+        /**
+         * @brief Constructor for Scope.
+         *
+         * @param name Phase name (string literal).
+         * @param subSound Sub-sound index the phase belongs to, or -1.
+         * @param elapsed Receives the duration in nanoseconds (added to it) even when tracing is disabled, or nullptr.
+         */
+        explicit Scope(const char* name, int subSound = -1, int64_t* elapsed = nullptr)
+            : name_(name), subSound_(subSound), traced_(Enabled()), elapsed_(elapsed), begin_(traced_ || elapsed ? Now() : -1) {
+        }
+
+        ~Scope() {
+            if (begin_ >= 0) {
+                const int64_t end = Now();
+                if (elapsed_) {
+                    *elapsed_ += end - begin_;
+                }
+                if (traced_) {
+                    LocalBuffer().events.push_back({ name_, begin_, end, subSound_, label_ });
+                }
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        /**
+         * @brief Returns true if the phase is recorded (check before building a label).
+         */
+        bool active() const { return traced_; }
+
+        /**
+         * @brief Attaches a label (file or sound name) to the event.
+         */
+        void SetLabel(const std::string& label) {
+            if (active()) {
+                ThreadBuffer& buffer = LocalBuffer();
+                buffer.labels.push_back(label);
+                label_ = static_cast<uint32_t>(buffer.labels.size());
+            }
+        }
+    private:
+        const char* name_;   // Phase name
+        int32_t subSound_;   // Sub-sound index, or -1
+        uint32_t label_ = 0; // Label index, or 0
+        bool traced_;        // True if the event is recorded
+        int64_t* elapsed_;   // Duration accumulator, or nullptr
+        int64_t begin_;      // Start time, or -1 if neither traced nor timed
+    };
+
+    /**
+     * @brief Appends a time in nanoseconds as microseconds with three decimals (the Trace Event time unit).
+     */
+    inline void AppendMicroseconds(std::string& json, int64_t nanoseconds) {
+        char digits[32];
+        int length = std::snprintf(digits, sizeof(digits), "%lld.%03lld", static_cast<long long>(nanoseconds / 1000), static_cast<long long>(nanoseconds % 1000));
+        json.append(digits, static_cast<size_t>(length));
+    }
+
+    /**
+     * @brief Writes every recorded event as a Trace Event JSON document.
+     *
+     * @param tracePath Path of the JSON file.
+     * @return bool True if the file was written successfully, false otherwise.
+     *
+     * @details
+     * Phases become complete ("X") events with the sub-sound index and label as arguments, and every track gets a
+     * "thread_name" metadata event. Must only be called once the traced threads have finished recording.
+     */
+    inline bool WriteJson(const std::filesystem::path& tracePath) {
+        std::ofstream traceFile(tracePath, std::ios::binary | std::ios::trunc);
+        if (!traceFile.is_open()) {
+            return false;
+        }
+        Registry& registry = State();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for (size_t i = 0; i < registry.threadNames.size(); ++i) {
+            json += first ? "" : ",\n";
+            json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(i + 1) + ",\"args\":{\"name\":\"" + EscapeJsonString(registry.threadNames[i]) + "\"}}";
+            first = false;
+        }
+        for (const std::unique_ptr<ThreadBuffer>& buffer : registry.buffers) {
+            const std::string tid = std::to_string(buffer->threadId);
+            for (const Event& event : buffer->events) {
+                json += first ? "{\"name\":\"" : ",\n{\"name\":\"";
+                first = false;
+                json += event.name;
+                json += "\",\"cat\":\"extract\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+                json += tid;
+                json += ",\"ts\":";
+                AppendMicroseconds(json, event.begin);
+                json += ",\"dur\":";
+                AppendMicroseconds(json, event.end - event.begin);
+                if (event.subSound >= 0 || event.label > 0) {
+                    json += ",\"args\":{";
+                    if (event.subSound >= 0) {
+                        json += "\"subSound\":" + std::to_string(event.subSound);
+                    }
+                    if (event.label > 0) {
+                        json += event.subSound >= 0 ? ",\"name\":\"" : "\"name\":\"";
+                        json += EscapeJsonString(buffer->labels[event.label - 1]) + "\"";
+                    }
+                    json += "}";
+                }
+                json += "}";
+                if (json.size() >= Constants::ARCHIVE_BUFFER_SIZE) { // Writes in large blocks instead of building the whole document
+                    traceFile.write(json.data(), static_cast<std::streamsize>(json.size()));
+                    json.clear();
+                }
+            }
+        }
+        json += "\n]}\n";
+        traceFile.write(json.data(), static_cast<std::streamsize>(json.size()));
+        traceFile.close();
+        return !traceFile.fail();
+    }
+
+    /**
+     * @class Session
+     * @brief Enables tracing for its lifetime and writes the trace file when it goes out of scope (including on errors).
+     */
+    class Session {
+    public:
+        explicit Session(const std::filesystem::path& tracePath) : tracePath_(tracePath) {
+            Enable();
+        }
+
+        ~Session() {
+            EnabledFlag().store(false, std::memory_order_relaxed);
+            if (WriteJson(tracePath_)) {
+                std::cout << " Trace written: " << std::filesystem::absolute(tracePath_).u8string() << std::endl;
+            }
+            else {
+                std::cerr << " Error writing trace file: " << tracePath_.u8string() << std::endl;
+            }
+        }
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+    private:
+        std::filesystem::path tracePath_; // Path of the Trace Event JSON file
+    };
+}
+
+/**
+ * @namespace PerfCounters
+ * @brief Hardware performance counters per pipeline phase, read with perf_event_open on Linux ("-perf-counters").
+ *
+ * @details
+ * Each thread opens one counter group (cycles, instructions, cache misses, branch misses; user space only) the first time it
+ * enters a phase. A Scope reads the group when the phase starts and ends, and the counts in between are added to that phase;
+ * phases nest (a FLAC or float32 conversion runs inside a write), and the counts are attributed to the innermost phase only,
+ * so the phase totals do not overlap. Totals are relaxed atomics shared by all threads. Every boundary costs one read()
+ * system call, so the figures are meant for comparing phases and builds, not for timing. Elsewhere than on Linux, and while
+ * disabled, a Scope does nothing beyond one relaxed atomic load.
+ */
+namespace PerfCounters {
+    /**
+     * @enum Phase
+     * @brief Pipeline phases the counts are attributed to.
+     */
+    enum Phase {
+        Scan,    // Searching a BANK file for embedded FSBs
+        Open,    // Opening an FSB with FMOD
+        Decode,  // FMOD::Sound::readData
+        Convert, // Clipping, float32 conversion and FLAC encoding
+        Write,   // Writing the chunks to the output stream
+        PHASE_COUNT
+    };
+
+    constexpr int EVENT_COUNT = 4; // Cycles, instructions, cache misses, branch misses
+
+    inline const char* PhaseName(int phase) {
+        static const char* const names[PHASE_COUNT] = { "scan", "open", "decode", "convert", "write" };
+        return names[phase];
+    }
+
+    /**
+     * @struct Totals
+     * @brief Counts of every phase, summed over all threads.
+     */
+    struct Totals {
+        std::atomic<uint64_t> counts[PHASE_COUNT][EVENT_COUNT] = {}; // Scaled event counts
+        std::atomic<uint64_t> entries[PHASE_COUNT] = {};             // Number of times each phase was entered
+    };
+
+    inline Totals& Global() {
+        static Totals totals;
+        return totals;
+    }
+
+    inline std::atomic<bool>& EnabledFlag() {
+        static std::atomic<bool> enabled{ false };
+        return enabled;
+    }
+
+    inline bool Enabled() {
+        return EnabledFlag().load(std::memory_order_relaxed);
+    }
+
+#ifdef FSB_EXTRACTOR_COUNT_ALLOCATIONS
+    constexpr int PHASE_OTHER = PHASE_COUNT; // Allocations outside the listed phases (sub-sound setup, GetSoundInfo, logging, ...)
+
+    /**
+     * @struct AllocationTotals
+     * @brief Heap allocations per phase, counted by the replaced global operator new (build option FSB_EXTRACTOR_COUNT_ALLOCATIONS).
+     */
+    struct AllocationTotals {
+        std::atomic<uint64_t> allocations[PHASE_COUNT + 1] = {}; // Calls to operator new per phase (last: other)
+        std::atomic<uint64_t> bytes[PHASE_COUNT + 1] = {};       // Bytes requested per phase
+        std::atomic<uint64_t> frees{ 0 };                         // Calls to operator delete (any phase)
+    };
+
+    inline AllocationTotals allocationTotals;                 // Constant-initialized, usable before main
+    inline thread_local int allocationPhase = PHASE_OTHER;    // Phase of the calling thread, set by Scope
+
+    /**
+     * @brief Counts one allocation for the calling thread's phase (called by the replaced operator new).
+     */
+    inline void CountAllocation(std::size_t size) {
+        allocationTotals.allocations[allocationPhase].fetch_add(1, std::memory_order_relaxed);
+        allocationTotals.bytes[allocationPhase].fetch_add(size, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Prints the allocations of every phase, per extracted sub-sound and per MB of decoded PCM data.
+     *
+     * @param output Stream to print to (the console).
+     * @param sounds Sub-sounds extracted during the run.
+     * @param decodedBytes PCM bytes decoded during the run.
+     */
+    inline void PrintAllocations(std::ostream& output, uint64_t sounds, uint64_t decodedBytes) {
+        const double megabytes = static_cast<double>(decodedBytes) / (1024.0 * 1024.0);
+        char line[160];
+        output << std::endl << " ===== Heap allocations (operator new) =====" << std::endl;
+        std::snprintf(line, sizeof(line), " %-8s %12s %14s %14s %12s", "Phase", "Allocations", "Bytes", "Per sub-sound", "Per MB");
+        output << line << std::endl;
+        uint64_t totalAllocations = 0;
+        for (int phase = 0; phase <= PHASE_COUNT; ++phase) {
+            const uint64_t allocations = allocationTotals.allocations[phase].load(std::memory_order_relaxed);
+            totalAllocations += allocations;
+            std::snprintf(line, sizeof(line), " %-8s %12llu %14llu %14.1f %12.1f", phase == PHASE_OTHER ? "other" : PhaseName(phase),
+                static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(allocationTotals.bytes[phase].load(std::memory_order_relaxed)),
+                sounds > 0 ? static_cast<double>(allocations) / static_cast<double>(sounds) : 0.0, megabytes > 0 ? static_cast<double>(allocations) / megabytes : 0.0);
+            output << line << std::endl;
+        }
+        std::snprintf(line, sizeof(line), " Total: %llu allocations, %llu frees, %.1f per sub-sound", static_cast<unsigned long long>(totalAllocations),
+            static_cast<unsigned long long>(allocationTotals.frees.load(std::memory_order_relaxed)), sounds > 0 ? static_cast<double>(totalAllocations) / static_cast<double>(sounds) : 0.0);
+        output << line << std::endl;
+    }
+#endif
+
+#ifdef __linux__
+    /**
+     * @class ThreadGroup
+     * @brief The calling thread's counter group; the file descriptors are closed when the thread ends.
+     */
+    class ThreadGroup {
+    public:
+        ThreadGroup() {
+            static const uint64_t configs[EVENT_COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+            for (int i = 0; i < EVENT_COUNT; ++i) {
+                perf_event_attr attr = {};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[i];
+                attr.exclude_kernel = 1; // Allowed with the default perf_event_paranoid level (2)
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fds_[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds_[0], 0)); // This thread, any CPU
+                if (fds_[i] < 0) {
+                    return; // ok() stays false
+                }
+            }
+        }
+
+        ~ThreadGroup() {
+            for (int fd : fds_) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+        }
+
+        ThreadGroup(const ThreadGroup&) = delete;
+        ThreadGroup& operator=(const ThreadGroup&) = delete;
+
+        bool ok() const { return fds_[EVENT_COUNT - 1] >= 0; }
+
+        /**
+         * @brief Reads the counts, scaled up if the kernel had to multiplex the counters since the previous read.
+         */
+        void Read(uint64_t counts[EVENT_COUNT]) {
+            uint64_t values[3 + EVENT_COUNT] = {}; // nr, time enabled, time running, counts
+            if (::read(fds_[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+                std::copy(last_, last_ + EVENT_COUNT, counts); // No progress rather than garbage
+                return;
+            }
+            const uint64_t enabled = values[1] - lastEnabled_;
+            const uint64_t running = values[2] - lastRunning_;
+            for (int i = 0; i < EVENT_COUNT; ++i) {
+                uint64_t delta = values[3 + i] - lastRaw_[i];
+                if (running > 0 && running < enabled) {
+                    delta = static_cast<uint64_t>(static_cast<double>(delta) * enabled / running);
+                }
+                lastRaw_[i] = values[3 + i];
+                last_[i] += delta;
+                counts[i] = last_[i];
+            }
+            lastEnabled_ = values[1];
+            lastRunning_ = values[2];
+        }
+    private:
+        int fds_[EVENT_COUNT] = { -1, -1, -1, -1 }; // Leader (cycles) first
+        uint64_t lastRaw_[EVENT_COUNT] = {};        // Raw counts at the previous read
+        uint64_t last_[EVENT_COUNT] = {};           // Scaled running totals
+        uint64_t lastEnabled_ = 0;                  // Time enabled at the previous read
+        uint64_t lastRunning_ = 0;                  // Time running at the previous read
+    };
+
+    /**
+     * @struct ThreadState
+     * @brief Per-thread counter group and the phase the thread is in.
+     */
+    struct ThreadState {
+        ThreadGroup group;
+        int currentPhase = -1;             // Innermost open phase, or -1
+        uint64_t last[EVENT_COUNT] = {};   // Counts at the last phase boundary
+    };
+
+    inline ThreadState& Local() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    /**
+     * @brief Adds the counts since the last boundary to the current phase and moves the boundary.
+     */
+    inline void Attribute(ThreadState& state) {
+        uint64_t now[EVENT_COUNT];
+        state.group.Read(now);
+        if (state.currentPhase >= 0) {
+            for (int i = 0; i < EVENT_COUNT; ++i) {
+                Global().counts[state.currentPhase][i].fetch_add(now[i] - state.last[i], std::memory_order_relaxed);
+            }
+        }
+        std::copy(now, now + EVENT_COUNT, state.last);
+    }
+#endif
+
+    /**
+     * @class Scope
+     * @brief Attributes the counts from its construction to its destruction (minus nested phases) to a phase.
+     */
+    class Scope {
+    public:
+        explicit Scope(Phase phase) {
+#ifdef FSB_EXTRACTOR_COUNT_ALLOCATIONS
+            previousAllocationPhase_ = allocationPhase;
+            allocationPhase = phase; // Allocations are tagged with the innermost phase as well
+#endif
+#ifdef __linux__
+            if (!Enabled()) {
+                return;
+            }
+            ThreadState& state = Local();
+            if (!state.group.ok()) {
+                return; // Counters unavailable on this thread
+            }
+            Attribute(state); // Closes the enclosing phase's interval
+            previousPhase_ = state.currentPhase;
+            state.currentPhase = phase;
+            Global().entries[phase].fetch_add(1, std::memory_order_relaxed);
+            active_ = true;
+#else
+            (void)phase;
+#endif
+        }
+
+        ~Scope() {
+#ifdef FSB_EXTRACTOR_COUNT_ALLOCATIONS
+            allocationPhase = previousAllocationPhase_;
+#endif
+#ifdef __linux__
+            if (active_) {
+                ThreadState& state = Local();
+                Attribute(state);
+                state.currentPhase = previousPhase_;
+            }
+#endif
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        bool active_ = false;     // True if the counts are attributed
+        int previousPhase_ = -1;  // Phase to resume on destruction
+#ifdef FSB_EXTRACTOR_COUNT_ALLOCATIONS
+        int previousAllocationPhase_ = PHASE_OTHER; // Allocation phase to resume on destruction
+#endif
+    };
+
+    /**
+     * @brief Enables the counters after checking that the calling thread can open them.
+     *
+     * @return bool True if counting is enabled, false if perf_event_open is unavailable (see perf_event_paranoid) or not on Linux.
+     */
+    inline bool Enable() {
+#ifdef __linux__
+        if (!Local().group.ok()) {
+            return false;
+        }
+        EnabledFlag().store(true, std::memory_order_relaxed);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @brief Prints the counts of every phase that was entered, with IPC and misses per MB of decoded PCM data.
+     *
+     * @param output Stream to print to (the console).
+     * @param decodedBytes PCM bytes decoded during the run.
+     */
+    inline void Print(std::ostream& output, uint64_t decodedBytes) {
+        const double megabytes = static_cast<double>(decodedBytes) / (1024.0 * 1024.0);
+        char line[192];
+        output << std::endl << " ===== Hardware counters (user space, per MB of decoded PCM) =====" << std::endl;
+        std::snprintf(line, sizeof(line), " %-8s %10s %12s %12s %6s %14s %15s", "Phase", "Entries", "Cycles (M)", "Instr. (M)", "IPC", "Cache miss/MB", "Branch miss/MB");
+        output << line << std::endl;
+        for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+            const uint64_t entries = Global().entries[phase].load(std::memory_order_relaxed);
+            if (entries == 0) {
+                continue;
+            }
+            double counts[EVENT_COUNT];
+            for (int i = 0; i < EVENT_COUNT; ++i) {
+                counts[i] = static_cast<double>(Global().counts[phase][i].load(std::memory_order_relaxed));
+            }
+            std::snprintf(line, sizeof(line), " %-8s %10llu %12.2f %12.2f %6.2f %14.0f %15.0f", PhaseName(phase), static_cast<unsigned long long>(entries),
+                counts[0] / 1e6, counts[1] / 1e6, counts[0] > 0 ? counts[1] / counts[0] : 0.0,
+                megabytes > 0 ? counts[2] / megabytes : 0.0, megabytes > 0 ? counts[3] / megabytes : 0.0);
+            output << line << std::endl;
+        }
+    }
+}
+
+#ifdef FSB_EXTRACTOR_COUNT_ALLOCATIONS
+/*
+ * Replacement global allocation functions for the allocation-counting build (define FSB_EXTRACTOR_COUNT_ALLOCATIONS).
+ * The plain, sized and aligned forms are replaced; the standard library's array and nothrow forms forward to them.
+ */
+void* operator new(std::size_t size) {
+    PerfCounters::CountAllocation(size);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    if (memory) {
+        PerfCounters::allocationTotals.frees.fetch_add(1, std::memory_order_relaxed);
+        std::free(memory);
+    }
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    ::operator delete(memory);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    PerfCounters::CountAllocation(size);
+    const std::size_t bytes = size == 0 ? 1 : size;
+#ifdef _WIN32
+    void* memory = _aligned_malloc(bytes, static_cast<std::size_t>(alignment));
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, std::max(static_cast<std::size_t>(alignment), sizeof(void*)), bytes) != 0) {
+        memory = nullptr;
+    }
+#endif
+    if (memory) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    if (memory) {
+        PerfCounters::allocationTotals.frees.fetch_add(1, std::memory_order_relaxed);
+#ifdef _WIN32
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept {
+    ::operator delete(memory, alignment);
+}
+#endif
+
 
 /**
  * @class FMODSystem
@@ -166,10 +860,34 @@ public:
      * Throws std::runtime_error if sound creation fails.
      */
     FMODSound(FMOD::System* system, const std::string& filePath) : sound_(nullptr) {
+        TraceEvents::Scope openScope("open");
+        PerfCounters::Scope perfScope(PerfCounters::Open);
         FMOD_RESULT result = system->createSound(filePath.c_str(), FMOD_CREATESTREAM, nullptr, &sound_); // Creates an FMOD sound object from the given file path, using stream mode
         CheckFMODResult(result, "FMOD::System::createSound failed for " + filePath); // Checks if sound creation was successful
     }
 
+    /**
+     * @brief Constructor for FMODSound that opens a file embedded in a larger file (e.g. an FSB inside a BANK file).
+     *
+     * @param system Pointer to the initialized FMOD System object.
+     * @param filePath Path to the containing file.
+     * @param fileOffset Byte offset of the embedded file within the containing file.
+     * @param length Size of the embedded file in bytes.
+     *
+     * @details
+     * Throws std::runtime_error if sound creation fails.
+     */
+    FMODSound(FMOD::System* system, const std::string& filePath, unsigned int fileOffset, unsigned int length) : sound_(nullptr) {
+        TraceEvents::Scope openScope("open");
+        PerfCounters::Scope perfScope(PerfCounters::Open);
+        FMOD_CREATESOUNDEXINFO exinfo = {};
+        exinfo.cbsize = sizeof(exinfo);
+        exinfo.fileoffset = fileOffset; // FMOD reads the embedded file in place
+        exinfo.length = length;
+        FMOD_RESULT result = system->createSound(filePath.c_str(), FMOD_CREATESTREAM, &exinfo, &sound_);
+        CheckFMODResult(result, "FMOD::System::createSound failed for " + filePath + " at offset " + std::to_string(fileOffset));
+    }
+
     /**
      * @brief Destructor for FMODSound.
      *
@@ -197,14 +915,46 @@ private:
 };
 
 std::string SanitizeFileName(const std::string& fileName); // Function declaration to sanitize file names by replacing invalid characters
-bool WriteWAVHeader(std::ofstream& file, int sampleRate, int channels, size_t dataSize, int bitsPerSample, FMOD_SOUND_FORMAT format); // Function declaration to write WAV file header
-void WriteLogMessage(std::ofstream& logFile, const std::string& level, const std::string& functionName, const std::string& message, bool verboseLogEnabled, FMOD_RESULT errorCode); // Function declaration to write log messages
+bool ParseUnsignedArgument(const std::string& text, uint64_t& value); // Function declaration to parse a non-negative integer command-line value
+const char* SoundFormatName(FMOD_SOUND_FORMAT format); // Function declaration to convert an FMOD sound format to its name
+const char* SoundTypeName(FMOD_SOUND_TYPE soundType); // Function declaration to convert an FMOD sound type (codec/container) to its name
+bool WriteWAVHeader(std::ostream& file, int sampleRate, int channels, size_t dataSize, int bitsPerSample, FMOD_SOUND_FORMAT format); // Function declaration to write WAV file header
+bool PatchWAVHeaderSizes(std::ostream& file, size_t dataSize); // Function declaration to rewrite the RIFF and data size fields of an already written WAV header
+void WriteLogMessage(std::ofstream& logFile, const char* level, const char* functionName, const std::string& message, bool verboseLogEnabled, FMOD_RESULT errorCode); // Function declaration to write log messages
+void WriteLogSeparator(std::ofstream& logFile, bool verboseLogEnabled); // Function declaration to write an empty line into the log
+
+/**
+ * @def LOG_MESSAGE
+ * @brief Writes a log message with WriteLogMessage, but only evaluates the message expression if verbose logging is enabled.
+ *
+ * @details
+ * Log messages are built with std::string concatenation and std::to_string, which allocates on the heap. Checking the
+ * flag first means a run without -v does no logging work at all, not even in the chunk writers or GetSoundInfo.
+ * The arguments are the same as those of WriteLogMessage; level and functionName are string literals.
+ */
+#define LOG_MESSAGE(logFile, level, functionName, message, verboseLogEnabled, errorCode) \
+    do { \
+        if (verboseLogEnabled) { \
+            WriteLogMessage(logFile, level, functionName, message, true, errorCode); \
+        } \
+    } while (false)
+
+namespace PcmChecksum { class Hasher; } // Forward declaration, defined below
 
 namespace AudioProcessor {
+    /**
+     * @struct ChunkTimings
+     * @brief Time a chunk writer spent decoding and writing, for the run summary (see RunSummary).
+     */
+    struct ChunkTimings {
+        int64_t decodeNanoseconds = 0; // Time spent in FMOD::Sound::readData
+        int64_t writeNanoseconds = 0;  // Time spent clipping and writing the chunks (including FLAC or float32 conversion downstream)
+    };
+
     template <typename BufferType>
-    bool WriteAudioDataChunk(FMOD::Sound* subSound, std::ofstream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile); // Template function declaration to write audio data chunks for various PCM formats
-    bool WritePCM24DataChunk(FMOD::Sound* subSound, std::ofstream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile); // Function declaration to handle writing 24-bit PCM data chunks (special case handling might be needed)
-    bool WritePCMFloatDataChunk(FMOD::Sound* subSound, std::ofstream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile); // Function declaration to handle writing PCM float data chunks
+    bool WriteAudioDataChunk(FMOD::Sound* subSound, std::ostream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile, PcmChecksum::Hasher* pcmHasher = nullptr, ChunkTimings* timings = nullptr); // Template function declaration to write audio data chunks for various PCM formats
+    bool WritePCM24DataChunk(FMOD::Sound* subSound, std::ostream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile, PcmChecksum::Hasher* pcmHasher = nullptr, ChunkTimings* timings = nullptr); // Function declaration to handle writing 24-bit PCM data chunks (special case handling might be needed)
+    bool WritePCMFloatDataChunk(FMOD::Sound* subSound, std::ostream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile, PcmChecksum::Hasher* pcmHasher = nullptr, ChunkTimings* timings = nullptr); // Function declaration to handle writing PCM float data chunks
 }
 
 /**
@@ -226,169 +976,4782 @@ struct SoundInfo {
     char subSoundName[256] = { 0 };  // Name of the sub-sound (if available, null-terminated C-style string)
 };
 
-SoundInfo GetSoundInfo(FMOD::Sound* subSound, int subSoundIndex, bool verboseLogEnabled, std::ofstream& logFile); // Function declaration to retrieve sound information from an FMOD Sound object
-// Function signature changed to accept usedFileNames
-void ProcessSubSound(FMOD::System* fmodSystem, FMOD::Sound* subSound, int subSoundIndex, int totalSubSounds, const std::string& baseFileName, const std::filesystem::path& outputDirectoryPath, bool verboseLogEnabled, std::ofstream& logFile, std::unordered_set<std::string>& usedFileNames);
-
+class ArchiveSink; // Forward declaration, defined below
+class ShardSink;   // Forward declaration, defined below
+class TensorBlobSink; // Forward declaration, defined below
+class PipeSink;    // Forward declaration, defined below
+class OutputDurability; // Forward declaration, defined below
+class SharedMemoryRingSink; // Forward declaration, defined below
+class ManifestSink; // Forward declaration, defined below
+class RunSummary;  // Forward declaration, defined below
+class FlacEncoderPool; // Forward declaration, defined below
+struct OutputPlan; // Forward declaration, defined below
+
+/**
+ * @enum OutputFormat
+ * @brief File format used for the extracted sounds.
+ */
+enum class OutputFormat {
+    Wav,  // Waveform Audio (.wav), the default
+    Flac, // Free Lossless Audio Codec (.flac), integer PCM only; float sounds fall back to WAV
+    Npy,  // NumPy array of float32 samples (.npy), one file per sound
+    F32,  // Raw float32 samples of all sounds concatenated into one blob, with a JSON Lines offsets index
+    Pcm   // Raw PCM samples as decoded (.pcm), without any header
+};
+
+/**
+ * @struct OutputOptions
+ * @brief Structure to hold the output settings shared by every sub-sound of an extraction run.
+ *
+ * @details
+ * This structure is filled from the command-line options in main and passed to ProcessSubSound,
+ * so new output settings do not have to be threaded through as separate parameters.
+ */
+struct OutputOptions {
+    bool singlePassEnabled = false;     // Write a placeholder WAV header and patch its sizes after streaming (skips the PCM byte length query)
+    OutputFormat outputFormat = OutputFormat::Wav; // File format of the extracted sounds
+    unsigned int encoderThreads = 1;    // Number of threads used to encode FLAC frames in parallel
+    FlacEncoderPool* flacEncoderPool = nullptr; // Worker threads encoding FLAC frames (created once per run), or nullptr to encode on the extracting thread
+    bool planarLayout = false;          // Float32 output ([channel][frame] instead of [frame][channel] order)
+    TensorBlobSink* tensorBlobSink = nullptr; // Blob receiving the float32 samples of every sound (F32 format), or nullptr
+    PipeSink* pipeSink = nullptr;       // Standard output receiving the sounds ("-o -"), or nullptr
+    SharedMemoryRingSink* ringSink = nullptr; // Shared-memory ring receiving the PCM data of every sound ("-shm"), or nullptr
+    bool peaksEnabled = false;          // Write a "*.peaks" waveform summary next to every output file or archive entry
+    OutputDurability* durability = nullptr; // Flush and atomic rename policy for written files, or nullptr to leave both to the OS
+    ArchiveSink* archiveSink = nullptr; // Archive receiving every WAV file, or nullptr to write individual files
+    ShardSink* shardSink = nullptr;     // WebDataset shard sequence receiving every WAV file with a JSON sidecar, or nullptr
+    std::string sourceFileName;         // Provenance for shard metadata: name of the input *.fsb/*.bank file
+    std::string containerFileName;      // Provenance for shard metadata: name of the FSB being processed (updated by main for each FSB)
+    ManifestSink* manifestSink = nullptr; // Manifest receiving the PCM checksum of every sound ("-manifest"), or nullptr
+    long long containerOffset = -1;     // Provenance for the manifest: byte offset of the FSB in the input file (-1 if unknown)
+    std::vector<uint64_t> sampleDataOffsets; // Provenance for the manifest: offset of each sub-sound's data within the FSB (updated by main for each FSB)
+    const OutputPlan* outputPlan = nullptr; // Output paths and language IDs of the FSB being processed, for the sound metadata (updated by main for each FSB)
+    RunSummary* runSummary = nullptr;   // End-of-run summary receiving the throughput figures of every sound, or nullptr
+};
+
+/**
+ * @struct OutputFileNames
+ * @brief Output file paths used in the current extraction session, with the next free numeric suffix of every name.
+ *
+ * @details
+ * GetOutputFilePath resolves a name collision by appending "_1", "_2", ... to the file stem. Instead of probing the
+ * suffixes from 1 each time, the next suffix to try is remembered per (directory, stem, extension), so a name that is
+ * used thousands of times still costs one or two hash lookups per sub-sound. Both tables are reserved up front by main.
+ */
+struct OutputFileNames {
+    std::unordered_set<std::string> usedPaths;                // Full output paths (UTF-8) already handed out
+    std::unordered_map<std::string, unsigned int> nextSuffix; // Next suffix to try, keyed by the full unsuffixed path
+
+    /**
+     * @brief Reserves room for the given number of additional names, so the tables are not rehashed during extraction.
+     */
+    void Reserve(size_t additionalNames) {
+        usedPaths.reserve(usedPaths.size() + additionalNames);
+        nextSuffix.reserve(nextSuffix.size() + additionalNames);
+    }
+};
+
+SoundInfo GetSoundInfo(FMOD::Sound* subSound, int subSoundIndex, bool verboseLogEnabled, std::ofstream& logFile, bool singlePassEnabled); // Function declaration to retrieve sound information from an FMOD Sound object
+// Function signature changed to accept the planned output path (see PlanOutputPaths)
+void ProcessSubSound(FMOD::System* fmodSystem, FMOD::Sound* subSound, int subSoundIndex, int totalSubSounds, const std::filesystem::path& outputDirectoryPath, bool verboseLogEnabled, std::ofstream& logFile, const std::filesystem::path& outputFilePath, const OutputOptions& outputOptions);
+
 
 namespace BANKtoFSBExtractor {
 
     /**
-     * @brief Searches for the "FSB5" signature within a BinaryReader stream (ported from C#).
+     * @brief Searches for the "FSB5" signature within a BinaryReader stream (ported from C#).
+     *
+     * @param reader The std::ifstream to search within.
+     * @return bool True if the "FSB5" signature is found, false otherwise.
+     */
+    bool FindFSB5Signature(std::ifstream& reader) {
+        TraceEvents::Scope scanScope("scan");
+        PerfCounters::Scope perfScope(PerfCounters::Scan);
+        std::streampos startPosition = reader.tellg(); // Store the initial position of the stream
+        reader.seekg(0, std::ios::end);
+        long long fileSize = reader.tellg();
+        reader.seekg(startPosition);
+
+        while (static_cast<long long>(reader.tellg()) < fileSize - 3) {
+            char signature[4];
+            reader.read(signature, 4);
+            if (reader.gcount() == 4) { // Ensure 4 bytes were read
+                if (std::string(signature, 4) == "FSB5") {
+                    reader.seekg(-4, std::ios::cur); // Rewind by 4 bytes
+                    return true;
+                }
+            }
+            else {
+                break; // Reached end of file prematurely
+            }
+            reader.seekg(-3, std::ios::cur); // Move back 3 bytes to check next sequence
+        }
+        reader.clear(); // Clear any EOF flags
+        reader.seekg(startPosition); // Reset stream position if not found
+        return false;
+    }
+
+
+    /**
+     * @struct EmbeddedFSB
+     * @brief Location of an FSB embedded in a BANK file.
+     */
+    struct EmbeddedFSB {
+        unsigned int offset; // Byte offset of the "FSB5" header within the BANK file
+        unsigned int size;   // Size of the FSB in bytes (header, sample headers, names and data)
+    };
+
+    /**
+     * @brief Finds the FSB files embedded within a BANK file without copying them anywhere.
+     *
+     * @param bankFilePath Path to the BANK file to scan.
+     * @param error If not null, receives the error message instead of std::cerr (empty if no error occurred).
+     * @return std::vector<EmbeddedFSB> Offset and size of every FSB found, in file order.
+     *         Returns an empty list if no FSB files are found or if the file cannot be opened;
+     *         the FSBs found before a truncated one (or one FMOD cannot open in place) are returned.
+     *
+     * @details
+     * The FSB size is calculated from its header (structure based on QuickBMS script analysis). The FSBs are opened
+     * in place by passing the offset and size to FMOD (see FMODSound), so no temporary files are needed.
+     * FMOD takes both as 32-bit values, so an FSB that starts beyond 4 GiB or is larger than that is reported as an error.
+     */
+    std::vector<EmbeddedFSB> FindFSBsInBankFile(const std::filesystem::path& bankFilePath, std::string* error = nullptr) {
+        std::vector<EmbeddedFSB> embeddedFsbs;
+        auto reportError = [error](const std::string& message) {
+            if (error) {
+                *error = message;
+            }
+            else {
+                std::cerr << message << std::endl;
+            }
+            };
+        std::ifstream bankFileStream(bankFilePath, std::ios::binary);
+        if (!bankFileStream.is_open()) {
+            reportError("Error opening bank file: " + bankFilePath.u8string());
+            return embeddedFsbs;
+        }
+        bankFileStream.seekg(0, std::ios::end);
+        const long long fileSize = bankFileStream.tellg();
+        bankFileStream.seekg(0);
+
+        while (FindFSB5Signature(bankFileStream)) {
+            const long long offset = bankFileStream.tellg();
+            char header[24]; // "FSB5", version, numSamples, shdrSize, nameSize, dataSize
+            if (!bankFileStream.read(header, sizeof(header))) {
+                break;
+            }
+            uint32_t shdrSize, nameSize, dataSize;
+            std::memcpy(&shdrSize, header + 12, sizeof(shdrSize));
+            std::memcpy(&nameSize, header + 16, sizeof(nameSize));
+            std::memcpy(&dataSize, header + 20, sizeof(dataSize));
+            const uint64_t fsbFileSize = 0x3Cull + shdrSize + nameSize + dataSize;
+            if (static_cast<uint64_t>(offset) + fsbFileSize > static_cast<uint64_t>(fileSize)) {
+                reportError("Truncated FSB in bank file at offset " + std::to_string(offset) + ": " + bankFilePath.u8string());
+                break;
+            }
+            if (static_cast<uint64_t>(offset) > std::numeric_limits<unsigned int>::max() || fsbFileSize > std::numeric_limits<unsigned int>::max()) {
+                reportError("FSB in bank file at offset " + std::to_string(offset) + " (" + std::to_string(fsbFileSize) + " bytes) exceeds the 4 GiB offset and size FMOD can open in place: " + bankFilePath.u8string());
+                break;
+            }
+            embeddedFsbs.push_back({ static_cast<unsigned int>(offset), static_cast<unsigned int>(fsbFileSize) });
+            bankFileStream.seekg(offset + static_cast<long long>(fsbFileSize)); // Continue the search after this FSB
+        }
+        return embeddedFsbs;
+    }
+
+    /**
+     * @brief Reads the position of every sub-sound's encoded data from the sample headers of an FSB5 file.
+     *
+     * @param fsbFilePath Path to the FSB file, or to the BANK file containing it.
+     * @param fsbOffset Byte offset of the FSB within the file (0 for a stand-alone *.fsb).
+     * @return std::vector<uint64_t> Byte offset of each sub-sound's data relative to the start of the FSB, in sub-sound order.
+     *         Returns an empty list if the file is not a readable FSB5 file.
+     *
+     * @details
+     * Each sample header starts with a 64-bit bit field holding the data offset (in 32-byte units, relative to the
+     * data section) and a flag for optional extra chunks, which are skipped. The data section follows the FSB header
+     * (0x3C bytes, 0x40 in version 0), the sample headers and the name table.
+     */
+    std::vector<uint64_t> ReadFSB5SampleDataOffsets(const std::filesystem::path& fsbFilePath, uint64_t fsbOffset = 0) {
+        std::vector<uint64_t> dataOffsets;
+        std::ifstream fsbFileStream(fsbFilePath, std::ios::binary);
+        fsbFileStream.seekg(static_cast<std::streamoff>(fsbOffset));
+        char header[24]; // "FSB5", version, numSamples, shdrSize, nameSize, dataSize
+        if (!fsbFileStream.read(header, sizeof(header)) || std::memcmp(header, "FSB5", 4) != 0) {
+            return dataOffsets;
+        }
+        uint32_t version, numSamples, shdrSize, nameSize;
+        std::memcpy(&version, header + 4, sizeof(version));
+        std::memcpy(&numSamples, header + 8, sizeof(numSamples));
+        std::memcpy(&shdrSize, header + 12, sizeof(shdrSize));
+        std::memcpy(&nameSize, header + 16, sizeof(nameSize));
+        const uint64_t headerSize = version == 0 ? 0x40 : 0x3C;
+
+        std::vector<char> sampleHeaders(shdrSize);
+        fsbFileStream.seekg(static_cast<std::streamoff>(fsbOffset + headerSize));
+        if (!fsbFileStream.read(sampleHeaders.data(), static_cast<std::streamsize>(sampleHeaders.size()))) {
+            return dataOffsets;
+        }
+        const uint64_t dataSectionOffset = headerSize + shdrSize + nameSize;
+        size_t position = 0;
+        dataOffsets.reserve(numSamples);
+        for (uint32_t i = 0; i < numSamples; ++i) {
+            if (position + 8 > sampleHeaders.size()) {
+                dataOffsets.clear(); // Truncated sample headers
+                break;
+            }
+            uint64_t mode;
+            std::memcpy(&mode, sampleHeaders.data() + position, sizeof(mode));
+            position += 8;
+            dataOffsets.push_back(dataSectionOffset + ((mode >> 7) & 0x7FFFFFF) * 32); // Bits 7-33: data offset / 32
+            bool hasChunk = (mode & 1) != 0;
+            while (hasChunk && position + 4 <= sampleHeaders.size()) { // Skips the extra chunks (loop points, codec setup, ...)
+                uint32_t chunk;
+                std::memcpy(&chunk, sampleHeaders.data() + position, sizeof(chunk));
+                hasChunk = (chunk & 1) != 0;
+                position += 4 + ((chunk >> 1) & 0xFFFFFF); // Bits 1-24: chunk size
+            }
+        }
+        return dataOffsets;
+    }
+}
+
+namespace ArchiveFormat {
+    constexpr size_t TAR_BLOCK_SIZE = 512;              // Size of a tar header/data block (in bytes)
+    constexpr uint64_t TAR_MAX_OCTAL_SIZE = 077777777777ULL; // Largest size representable in the 11-digit octal size field
+    constexpr uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;   // "PK\3\4" local file header signature
+    constexpr uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50; // "PK\1\2" central directory file header signature
+    constexpr uint32_t ZIP_END_SIGNATURE = 0x06054b50;            // "PK\5\6" end of central directory signature
+    constexpr uint32_t ZIP64_END_SIGNATURE = 0x06064b50;          // "PK\6\6" ZIP64 end of central directory record signature
+    constexpr uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;      // "PK\6\7" ZIP64 end of central directory locator signature
+    constexpr uint32_t ZIP_32BIT_LIMIT = 0xFFFFFFFF;              // Marker value meaning "see ZIP64 extra field"
+    constexpr uint16_t ZIP_16BIT_LIMIT = 0xFFFF;                  // Marker value for the entry counts in the end record
+    constexpr uint16_t ZIP_FLAG_UTF8 = 0x0800;                    // General purpose flag bit 11: file name is UTF-8
+
+    /**
+     * @brief Writes a little-endian integer value to an output stream.
+     *
+     * @param out Output stream to write to.
+     * @param value Integer value to write (its size determines the number of bytes written).
+     */
+    template <typename T>
+    void WriteLE(std::ostream& out, T value) {
+        char bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bytes[i] = static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xFF);
+        }
+        out.write(bytes, sizeof(T));
+    }
+
+    /**
+     * @brief Computes the CRC-32 (ISO-HDLC, as used by zip) of a data block.
+     *
+     * @param data Pointer to the data.
+     * @param size Size of the data in bytes.
+     * @param crc Running CRC value from a previous call (0 for a new checksum).
+     * @return uint32_t The updated CRC-32 value.
+     */
+    uint32_t Crc32(const char* data, size_t size, uint32_t crc = 0) {
+        static const auto table = [] { // Builds the byte-wise lookup table once
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    /**
+     * @brief Returns the CRC-32 of two concatenated blocks from the CRC-32 of each block (the method of zlib's crc32_combine).
+     *
+     * @param crc1 CRC-32 of the first block.
+     * @param crc2 CRC-32 of the second block.
+     * @param size2 Size of the second block in bytes.
+     * @return uint32_t CRC-32 of the first block followed by the second.
+     *
+     * @details
+     * Used for streamed zip entries, whose first bytes may still be rewritten (header patches) after the rest was checksummed.
+     * Appending size2 bytes multiplies the first CRC by x^(8 * size2) modulo the CRC polynomial, computed from a table
+     * of the powers x^(2^k) in O(log size2) steps.
+     */
+    uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, uint64_t size2) {
+        auto multiplyModP = [](uint32_t a, uint32_t b) { // a * b modulo the polynomial (bit-reflected, x^0 in the top bit)
+            uint32_t product = 0;
+            for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+                if (a & bit) {
+                    product ^= b;
+                }
+                b = (b & 1) ? (b >> 1) ^ 0xEDB88320u : b >> 1;
+            }
+            return product;
+        };
+        static const auto powers = [&multiplyModP] { // powers[k] = x^(2^k) modulo the polynomial
+            std::array<uint32_t, 64> p{};
+            p[0] = 1u << 30; // x^1
+            for (size_t k = 1; k < p.size(); ++k) {
+                p[k] = multiplyModP(p[k - 1], p[k - 1]);
+            }
+            return p;
+        }();
+        uint32_t shift = 1u << 31; // x^0
+        uint64_t bits = size2 * 8;
+        for (size_t k = 0; bits != 0; bits >>= 1, ++k) {
+            if (bits & 1) {
+                shift = multiplyModP(powers[k], shift);
+            }
+        }
+        return multiplyModP(shift, crc1) ^ crc2;
+    }
+
+    /**
+     * @brief Writes one 512-byte ustar header block.
+     *
+     * @param out Output stream to write to.
+     * @param name Entry name (must fit the 100-byte name field, optionally split with a 155-byte prefix).
+     * @param prefix Entry name prefix (directory part), may be empty.
+     * @param size Size of the entry data in bytes.
+     * @param typeFlag Tar type flag ('0' for regular files, 'L' for GNU long name records).
+     * @param modificationTime Modification time stored in the header (seconds since epoch).
+     */
+    void WriteTarHeaderBlock(std::ostream& out, const std::string& name, const std::string& prefix, uint64_t size, char typeFlag, uint64_t modificationTime) {
+        char header[TAR_BLOCK_SIZE] = { 0 };
+        std::memcpy(header, name.data(), std::min<size_t>(name.size(), 100)); // name[100]
+        std::snprintf(header + 100, 8, "%07o", 0644); // mode[8]
+        std::snprintf(header + 108, 8, "%07o", 0);    // uid[8]
+        std::snprintf(header + 116, 8, "%07o", 0);    // gid[8]
+        if (size <= TAR_MAX_OCTAL_SIZE) { // size[12], octal when it fits
+            std::snprintf(header + 124, 12, "%011llo", static_cast<unsigned long long>(size));
+        }
+        else { // Base-256 encoding for entries of 8 GiB and more (GNU/star extension)
+            header[124] = static_cast<char>(0x80);
+            for (int i = 0; i < 8; ++i) {
+                header[135 - i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+            }
+        }
+        std::snprintf(header + 136, 12, "%011llo", static_cast<unsigned long long>(modificationTime)); // mtime[12]
+        std::memset(header + 148, ' ', 8); // chksum[8], spaces while computing the checksum
+        header[156] = typeFlag; // typeflag
+        std::memcpy(header + 257, "ustar", 6); // magic[6] including the terminating NUL
+        std::memcpy(header + 263, "00", 2);    // version[2]
+        std::memcpy(header + 345, prefix.data(), std::min<size_t>(prefix.size(), 155)); // prefix[155]
+
+        unsigned int checksum = 0;
+        for (size_t i = 0; i < TAR_BLOCK_SIZE; ++i) {
+            checksum += static_cast<unsigned char>(header[i]);
+        }
+        std::snprintf(header + 148, 8, "%06o", checksum); // Six octal digits followed by NUL and a space
+        header[155] = ' ';
+        out.write(header, TAR_BLOCK_SIZE);
+    }
+
+    /**
+     * @brief Writes zero padding up to the next 512-byte tar block boundary.
+     *
+     * @param out Output stream to write to.
+     * @param size Size of the data that was just written.
+     */
+    void WriteTarPadding(std::ostream& out, uint64_t size) {
+        static const char zeros[TAR_BLOCK_SIZE] = { 0 };
+        size_t remainder = static_cast<size_t>(size % TAR_BLOCK_SIZE);
+        if (remainder != 0) {
+            out.write(zeros, TAR_BLOCK_SIZE - remainder);
+        }
+    }
+
+    /**
+     * @brief Splits an entry path into the ustar name and prefix fields.
+     *
+     * @param entryName Entry path inside the archive, using '/' as separator.
+     * @param name Receives the name field (the first 100 bytes of entryName if it fits neither field).
+     * @param prefix Receives the prefix field, or an empty string.
+     * @return bool True if the path does not fit and needs a GNU long name record before the header.
+     */
+    bool SplitTarName(const std::string& entryName, std::string& name, std::string& prefix) {
+        name = entryName;
+        prefix.clear();
+        if (name.size() <= 100) {
+            return false;
+        }
+        size_t split = name.rfind('/', 155);
+        if (split != std::string::npos && name.size() - split - 1 <= 100 && split > 0) { // Fits the ustar prefix/name split
+            prefix = name.substr(0, split);
+            name = name.substr(split + 1);
+            return false;
+        }
+        name = entryName.substr(0, 100); // Truncated name in the real header, the full path is in the long name record
+        return true;
+    }
+
+    /**
+     * @brief Writes the header of a regular file entry: a GNU long name record if the path needs one, then the ustar header block.
+     *
+     * @param out Output stream to write to.
+     * @param entryName Entry path inside the archive, using '/' as separator.
+     * @param size Size of the entry data in bytes.
+     * @param modificationTime Modification time stored in the header (seconds since epoch).
+     *
+     * @details
+     * The ustar header block is always the last 512 bytes before the entry data, so it can be rewritten in place
+     * with WriteTarHeaderBlock once the size of a streamed entry is known.
+     */
+    void WriteTarEntryHeader(std::ostream& out, const std::string& entryName, uint64_t size, uint64_t modificationTime) {
+        std::string name;
+        std::string prefix;
+        if (SplitTarName(entryName, name, prefix)) { // Understood by GNU tar, bsdtar and Python's tarfile
+            WriteTarHeaderBlock(out, "././@LongLink", "", entryName.size() + 1, 'L', modificationTime);
+            out.write(entryName.c_str(), entryName.size() + 1);
+            WriteTarPadding(out, entryName.size() + 1);
+        }
+        WriteTarHeaderBlock(out, name, prefix, size, '0', modificationTime);
+    }
+
+    /**
+     * @brief Writes a complete tar entry (header, data and padding) for a regular file.
+     *
+     * @param out Output stream to write to.
+     * @param entryName Entry path inside the archive, using '/' as separator.
+     * @param data Pointer to the entry data.
+     * @param size Size of the entry data in bytes.
+     * @param modificationTime Modification time stored in the header (seconds since epoch).
+     *
+     * @details
+     * Names longer than the ustar name field are split into prefix and name at a '/' when possible.
+     * Otherwise a GNU long name record ("././@LongLink") is emitted first, which GNU tar, bsdtar and Python's tarfile all understand.
+     */
+    void WriteTarEntry(std::ostream& out, const std::string& entryName, const char* data, uint64_t size, uint64_t modificationTime) {
+        WriteTarEntryHeader(out, entryName, size, modificationTime);
+        out.write(data, static_cast<std::streamsize>(size));
+        WriteTarPadding(out, size);
+    }
+
+    /**
+     * @brief Writes the tar end-of-archive marker (two zero blocks).
+     *
+     * @param out Output stream to write to.
+     */
+    void WriteTarEnd(std::ostream& out) {
+        static const char zeros[TAR_BLOCK_SIZE * 2] = { 0 };
+        out.write(zeros, sizeof(zeros));
+    }
+}
+
+/**
+ * @brief Gets a unique full output file path for a sub-sound output file, handling potential name collisions.
+ *
+ * @param outputDirectoryPath The base output directory path.
+ * @param baseFileName The base file name (stem of the input FSB file name).
+ * @param soundInfo The SoundInfo struct containing information about the sub-sound.
+ * @param subSoundIndex The index of the sub-sound being processed.
+ * @param usedFileNames Output paths already used in the current extraction session, with their next free suffixes.
+ * @param extension File extension including the dot (e.g. ".wav", ".flac", ".npy").
+ * @param sampleKeyName True to replace '.' with '_' in the file name (shards and framed stdout output), so the WebDataset
+ *        sample key, which ends at the first '.' of the name, is made unique by the same collision check.
+ * @return std::filesystem::path The unique full output file path for the output file.
+ *
+ * @details
+ * Candidate paths are built as strings from the directory prefix, so no path object is created while probing.
+ * A colliding name continues from its remembered suffix; a suffixed candidate can still be taken by a sound that
+ * literally has that name (e.g. "step_1"), in which case the next suffix is tried.
+ */
+std::filesystem::path GetOutputFilePath(const std::filesystem::path& outputDirectoryPath, const std::string& baseFileName, const SoundInfo& soundInfo, int subSoundIndex, OutputFileNames& usedFileNames, const std::string& extension, bool sampleKeyName) {
+    std::string outputFileName = std::strlen(soundInfo.subSoundName) > 0
+        ? SanitizeFileName(soundInfo.subSoundName)
+        : SanitizeFileName(baseFileName + "_" + std::to_string(subSoundIndex));
+    if (sampleKeyName) { // "x.y" becomes "x_y" before the check, so it collides with a sound named "x_y" and gets a suffix
+        std::replace(outputFileName.begin(), outputFileName.end(), '.', '_');
+    }
+
+    std::string stemPath = (outputDirectoryPath / "").u8string(); // Directory with a trailing separator
+    stemPath += outputFileName;
+
+    std::string finalPathStr = stemPath + extension;
+    if (!usedFileNames.usedPaths.insert(finalPathStr).second) { // Name taken: continue from its next free suffix
+        unsigned int& counter = usedFileNames.nextSuffix.try_emplace(finalPathStr, 1).first->second;
+        do {
+            finalPathStr.assign(stemPath).append("_").append(std::to_string(counter++)).append(extension);
+        } while (!usedFileNames.usedPaths.insert(finalPathStr).second);
+    }
+    return std::filesystem::u8path(finalPathStr);
+}
+
+/**
+ * @brief Prepares the output directory by creating it if it doesn't exist.
+ *
+ * @param outputDirectory The path to the output directory to prepare.
+ *
+ * @details
+ * Directories that were already prepared are remembered in an in-memory cache, so repeated calls for the same folder
+ * (the FSB output folder, prepared for both its log file and its sounds, for example) return without touching the file system.
+ * For a new directory, create_directories is called directly instead of checking with exists() first.
+ */
+void PrepareOutputDirectory(const std::filesystem::path& outputDirectory) {
+    static std::unordered_set<std::string> preparedDirectories; // Directories known to exist
+    static std::mutex preparedDirectoriesMutex;                 // Guards preparedDirectories
+    std::lock_guard<std::mutex> lock(preparedDirectoriesMutex);
+    if (!preparedDirectories.insert(outputDirectory.u8string()).second) {
+        return; // Already prepared, no file system access needed
+    }
+
+    std::error_code ec;
+    bool created = std::filesystem::create_directories(outputDirectory, ec);
+    if (ec) {
+        preparedDirectories.erase(outputDirectory.u8string()); // Retried on the next call
+        std::cerr << "Error creating directory: " << outputDirectory.u8string() << " - " << ec.message() << std::endl;
+    }
+    else if (created) {
+        std::cout << " Created directory: " << std::filesystem::absolute(outputDirectory).u8string() << std::endl;
+    }
+}
+
+namespace DurableIO {
+#ifdef __linux__
+    constexpr bool HAS_FILE_SYSTEM_SYNC = true;  // syncfs() flushes a whole file system in one call
+#else
+    constexpr bool HAS_FILE_SYSTEM_SYNC = false; // Files and directories are flushed one by one
+#endif
+
+    /**
+     * @brief Flushes the data of a closed file to the storage device (fdatasync on POSIX, FlushFileBuffers on Windows).
+     *
+     * @param filePath Path of the file to flush.
+     * @return bool True if the data reached the device, false otherwise.
+     */
+    inline bool SyncFileData(const std::filesystem::path& filePath) {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(filePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        bool flushed = FlushFileBuffers(file) != 0;
+        CloseHandle(file);
+        return flushed;
+#else
+        int fd = ::open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+#ifdef __APPLE__
+        bool flushed = ::fsync(fd) == 0;
+#else
+        bool flushed = ::fdatasync(fd) == 0; // File size changes are included, other metadata (timestamps) is not
+#endif
+        ::close(fd);
+        return flushed;
+#endif
+    }
+
+    /**
+     * @brief Flushes a directory, making the file names created or renamed in it durable (POSIX only, a no-op on Windows).
+     *
+     * @param directoryPath Path of the directory to flush.
+     * @return bool True on success (always true on Windows, where NTFS journals directory changes itself).
+     */
+    inline bool SyncDirectory(const std::filesystem::path& directoryPath) {
+#ifdef _WIN32
+        (void)directoryPath;
+        return true;
+#else
+        int fd = ::open(directoryPath.empty() ? "." : directoryPath.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0) {
+            return false;
+        }
+        bool flushed = ::fsync(fd) == 0;
+        ::close(fd);
+        return flushed;
+#endif
+    }
+
+    /**
+     * @brief Flushes everything written to the file system that contains the given path, in a single call where the OS allows it.
+     *
+     * @param anyPath Any existing path on the file system to flush.
+     * @param files Files to flush one by one where no file-system-wide flush exists.
+     * @return bool True on success, false otherwise.
+     *
+     * @details
+     * On Linux this is one syncfs() call, which lets the kernel write back all dirty pages of the batch together
+     * instead of waiting for the device once per file. Elsewhere the files (and their directories) are flushed individually.
+     */
+    inline bool SyncFileSystem(const std::filesystem::path& anyPath, const std::vector<std::filesystem::path>& files) {
+#ifdef __linux__
+        (void)files;
+        int fd = ::open(anyPath.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        bool flushed = ::syncfs(fd) == 0;
+        ::close(fd);
+        return flushed;
+#else
+        (void)anyPath;
+        bool flushed = true;
+        for (const std::filesystem::path& file : files) {
+            flushed = SyncFileData(file) && flushed;
+        }
+        return flushed;
+#endif
+    }
+}
+
+
+/**
+ * @enum DurabilityMode
+ * @brief When extracted files are flushed to the storage device.
+ */
+enum class DurabilityMode {
+    None,    // Leave write-back to the OS (fastest, data may be lost on power failure)
+    PerFile, // Flush the data of every file as soon as it is closed (fdatasync / FlushFileBuffers)
+    Batch    // Flush once per batch of files (one syncfs() call on Linux)
+};
+
+/**
+ * @class OutputDurability
+ * @brief Applies the durability policy to extracted files and, in atomic mode, publishes them by batched renames.
+ *
+ * @details
+ * ProcessSubSound writes each file to WritePath() and reports it to FileWritten() after closing it.
+ * Completed files are collected into a batch, which is closed once it holds the configured number of files or bytes:
+ * in Batch mode the data of the whole batch is flushed with one file-system-wide sync, then (atomic mode) every "*.tmp"
+ * file of the batch is renamed to its final name, and the new directory entries are flushed as well. Readers therefore
+ * only ever see complete files under their final names, at the cost of two syncs per batch instead of one per file.
+ * FileWritten is guarded by a mutex, so several extraction workers can share one instance.
+ * Throws std::runtime_error if a flush or rename fails.
+ */
+class OutputDurability {
+public:
+    /**
+     * @brief Constructor for OutputDurability.
+     *
+     * @param mode When file data is flushed to the storage device.
+     * @param atomicRename True to write "*.tmp" files and rename them to their final names batch by batch.
+     * @param batchFiles Number of files per batch (0 for no count limit).
+     * @param batchBytes Number of bytes per batch (0 for no size limit).
+     */
+    OutputDurability(DurabilityMode mode, bool atomicRename, uint64_t batchFiles, uint64_t batchBytes)
+        : mode_(mode), atomicRename_(atomicRename), batchFiles_(batchFiles), batchBytes_(batchBytes) {
+    }
+
+    /**
+     * @brief Destructor for OutputDurability.
+     *
+     * @details
+     * Flushes and publishes the open batch if Finish() was not called. Errors are printed to std::cerr, but no exception is thrown in destructor.
+     */
+    ~OutputDurability() {
+        try {
+            Finish();
+        }
+        catch (const std::exception& ex) {
+            std::cerr << " Error finishing output batch: " << ex.what() << std::endl;
+        }
+    }
+
+    OutputDurability(const OutputDurability&) = delete;
+    OutputDurability& operator=(const OutputDurability&) = delete;
+
+    /**
+     * @brief Returns the path a file should be written to: its final path, or "<final path>.tmp" in atomic mode.
+     */
+    std::filesystem::path WritePath(const std::filesystem::path& finalPath) const {
+        if (!atomicRename_) {
+            return finalPath;
+        }
+        std::filesystem::path tempPath = finalPath;
+        tempPath += ".tmp";
+        return tempPath;
+    }
+
+    /**
+     * @brief Reports a completely written and closed file.
+     *
+     * @param finalPath Final path of the file (it was written to WritePath(finalPath)).
+     * @param fileBytes Size of the file in bytes.
+     */
+    void FileWritten(const std::filesystem::path& finalPath, uint64_t fileBytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (mode_ == DurabilityMode::PerFile) {
+            SyncOrThrow(WritePath(finalPath));
+        }
+        if (mode_ == DurabilityMode::None && !atomicRename_) {
+            return; // Nothing to do at batch boundaries
+        }
+        pendingFiles_.push_back(finalPath);
+        pendingBytes_ += fileBytes;
+        if ((batchFiles_ > 0 && pendingFiles_.size() >= batchFiles_) || (batchBytes_ > 0 && pendingBytes_ >= batchBytes_)) {
+            FlushBatch();
+        }
+    }
+
+    /**
+     * @brief Flushes a standalone output file (archive, shard, tensor blob) unless the mode is None.
+     *
+     * @param filePath Path of the closed file.
+     */
+    void SyncFile(const std::filesystem::path& filePath) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (mode_ != DurabilityMode::None) {
+            SyncOrThrow(filePath);
+        }
+    }
+
+    /**
+     * @brief Flushes and publishes the open batch.
+     */
+    void Finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pendingFiles_.empty()) {
+            FlushBatch();
+        }
+    }
+
+    /**
+     * @brief Returns the number of flush calls issued so far.
+     */
+    uint64_t syncCalls() const { return syncCalls_; }
+private:
+    /**
+     * @brief Flushes one file and throws if that fails.
+     */
+    void SyncOrThrow(const std::filesystem::path& filePath) {
+        ++syncCalls_;
+        if (!DurableIO::SyncFileData(filePath)) {
+            throw std::runtime_error("Failed to flush file to disk: " + filePath.u8string());
+        }
+    }
+
+    /**
+     * @brief Flushes the data of the pending files (Batch mode), renames them (atomic mode) and flushes the renames.
+     */
+    void FlushBatch() {
+        std::vector<std::filesystem::path> writtenFiles;
+        writtenFiles.reserve(pendingFiles_.size());
+        for (const std::filesystem::path& finalPath : pendingFiles_) {
+            writtenFiles.push_back(WritePath(finalPath));
+        }
+        if (mode_ == DurabilityMode::Batch) { // Data must be durable before the renames publish it
+            ++syncCalls_;
+            if (!DurableIO::SyncFileSystem(writtenFiles.front(), writtenFiles)) {
+                throw std::runtime_error("Failed to flush output batch to disk");
+            }
+        }
+        if (atomicRename_) {
+            for (size_t i = 0; i < pendingFiles_.size(); ++i) {
+                std::filesystem::rename(writtenFiles[i], pendingFiles_[i]); // Publishes the complete file in one step
+            }
+        }
+        if (mode_ == DurabilityMode::Batch && DurableIO::HAS_FILE_SYSTEM_SYNC) { // One more file-system-wide flush covers every new name
+            ++syncCalls_;
+            if (!DurableIO::SyncFileSystem(pendingFiles_.front(), {})) {
+                throw std::runtime_error("Failed to flush output batch to disk");
+            }
+        }
+        else if (mode_ != DurabilityMode::None) { // Makes the new names durable, one flush per directory
+            std::unordered_set<std::string> directories;
+            for (const std::filesystem::path& finalPath : pendingFiles_) {
+                if (directories.insert(finalPath.parent_path().u8string()).second) {
+                    ++syncCalls_;
+                    if (!DurableIO::SyncDirectory(finalPath.parent_path())) {
+                        throw std::runtime_error("Failed to flush directory to disk: " + finalPath.parent_path().u8string());
+                    }
+                }
+            }
+        }
+        pendingFiles_.clear();
+        pendingBytes_ = 0;
+    }
+
+    DurabilityMode mode_;                              // When file data is flushed
+    bool atomicRename_;                                // True to write "*.tmp" files and rename them per batch
+    uint64_t batchFiles_;                              // Files per batch (0 for no count limit)
+    uint64_t batchBytes_;                              // Bytes per batch (0 for no size limit)
+    std::vector<std::filesystem::path> pendingFiles_;  // Final paths of the files in the open batch
+    uint64_t pendingBytes_ = 0;                        // Bytes in the open batch
+    uint64_t syncCalls_ = 0;                           // Flush calls issued so far
+    std::mutex mutex_;                                 // Serializes concurrent FileWritten/SyncFile/Finish calls
+};
+
+
+/**
+ * @class ArchiveSink
+ * @brief Streams all extracted WAV files into one tar or store-only zip archive instead of individual files.
+ *
+ * @details
+ * ProcessSubSound streams each sub-sound into the archive as one entry (BeginEntry/EndEntry), keeping the same relative
+ * layout as the file output (base folder, language folders, de-duplicated names); no sound is held in memory as a whole.
+ * The archive is written strictly sequentially through a large stream buffer, so the file system sees a handful of big writes
+ * instead of one create/write/close cycle per sound. The first Constants::ARCHIVE_ENTRY_HEAD_SIZE bytes of an entry are kept
+ * in memory until the entry ends, so the header patches of the output formats (WAV sizes, NPY shape, FLAC STREAMINFO) need no
+ * file seeks; only for a longer entry are the entry header and these bytes rewritten once, with the final size and CRC-32.
+ * The format is chosen from the archive extension: ".zip" produces a store-only (uncompressed) zip with ZIP64 records
+ * where needed, anything else produces a POSIX ustar tar file.
+ * The archive is written under a temporary name ("<path>.tmp") and renamed to its final name by Finish(), so an aborted
+ * run never leaves a truncated archive that looks complete; if the sink is destroyed without Finish(), the file is deleted.
+ * Throws std::runtime_error if the archive cannot be created or written.
+ */
+class ArchiveSink {
+public:
+    /**
+     * @brief Constructor for ArchiveSink.
+     *
+     * @param archivePath Path of the archive file to create (replaced by Finish() if it exists).
+     * @param durability Flush policy applied to the archive before it is renamed, or nullptr.
+     */
+    ArchiveSink(const std::filesystem::path& archivePath, OutputDurability* durability)
+        : archivePath_(archivePath), durability_(durability), buffer_(Constants::ARCHIVE_BUFFER_SIZE), entryBuffer_(*this), entryStream_(&entryBuffer_),
+        offset_(0), finished_(false) {
+        std::string extension = archivePath.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        isZip_ = (extension == ".zip");
+
+        std::time_t now = std::time(nullptr); // Single timestamp used for every entry in the archive
+        modificationTime_ = static_cast<uint64_t>(now);
+        std::tm time_components;
+#ifdef _WIN32
+        localtime_s(&time_components, &now);
+#else
+        localtime_r(&now, &time_components);
+#endif
+        dosTime_ = static_cast<uint16_t>((time_components.tm_hour << 11) | (time_components.tm_min << 5) | (time_components.tm_sec / 2));
+        dosDate_ = static_cast<uint16_t>(((std::max(time_components.tm_year, 80) - 80) << 9) | ((time_components.tm_mon + 1) << 5) | time_components.tm_mday);
+
+        tempPath_ = archivePath;
+        tempPath_ += ".tmp";
+        file_.rdbuf()->pubsetbuf(buffer_.data(), static_cast<std::streamsize>(buffer_.size())); // Large buffer for big sequential writes (must be set before open)
+        file_.open(tempPath_, std::ios::binary | std::ios::trunc);
+        if (!file_.is_open()) {
+            throw std::runtime_error("Failed to create archive file: " + tempPath_.u8string());
+        }
+    }
+
+    /**
+     * @brief Destructor for ArchiveSink.
+     *
+     * @details
+     * If Finish() was not called, the extraction was aborted: the archive is incomplete, so its temporary file is deleted
+     * rather than published. Errors are printed to std::cerr, but no exception is thrown in destructor.
+     */
+    ~ArchiveSink() {
+        if (!finished_) {
+            file_.close();
+            std::error_code error;
+            std::filesystem::remove(tempPath_, error);
+            std::cerr << " Incomplete archive discarded: " << tempPath_.u8string() << std::endl;
+        }
+    }
+
+    ArchiveSink(const ArchiveSink&) = delete;
+    ArchiveSink& operator=(const ArchiveSink&) = delete;
+
+    /**
+     * @brief Starts a streamed entry and returns the stream receiving its contents.
+     *
+     * @param entryName Entry path inside the archive, using '/' as separator.
+     * @return std::ostream& Stream for the entry data. tellp() and seekp() are relative to the start of the entry; only the first
+     *         Constants::ARCHIVE_ENTRY_HEAD_SIZE bytes can be rewritten.
+     *
+     * @details
+     * An entry that was begun but not ended (its sound failed) is dropped first.
+     */
+    std::ostream& BeginEntry(const std::string& entryName) {
+        DiscardEntry();
+        entryName_ = entryName;
+        entryOpen_ = true;
+        entryBuffer_.Reset();
+        entryStream_.clear();
+        return entryStream_;
+    }
+
+    /**
+     * @brief Ends the streamed entry: writes its header with the final size (and CRC-32 for zip) and the padding (tar).
+     */
+    void EndEntry() {
+        if (!entryStream_.good()) {
+            DiscardEntry();
+            throw std::runtime_error("Failed to write archive entry: " + entryName_);
+        }
+        entryOpen_ = false;
+        const uint64_t size = entryBuffer_.size();
+        const uint32_t crc = isZip_ ? entryBuffer_.crc() : 0;
+        if (entryBuffer_.headWritten()) { // Replaces the provisional header and the head written when the entry outgrew the head
+            const std::streampos dataEnd = file_.tellp();
+            file_.seekp(static_cast<std::streamoff>(offset_));
+            WriteEntryHeader(size, crc, true);
+            file_.write(entryBuffer_.head(), static_cast<std::streamsize>(entryBuffer_.headBytes()));
+            file_.seekp(dataEnd);
+        }
+        else { // The whole entry is still in memory
+            WriteEntryHeader(size, crc, false);
+            file_.write(entryBuffer_.head(), static_cast<std::streamsize>(entryBuffer_.headBytes()));
+        }
+        if (isZip_) {
+            zipEntries_.push_back({ entryName_, crc, size, offset_ });
+        }
+        else {
+            ArchiveFormat::WriteTarPadding(file_, size);
+        }
+        if (!file_.good()) {
+            throw std::runtime_error("Failed to write archive entry: " + entryName_);
+        }
+        offset_ = static_cast<uint64_t>(file_.tellp());
+    }
+
+    /**
+     * @brief Appends one file entry whose contents are already in memory (small sidecar files) to the archive.
+     *
+     * @param entryName Entry path inside the archive, using '/' as separator.
+     * @param data Complete file contents.
+     */
+    void AddEntry(const std::string& entryName, const std::string& data) {
+        DiscardEntry();
+        if (isZip_) {
+            WriteZipEntry(entryName, data);
+        }
+        else {
+            ArchiveFormat::WriteTarEntry(file_, entryName, data.data(), data.size(), modificationTime_);
+        }
+        if (!file_.good()) {
+            throw std::runtime_error("Failed to write archive entry: " + entryName);
+        }
+        offset_ = static_cast<uint64_t>(file_.tellp());
+    }
+
+    /**
+     * @brief Writes the archive trailer (tar end marker or zip central directory), closes the file and renames it to its final name.
+     */
+    void Finish() {
+        DiscardEntry();
+        if (isZip_) {
+            WriteZipCentralDirectory();
+        }
+        else {
+            ArchiveFormat::WriteTarEnd(file_);
+        }
+        const uint64_t archiveSize = static_cast<uint64_t>(file_.tellp());
+        file_.close();
+        if (file_.fail()) {
+            throw std::runtime_error("Failed to finalize archive file: " + tempPath_.u8string());
+        }
+        if (entryDiscarded_) { // Cuts off what is left of a dropped entry that was longer than everything written after it
+            std::filesystem::resize_file(tempPath_, archiveSize);
+        }
+        if (durability_) { // Archive data must be on disk before the rename publishes it
+            durability_->SyncFile(tempPath_);
+        }
+        std::filesystem::rename(tempPath_, archivePath_); // Publishes the complete archive in one step
+        finished_ = true;
+    }
+
+    /**
+     * @brief Returns the archive file path.
+     *
+     * @return const std::filesystem::path& Final path of the archive being written.
+     */
+    const std::filesystem::path& path() const { return archivePath_; }
+private:
+    struct ZipEntry { // Central directory bookkeeping for one zip entry
+        std::string name;
+        uint32_t crc;
+        uint64_t size;
+        uint64_t localHeaderOffset;
+    };
+
+    /**
+     * @class EntryBuffer
+     * @brief Stream buffer of a streamed entry: keeps the head of the entry in memory and appends the rest to the archive.
+     *
+     * @details
+     * When the entry outgrows the head, the provisional entry header and the head are written to the archive once, and every
+     * further byte is appended directly (and checksummed, for zip). Seeking is possible within the head and to the end of the entry.
+     */
+    class EntryBuffer : public std::streambuf {
+    public:
+        explicit EntryBuffer(ArchiveSink& sink) : sink_(sink), head_(Constants::ARCHIVE_ENTRY_HEAD_SIZE) {
+        }
+
+        /**
+         * @brief Prepares the buffer for a new entry.
+         */
+        void Reset() {
+            position_ = 0;
+            size_ = 0;
+            tailCrc_ = 0;
+            headWritten_ = false;
+        }
+
+        uint64_t size() const { return size_; }                  // Entry data size in bytes
+        const char* head() const { return head_.data(); }        // First bytes of the entry data
+        size_t headBytes() const { return static_cast<size_t>(std::min<uint64_t>(size_, head_.size())); } // Valid bytes in head()
+        bool headWritten() const { return headWritten_; }        // True once the head was written to the archive
+
+        /**
+         * @brief Returns the CRC-32 of the entry data: the head (final contents) followed by the appended bytes.
+         */
+        uint32_t crc() const {
+            return ArchiveFormat::Crc32Combine(ArchiveFormat::Crc32(head_.data(), headBytes()), tailCrc_, size_ - headBytes());
+        }
+    protected:
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            std::streamsize written = 0;
+            if (position_ < head_.size()) { // Head bytes stay in memory (rewritten in place by header patches)
+                const size_t count = static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(size), head_.size() - position_));
+                std::memcpy(head_.data() + position_, data, count);
+                position_ += count;
+                size_ = std::max(size_, position_);
+                written = static_cast<std::streamsize>(count);
+            }
+            if (written == size) {
+                return written;
+            }
+            if (position_ != size_) { // Beyond the head, data can only be appended
+                return written;
+            }
+            if (!headWritten_) { // The entry outgrew the head: the provisional header and the head go first
+                sink_.WriteEntryHeader(0, 0, true);
+                sink_.file_.write(head_.data(), static_cast<std::streamsize>(head_.size()));
+                headWritten_ = true;
+            }
+            const std::streamsize tail = size - written;
+            if (sink_.isZip_) {
+                tailCrc_ = ArchiveFormat::Crc32(data + written, static_cast<size_t>(tail), tailCrc_);
+            }
+            sink_.file_.write(data + written, tail);
+            if (!sink_.file_.good()) {
+                return written;
+            }
+            position_ += static_cast<uint64_t>(tail);
+            size_ = position_;
+            return size;
+        }
+
+        int_type overflow(int_type ch) override {
+            if (traits_type::eq_int_type(ch, traits_type::eof())) {
+                return traits_type::not_eof(ch);
+            }
+            const char byte = traits_type::to_char_type(ch);
+            return xsputn(&byte, 1) == 1 ? ch : traits_type::eof();
+        }
+
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override {
+            const off_type base = direction == std::ios_base::beg ? 0 : static_cast<off_type>(direction == std::ios_base::cur ? position_ : size_);
+            const off_type target = base + offset;
+            if (!(which & std::ios_base::out) || target < 0 || target > static_cast<off_type>(size_) ||
+                (target >= static_cast<off_type>(head_.size()) && target != static_cast<off_type>(size_))) {
+                return pos_type(off_type(-1)); // Only the head and the end of the entry can be reached
+            }
+            position_ = static_cast<uint64_t>(target);
+            return pos_type(target);
+        }
+
+        pos_type seekpos(pos_type position, std::ios_base::openmode which) override {
+            return seekoff(off_type(position), std::ios_base::beg, which);
+        }
+    private:
+        ArchiveSink& sink_;       // Archive receiving the entry
+        std::vector<char> head_;  // First Constants::ARCHIVE_ENTRY_HEAD_SIZE bytes of the entry
+        uint64_t position_ = 0;   // Write position within the entry
+        uint64_t size_ = 0;       // Entry data size so far
+        uint32_t tailCrc_ = 0;    // CRC-32 of the bytes after the head (zip only)
+        bool headWritten_ = false; // True once the provisional header and the head are in the archive
+    };
+
+    /**
+     * @brief Writes the header of the streamed entry at the current file position.
+     *
+     * @param size Entry data size in bytes (0 in the provisional header).
+     * @param crc CRC-32 of the entry data (zip only, 0 in the provisional header).
+     * @param rewritable True for a header that is rewritten once the size is known: zip sizes then always go in a ZIP64 extra field,
+     *        so the header has the same length whatever the final size. Tar headers always have a fixed length.
+     */
+    void WriteEntryHeader(uint64_t size, uint32_t crc, bool rewritable) {
+        if (isZip_) {
+            WriteZipLocalHeader(entryName_, crc, size, rewritable || size >= ArchiveFormat::ZIP_32BIT_LIMIT);
+        }
+        else {
+            ArchiveFormat::WriteTarEntryHeader(file_, entryName_, size, modificationTime_);
+        }
+    }
+
+    /**
+     * @brief Drops an entry that was begun but not ended. The archive continues at the entry's start, overwriting what was written of it.
+     */
+    void DiscardEntry() {
+        if (!entryOpen_) {
+            return;
+        }
+        entryOpen_ = false;
+        if (entryBuffer_.headWritten()) {
+            file_.seekp(static_cast<std::streamoff>(offset_));
+            entryDiscarded_ = true;
+        }
+    }
+
+    /**
+     * @brief Writes a zip local file header.
+     *
+     * @param name Entry name.
+     * @param crc CRC-32 of the entry data.
+     * @param size Entry data size in bytes (stored, so compressed and uncompressed sizes are equal).
+     * @param zip64 True to store the sizes in a ZIP64 extended information extra field.
+     */
+    void WriteZipLocalHeader(const std::string& name, uint32_t crc, uint64_t size, bool zip64) {
+        using namespace ArchiveFormat;
+        WriteLE<uint32_t>(file_, ZIP_LOCAL_HEADER_SIGNATURE);
+        WriteLE<uint16_t>(file_, zip64 ? 45 : 20); // Version needed to extract
+        WriteLE<uint16_t>(file_, ZIP_FLAG_UTF8);
+        WriteLE<uint16_t>(file_, 0); // Compression method: stored
+        WriteLE<uint16_t>(file_, dosTime_);
+        WriteLE<uint16_t>(file_, dosDate_);
+        WriteLE<uint32_t>(file_, crc);
+        WriteLE<uint32_t>(file_, zip64 ? ZIP_32BIT_LIMIT : static_cast<uint32_t>(size)); // Compressed size
+        WriteLE<uint32_t>(file_, zip64 ? ZIP_32BIT_LIMIT : static_cast<uint32_t>(size)); // Uncompressed size
+        WriteLE<uint16_t>(file_, static_cast<uint16_t>(name.size()));
+        WriteLE<uint16_t>(file_, zip64 ? 20 : 0); // Extra field length
+        file_.write(name.data(), static_cast<std::streamsize>(name.size()));
+        if (zip64) { // ZIP64 extended information extra field: uncompressed and compressed size
+            WriteLE<uint16_t>(file_, 0x0001);
+            WriteLE<uint16_t>(file_, 16);
+            WriteLE<uint64_t>(file_, size);
+            WriteLE<uint64_t>(file_, size);
+        }
+    }
+
+    /**
+     * @brief Writes a zip local file header followed by the stored (uncompressed) entry data.
+     */
+    void WriteZipEntry(const std::string& entryName, const std::string& data) {
+        ZipEntry entry{ entryName, ArchiveFormat::Crc32(data.data(), data.size()), data.size(), offset_ };
+        WriteZipLocalHeader(entry.name, entry.crc, entry.size, entry.size >= ArchiveFormat::ZIP_32BIT_LIMIT);
+        file_.write(data.data(), static_cast<std::streamsize>(data.size()));
+        zipEntries_.push_back(std::move(entry));
+    }
+
+    /**
+     * @brief Writes the zip central directory and end records, adding ZIP64 records when sizes, offsets or counts require them.
+     */
+    void WriteZipCentralDirectory() {
+        using namespace ArchiveFormat;
+        uint64_t centralDirectoryOffset = offset_;
+        for (const ZipEntry& entry : zipEntries_) {
+            bool sizeOverflow = entry.size >= ZIP_32BIT_LIMIT;
+            bool offsetOverflow = entry.localHeaderOffset >= ZIP_32BIT_LIMIT;
+            uint16_t extraLength = static_cast<uint16_t>((sizeOverflow || offsetOverflow) ? 4 + (sizeOverflow ? 16 : 0) + (offsetOverflow ? 8 : 0) : 0);
+
+            WriteLE<uint32_t>(file_, ZIP_CENTRAL_HEADER_SIGNATURE);
+            WriteLE<uint16_t>(file_, 45); // Version made by (MS-DOS attributes, spec 4.5)
+            WriteLE<uint16_t>(file_, extraLength ? 45 : 20); // Version needed to extract
+            WriteLE<uint16_t>(file_, ZIP_FLAG_UTF8);
+            WriteLE<uint16_t>(file_, 0); // Compression method: stored
+            WriteLE<uint16_t>(file_, dosTime_);
+            WriteLE<uint16_t>(file_, dosDate_);
+            WriteLE<uint32_t>(file_, entry.crc);
+            WriteLE<uint32_t>(file_, sizeOverflow ? ZIP_32BIT_LIMIT : static_cast<uint32_t>(entry.size));
+            WriteLE<uint32_t>(file_, sizeOverflow ? ZIP_32BIT_LIMIT : static_cast<uint32_t>(entry.size));
+            WriteLE<uint16_t>(file_, static_cast<uint16_t>(entry.name.size()));
+            WriteLE<uint16_t>(file_, extraLength);
+            WriteLE<uint16_t>(file_, 0); // File comment length
+            WriteLE<uint16_t>(file_, 0); // Disk number start
+            WriteLE<uint16_t>(file_, 0); // Internal file attributes
+            WriteLE<uint32_t>(file_, 0); // External file attributes
+            WriteLE<uint32_t>(file_, offsetOverflow ? ZIP_32BIT_LIMIT : static_cast<uint32_t>(entry.localHeaderOffset));
+            file_.write(entry.name.data(), static_cast<std::streamsize>(entry.name.size()));
+            if (extraLength) { // ZIP64 extra field holds only the values that overflowed, in this fixed order
+                WriteLE<uint16_t>(file_, 0x0001);
+                WriteLE<uint16_t>(file_, static_cast<uint16_t>(extraLength - 4));
+                if (sizeOverflow) {
+                    WriteLE<uint64_t>(file_, entry.size);
+                    WriteLE<uint64_t>(file_, entry.size);
+                }
+                if (offsetOverflow) {
+                    WriteLE<uint64_t>(file_, entry.localHeaderOffset);
+                }
+            }
+        }
+        uint64_t centralDirectoryEnd = static_cast<uint64_t>(file_.tellp());
+        uint64_t centralDirectorySize = centralDirectoryEnd - centralDirectoryOffset;
+        uint64_t entryCount = zipEntries_.size();
+
+        bool zip64 = entryCount >= ZIP_16BIT_LIMIT || centralDirectoryOffset >= ZIP_32BIT_LIMIT || centralDirectorySize >= ZIP_32BIT_LIMIT;
+        if (zip64) {
+            WriteLE<uint32_t>(file_, ZIP64_END_SIGNATURE);
+            WriteLE<uint64_t>(file_, 44); // Size of the remaining ZIP64 end record
+            WriteLE<uint16_t>(file_, 45); // Version made by
+            WriteLE<uint16_t>(file_, 45); // Version needed to extract
+            WriteLE<uint32_t>(file_, 0);  // Number of this disk
+            WriteLE<uint32_t>(file_, 0);  // Disk with the start of the central directory
+            WriteLE<uint64_t>(file_, entryCount);
+            WriteLE<uint64_t>(file_, entryCount);
+            WriteLE<uint64_t>(file_, centralDirectorySize);
+            WriteLE<uint64_t>(file_, centralDirectoryOffset);
+
+            WriteLE<uint32_t>(file_, ZIP64_LOCATOR_SIGNATURE);
+            WriteLE<uint32_t>(file_, 0); // Disk with the ZIP64 end record
+            WriteLE<uint64_t>(file_, centralDirectoryEnd);
+            WriteLE<uint32_t>(file_, 1); // Total number of disks
+        }
+        WriteLE<uint32_t>(file_, ZIP_END_SIGNATURE);
+        WriteLE<uint16_t>(file_, 0); // Number of this disk
+        WriteLE<uint16_t>(file_, 0); // Disk with the start of the central directory
+        WriteLE<uint16_t>(file_, zip64 ? ZIP_16BIT_LIMIT : static_cast<uint16_t>(entryCount));
+        WriteLE<uint16_t>(file_, zip64 ? ZIP_16BIT_LIMIT : static_cast<uint16_t>(entryCount));
+        WriteLE<uint32_t>(file_, zip64 ? ZIP_32BIT_LIMIT : static_cast<uint32_t>(centralDirectorySize));
+        WriteLE<uint32_t>(file_, zip64 ? ZIP_32BIT_LIMIT : static_cast<uint32_t>(centralDirectoryOffset));
+        WriteLE<uint16_t>(file_, 0); // Comment length
+    }
+
+    std::filesystem::path archivePath_; // Final path of the archive file
+    std::filesystem::path tempPath_;    // Path the archive is written to until Finish() ("<archivePath_>.tmp")
+    OutputDurability* durability_;      // Flush policy for the finished archive, or nullptr
+    std::vector<char> buffer_;          // Stream buffer backing file_ (Constants::ARCHIVE_BUFFER_SIZE bytes)
+    std::ofstream file_;                // Archive output stream
+    EntryBuffer entryBuffer_;           // Stream buffer of the streamed entry
+    std::ostream entryStream_;          // Stream over entryBuffer_, returned by BeginEntry
+    std::string entryName_;             // Name of the streamed entry
+    bool entryOpen_ = false;            // True between BeginEntry and EndEntry
+    bool entryDiscarded_ = false;       // True if a dropped entry left data that Finish() may have to cut off
+    bool isZip_ = false;                // True for zip output, false for tar output
+    uint64_t offset_;                   // Current end offset of the archive (start of the next entry)
+    uint64_t modificationTime_ = 0;     // Entry modification time for tar headers (seconds since epoch)
+    uint16_t dosTime_ = 0;              // Entry modification time for zip headers (MS-DOS format)
+    uint16_t dosDate_ = 0;              // Entry modification date for zip headers (MS-DOS format)
+    std::vector<ZipEntry> zipEntries_;  // Entries written so far (zip only)
+    bool finished_;                     // True once the archive has been published under its final name
+};
+
+
+/**
+ * @class ShardSink
+ * @brief Writes extracted sounds as rolling WebDataset-style tar shards, each sample being an audio file plus a JSON metadata sidecar.
+ *
+ * @details
+ * Samples are appended to the current shard until it reaches the configured size or sample count, at which point the shard
+ * is closed and a new one is started. Shards are written under a temporary name ("*.tar.tmp") and renamed to their final
+ * name only once complete, so consumers never observe a partially written shard. The last shard is published by Finish();
+ * if the sink is destroyed without it (the extraction failed), the open shard is deleted instead.
+ * AddSample is guarded by a mutex, so several extraction workers can fill the same shard sequence concurrently.
+ * Throws std::runtime_error if a shard cannot be created, written or renamed.
+ */
+class ShardSink {
+public:
+    /**
+     * @brief Constructor for ShardSink.
+     *
+     * @param shardDirectory Directory receiving the shard files (created if it does not exist).
+     * @param shardPrefix Prefix of the shard file names, e.g. "music" produces "music-000000.tar", "music-000001.tar", ...
+     * @param maxShardBytes Maximum shard size in bytes before rolling over (0 for no size limit).
+     * @param maxShardSamples Maximum number of samples per shard before rolling over (0 for no count limit).
+     * @param durability Flush policy applied to each shard before it is renamed, or nullptr.
+     */
+    ShardSink(const std::filesystem::path& shardDirectory, const std::string& shardPrefix, uint64_t maxShardBytes, uint64_t maxShardSamples, OutputDurability* durability)
+        : shardDirectory_(shardDirectory), shardPrefix_(shardPrefix), maxShardBytes_(maxShardBytes), maxShardSamples_(maxShardSamples), durability_(durability),
+        buffer_(Constants::ARCHIVE_BUFFER_SIZE), modificationTime_(static_cast<uint64_t>(std::time(nullptr))) {
+        PrepareOutputDirectory(shardDirectory_);
+    }
+
+    /**
+     * @brief Destructor for ShardSink.
+     *
+     * @details
+     * If Finish() was not called, the extraction was aborted: the open shard is incomplete, so it is deleted rather than
+     * published. Errors are printed to std::cerr, but no exception is thrown in destructor.
+     */
+    ~ShardSink() {
+        if (shardFile_.is_open()) {
+            shardFile_.close();
+            std::filesystem::path tempPath = ShardPath(shardIndex_);
+            tempPath += ".tmp";
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+            std::cerr << " Incomplete shard discarded: " << tempPath.u8string() << std::endl;
+        }
+    }
+
+    ShardSink(const ShardSink&) = delete;
+    ShardSink& operator=(const ShardSink&) = delete;
+
+    /**
+     * @brief Appends one sample (audio data and JSON metadata) to the current shard, rolling over to a new shard if needed.
+     *
+     * @param sampleKey WebDataset sample key (path without extension, must not contain '.' in its last component).
+     * @param audioExtension Extension of the audio entry including the dot (".wav" or ".flac").
+     * @param audioData Complete audio file contents.
+     * @param jsonMetadata JSON metadata document for the sample.
+     */
+    void AddSample(const std::string& sampleKey, const std::string& audioExtension, const std::string& audioData, const std::string& jsonMetadata) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t sampleBytes = TarEntrySize(sampleKey + audioExtension, audioData.size()) + TarEntrySize(sampleKey + ".json", jsonMetadata.size());
+        if (shardFile_.is_open() && ((maxShardSamples_ > 0 && shardSamples_ >= maxShardSamples_) ||
+            (maxShardBytes_ > 0 && shardBytes_ + sampleBytes + ArchiveFormat::TAR_BLOCK_SIZE * 2 > maxShardBytes_))) {
+            CloseShard(); // Current shard is full
+        }
+        if (!shardFile_.is_open()) {
+            OpenShard();
+        }
+        ArchiveFormat::WriteTarEntry(shardFile_, sampleKey + audioExtension, audioData.data(), audioData.size(), modificationTime_);
+        ArchiveFormat::WriteTarEntry(shardFile_, sampleKey + ".json", jsonMetadata.data(), jsonMetadata.size(), modificationTime_);
+        if (!shardFile_.good()) {
+            throw std::runtime_error("Failed to write shard sample: " + sampleKey);
+        }
+        shardBytes_ += sampleBytes;
+        ++shardSamples_;
+    }
+
+    /**
+     * @brief Finalizes and publishes the open shard, if any. Throws std::runtime_error if it cannot be written or renamed.
+     */
+    void Finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shardFile_.is_open()) {
+            CloseShard();
+        }
+    }
+
+    /**
+     * @brief Returns the shard directory.
+     *
+     * @return const std::filesystem::path& Directory receiving the shard files.
+     */
+    const std::filesystem::path& directory() const { return shardDirectory_; }
+
+    /**
+     * @brief Returns the number of shards completed so far.
+     *
+     * @return unsigned int Number of finalized shards.
+     */
+    unsigned int completedShards() const { return shardIndex_; }
+private:
+    /**
+     * @brief Returns the number of bytes a tar entry occupies (header blocks plus padded data).
+     */
+    static uint64_t TarEntrySize(const std::string& entryName, uint64_t dataSize) {
+        const uint64_t block = ArchiveFormat::TAR_BLOCK_SIZE;
+        uint64_t nameBlocks = entryName.size() > 100 ? 1 + (entryName.size() + 1 + block - 1) / block : 0; // Possible GNU long name record
+        return (1 + nameBlocks) * block + (dataSize + block - 1) / block * block;
+    }
+
+    /**
+     * @brief Returns the final path of the shard with the given index.
+     */
+    std::filesystem::path ShardPath(unsigned int index) const {
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "-%06u.tar", index);
+        return shardDirectory_ / std::filesystem::u8path(shardPrefix_ + suffix);
+    }
+
+    /**
+     * @brief Opens the next shard under its temporary name.
+     */
+    void OpenShard() {
+        std::filesystem::path tempPath = ShardPath(shardIndex_);
+        tempPath += ".tmp";
+        shardFile_.rdbuf()->pubsetbuf(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        shardFile_.open(tempPath, std::ios::binary | std::ios::trunc);
+        if (!shardFile_.is_open()) {
+            throw std::runtime_error("Failed to create shard file: " + tempPath.u8string());
+        }
+        shardBytes_ = 0;
+        shardSamples_ = 0;
+    }
+
+    /**
+     * @brief Writes the tar end marker, closes the shard and atomically renames it to its final name.
+     */
+    void CloseShard() {
+        ArchiveFormat::WriteTarEnd(shardFile_);
+        shardFile_.close();
+        std::filesystem::path finalPath = ShardPath(shardIndex_);
+        std::filesystem::path tempPath = finalPath;
+        tempPath += ".tmp";
+        if (shardFile_.fail()) {
+            throw std::runtime_error("Failed to finalize shard file: " + tempPath.u8string());
+        }
+        if (durability_) { // Shard data must be on disk before the rename publishes it
+            durability_->SyncFile(tempPath);
+        }
+        std::filesystem::rename(tempPath, finalPath); // Publishes the complete shard in one step
+        ++shardIndex_;
+    }
+
+    std::filesystem::path shardDirectory_; // Directory receiving the shard files
+    std::string shardPrefix_;              // Shard file name prefix
+    uint64_t maxShardBytes_;               // Size limit per shard in bytes (0 for none)
+    uint64_t maxShardSamples_;             // Sample limit per shard (0 for none)
+    OutputDurability* durability_;         // Flush policy for finished shards, or nullptr
+    std::vector<char> buffer_;             // Stream buffer backing shardFile_ (Constants::ARCHIVE_BUFFER_SIZE bytes)
+    std::ofstream shardFile_;              // Current shard output stream (written under its temporary name)
+    uint64_t modificationTime_;            // Entry modification time for tar headers (seconds since epoch)
+    unsigned int shardIndex_ = 0;          // Index of the current (or next) shard
+    uint64_t shardBytes_ = 0;              // Bytes written to the current shard
+    uint64_t shardSamples_ = 0;            // Samples written to the current shard
+    std::mutex mutex_;                     // Serializes concurrent AddSample/Finish calls
+};
+
+
+namespace FlacFormat {
+    constexpr unsigned int MAX_FIXED_ORDER = 4;       // Highest fixed predictor order tried per subframe
+    constexpr unsigned int MAX_PARTITION_ORDER = 8;   // Highest Rice partition order tried per subframe
+    constexpr unsigned int MAX_RICE_PARAMETER = 30;   // Highest Rice parameter representable with the 5-bit parameter coding method
+    constexpr unsigned int MAX_CHANNELS = 8;          // FLAC supports at most 8 channels
+    constexpr std::streamoff STREAMINFO_OFFSET = 8;   // Byte offset of the STREAMINFO block data ("fLaC" + 4-byte metadata block header)
+    constexpr size_t STREAMINFO_SIZE = 34;            // Size of the STREAMINFO block data (in bytes)
+
+    /**
+     * @class BitWriter
+     * @brief Appends big-endian bit fields to a byte string, as required by the FLAC frame format.
+     */
+    class BitWriter {
+    public:
+        /**
+         * @brief Appends the low bitCount bits of value (bitCount <= 32).
+         */
+        void Write(uint32_t value, unsigned int bitCount) {
+            if (bitCount == 0) {
+                return;
+            }
+            accumulator_ = (accumulator_ << bitCount) | (value & (bitCount == 32 ? 0xFFFFFFFFu : ((1u << bitCount) - 1)));
+            pendingBits_ += bitCount;
+            while (pendingBits_ >= 8) {
+                pendingBits_ -= 8;
+                bytes_.push_back(static_cast<char>((accumulator_ >> pendingBits_) & 0xFF));
+            }
+        }
+
+        /**
+         * @brief Appends a two's complement signed value using bitCount bits (bitCount <= 32).
+         */
+        void WriteSigned(int64_t value, unsigned int bitCount) {
+            Write(static_cast<uint32_t>(value), bitCount);
+        }
+
+        /**
+         * @brief Appends a Rice-coded value: the quotient in unary (zeros terminated by a one), then the low riceParameter bits.
+         */
+        void WriteRice(uint64_t value, unsigned int riceParameter) {
+            uint64_t quotient = value >> riceParameter;
+            while (quotient >= 32) {
+                Write(0, 32);
+                quotient -= 32;
+            }
+            Write(1, static_cast<unsigned int>(quotient) + 1); // quotient zeros followed by the terminating one
+            Write(static_cast<uint32_t>(value), riceParameter);
+        }
+
+        /**
+         * @brief Pads with zero bits up to the next byte boundary.
+         */
+        void AlignToByte() {
+            if (pendingBits_ > 0) {
+                Write(0, 8 - pendingBits_);
+            }
+        }
+
+        /**
+         * @brief Returns the bytes written so far (complete bytes only).
+         */
+        std::string& bytes() { return bytes_; }
+    private:
+        std::string bytes_;          // Completed output bytes
+        uint64_t accumulator_ = 0;   // Bits not yet flushed to bytes_ (only the low pendingBits_ are meaningful)
+        unsigned int pendingBits_ = 0; // Number of bits held in the accumulator
+    };
+
+    /**
+     * @brief Computes the CRC-8 (polynomial 0x07) used by FLAC frame headers.
+     */
+    uint8_t Crc8(const char* data, size_t size) {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= static_cast<uint8_t>(data[i]);
+            for (int k = 0; k < 8; ++k) {
+                crc = static_cast<uint8_t>((crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1));
+            }
+        }
+        return crc;
+    }
+
+    /**
+     * @brief Computes the CRC-16 (polynomial 0x8005) used by FLAC frame footers.
+     */
+    uint16_t Crc16(const char* data, size_t size) {
+        static const auto table = [] { // Builds the byte-wise lookup table once
+            std::array<uint16_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint16_t c = static_cast<uint16_t>(i << 8);
+                for (int k = 0; k < 8; ++k) {
+                    c = static_cast<uint16_t>((c & 0x8000) ? ((c << 1) ^ 0x8005) : (c << 1));
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint16_t crc = 0;
+        for (size_t i = 0; i < size; ++i) {
+            crc = static_cast<uint16_t>((crc << 8) ^ table[((crc >> 8) ^ static_cast<uint8_t>(data[i])) & 0xFF]);
+        }
+        return crc;
+    }
+
+    /**
+     * @struct SubframePlan
+     * @brief The cheapest encoding found for one channel of one frame.
+     */
+    struct SubframePlan {
+        enum class Type { Constant, Verbatim, Fixed } type = Type::Verbatim;
+        unsigned int order = 0;          // Fixed predictor order (Fixed only)
+        unsigned int partitionOrder = 0; // Rice partition order (Fixed only)
+        uint64_t bits = 0;               // Total encoded size of the subframe in bits
+    };
+
+    /**
+     * @brief Computes the residual of the fixed polynomial predictor of the given order at position i.
+     */
+    inline int64_t FixedResidual(const int64_t* x, size_t i, unsigned int order) {
+        switch (order) {
+        case 0: return x[i];
+        case 1: return x[i] - x[i - 1];
+        case 2: return x[i] - 2 * x[i - 1] + x[i - 2];
+        case 3: return x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+        default: return x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+        }
+    }
+
+    /**
+     * @brief Maps a signed residual to the unsigned value that is Rice coded (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...).
+     */
+    inline uint64_t ZigZag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    /**
+     * @brief Chooses the Rice parameter that minimizes the estimated size of a partition.
+     *
+     * @param sum Sum of the zig-zag mapped residuals in the partition.
+     * @param count Number of residuals in the partition.
+     * @param bits Receives the estimated size of the partition data in bits (excluding the parameter field).
+     * @return unsigned int The chosen Rice parameter.
+     */
+    unsigned int ChooseRiceParameter(uint64_t sum, uint64_t count, uint64_t& bits) {
+        unsigned int estimate = 0;
+        if (count > 0) {
+            while (estimate < MAX_RICE_PARAMETER && (count << (estimate + 1)) < sum) { // 2^k close to the mean residual
+                ++estimate;
+            }
+        }
+        unsigned int best = estimate;
+        bits = std::numeric_limits<uint64_t>::max();
+        for (unsigned int k = (estimate > 0 ? estimate - 1 : 0); k <= std::min(estimate + 1, MAX_RICE_PARAMETER); ++k) {
+            uint64_t candidate = count * (k + 1) + (sum >> k);
+            if (candidate < bits) {
+                bits = candidate;
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @brief Finds the cheapest subframe encoding (constant, verbatim or fixed predictor with Rice coded residual) for one channel.
+     *
+     * @param x Channel samples of the frame.
+     * @param blockSize Number of samples in the frame.
+     * @param bitsPerSample Bit depth of this channel (one more than the stream bit depth for side channels).
+     * @param residuals Scratch buffer of at least blockSize elements, receives the residuals of the chosen fixed order.
+     * @return SubframePlan The cheapest encoding found.
+     */
+    SubframePlan PlanSubframe(const int64_t* x, unsigned int blockSize, unsigned int bitsPerSample, std::vector<uint64_t>& residuals) {
+        SubframePlan best;
+        best.type = SubframePlan::Type::Verbatim;
+        best.bits = 8 + static_cast<uint64_t>(blockSize) * bitsPerSample;
+
+        if (std::all_of(x, x + blockSize, [&](int64_t v) { return v == x[0]; })) { // Silence and DC runs
+            best.type = SubframePlan::Type::Constant;
+            best.bits = 8 + bitsPerSample;
+            return best;
+        }
+
+        std::vector<uint64_t> candidate(blockSize);
+        for (unsigned int order = 0; order <= MAX_FIXED_ORDER && order < blockSize; ++order) {
+            bool fits = true;
+            for (unsigned int i = order; i < blockSize; ++i) {
+                int64_t residual = FixedResidual(x, i, order);
+                if (residual > std::numeric_limits<int32_t>::max() || residual < std::numeric_limits<int32_t>::min()) { // FLAC residuals must fit in 32 bits
+                    fits = false;
+                    break;
+                }
+                candidate[i] = ZigZag(residual);
+            }
+            if (!fits) {
+                continue;
+            }
+
+            unsigned int maxPartitionOrder = 0; // Partitions must divide the block evenly and the first one must hold more than the warm-up samples
+            while (maxPartitionOrder < MAX_PARTITION_ORDER && (blockSize % (2u << maxPartitionOrder)) == 0 && (blockSize >> (maxPartitionOrder + 1)) > order) {
+                ++maxPartitionOrder;
+            }
+            for (unsigned int partitionOrder = 0; partitionOrder <= maxPartitionOrder; ++partitionOrder) {
+                unsigned int partitions = 1u << partitionOrder;
+                unsigned int partitionSize = blockSize >> partitionOrder;
+                uint64_t bits = 8 + static_cast<uint64_t>(order) * bitsPerSample + 2 + 4; // Header, warm-up samples, coding method, partition order
+                for (unsigned int p = 0; p < partitions; ++p) {
+                    unsigned int start = (p == 0) ? order : p * partitionSize;
+                    unsigned int end = (p + 1) * partitionSize;
+                    uint64_t sum = 0;
+                    for (unsigned int i = start; i < end; ++i) {
+                        sum += candidate[i];
+                    }
+                    uint64_t partitionBits = 0;
+                    ChooseRiceParameter(sum, end - start, partitionBits);
+                    bits += 5 + partitionBits; // 5-bit parameter field is the worst case of both coding methods
+                }
+                if (bits < best.bits) {
+                    best.type = SubframePlan::Type::Fixed;
+                    best.order = order;
+                    best.partitionOrder = partitionOrder;
+                    best.bits = bits;
+                    residuals.assign(candidate.begin(), candidate.end());
+                }
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @brief Writes one subframe according to its plan.
+     */
+    void WriteSubframe(BitWriter& writer, const int64_t* x, unsigned int blockSize, unsigned int bitsPerSample, const SubframePlan& plan, const std::vector<uint64_t>& residuals) {
+        switch (plan.type) {
+        case SubframePlan::Type::Constant:
+            writer.Write(0x00, 8); // Zero pad bit, type 000000, no wasted bits
+            writer.WriteSigned(x[0], bitsPerSample);
+            return;
+        case SubframePlan::Type::Verbatim:
+            writer.Write(0x02, 8); // Zero pad bit, type 000001, no wasted bits
+            for (unsigned int i = 0; i < blockSize; ++i) {
+                writer.WriteSigned(x[i], bitsPerSample);
+            }
+            return;
+        case SubframePlan::Type::Fixed:
+            break;
+        }
+
+        writer.Write((0x08 | plan.order) << 1, 8); // Zero pad bit, type 001xxx (fixed predictor of order xxx), no wasted bits
+        for (unsigned int i = 0; i < plan.order; ++i) { // Warm-up samples
+            writer.WriteSigned(x[i], bitsPerSample);
+        }
+
+        unsigned int partitions = 1u << plan.partitionOrder;
+        unsigned int partitionSize = blockSize >> plan.partitionOrder;
+        std::vector<unsigned int> parameters(partitions);
+        bool needsWideParameters = false;
+        for (unsigned int p = 0; p < partitions; ++p) {
+            unsigned int start = (p == 0) ? plan.order : p * partitionSize;
+            unsigned int end = (p + 1) * partitionSize;
+            uint64_t sum = 0;
+            for (unsigned int i = start; i < end; ++i) {
+                sum += residuals[i];
+            }
+            uint64_t unusedBits = 0;
+            parameters[p] = ChooseRiceParameter(sum, end - start, unusedBits);
+            needsWideParameters = needsWideParameters || parameters[p] >= 15; // 15 is the escape code of the 4-bit method
+        }
+
+        writer.Write(needsWideParameters ? 1 : 0, 2); // Residual coding method: 4-bit or 5-bit Rice parameters
+        writer.Write(plan.partitionOrder, 4);
+        for (unsigned int p = 0; p < partitions; ++p) {
+            unsigned int start = (p == 0) ? plan.order : p * partitionSize;
+            unsigned int end = (p + 1) * partitionSize;
+            writer.Write(parameters[p], needsWideParameters ? 5 : 4);
+            for (unsigned int i = start; i < end; ++i) {
+                writer.WriteRice(residuals[i], parameters[p]);
+            }
+        }
+    }
+
+    /**
+     * @brief Appends a frame or sample number using FLAC's extended UTF-8 style coding.
+     */
+    void WriteCodedNumber(BitWriter& writer, uint64_t value) {
+        if (value < 0x80) {
+            writer.Write(static_cast<uint32_t>(value), 8);
+            return;
+        }
+        unsigned int continuationBytes = 1;
+        while (continuationBytes < 6 && value >= (1ULL << (6 + 5 * continuationBytes))) { // Payload bits: 11, 16, 21, 26, 31, 36
+            ++continuationBytes;
+        }
+        uint32_t leading = (0xFF00u >> (continuationBytes + 1)) & 0xFF; // continuationBytes + 1 leading one bits
+        writer.Write(leading | static_cast<uint32_t>(value >> (6 * continuationBytes)), 8);
+        for (int i = static_cast<int>(continuationBytes) - 1; i >= 0; --i) {
+            writer.Write(0x80 | static_cast<uint32_t>((value >> (6 * i)) & 0x3F), 8);
+        }
+    }
+
+    /**
+     * @brief Encodes one complete FLAC frame (header, subframes, footer) from interleaved integer samples.
+     *
+     * @param samples Interleaved samples of the frame (blockSize * channels values).
+     * @param blockSize Number of samples per channel in the frame.
+     * @param channels Number of channels (1 to 8).
+     * @param bitsPerSample Stream bit depth.
+     * @param frameNumber Index of the frame in the stream.
+     * @return std::string The encoded frame bytes.
+     *
+     * @details
+     * Stereo frames are encoded with whichever of left/right, left/side, right/side or mid/side decorrelation is smallest.
+     * Each channel uses the cheapest of a constant, verbatim or fixed-predictor subframe; LPC subframes are not used.
+     */
+    std::string EncodeFrame(const int32_t* samples, unsigned int blockSize, unsigned int channels, unsigned int bitsPerSample, uint64_t frameNumber) {
+        std::vector<std::vector<int64_t>> channelData(channels, std::vector<int64_t>(blockSize));
+        for (unsigned int i = 0; i < blockSize; ++i) { // Deinterleave
+            for (unsigned int c = 0; c < channels; ++c) {
+                channelData[c][i] = samples[static_cast<size_t>(i) * channels + c];
+            }
+        }
+
+        struct Subframe { // One encoded channel of the frame
+            const int64_t* data;
+            unsigned int bitsPerSample;
+            SubframePlan plan;
+            std::vector<uint64_t> residuals;
+        };
+        std::vector<Subframe> subframes;
+        unsigned int channelAssignment = channels - 1; // Independent channels
+
+        if (channels == 2 && bitsPerSample < 32) { // Side channel needs one extra bit, which 32-bit streams cannot spare
+            channelData.emplace_back(blockSize); // Mid
+            channelData.emplace_back(blockSize); // Side
+            for (unsigned int i = 0; i < blockSize; ++i) {
+                channelData[2][i] = (channelData[0][i] + channelData[1][i]) >> 1;
+                channelData[3][i] = channelData[0][i] - channelData[1][i];
+            }
+            std::vector<Subframe> candidates(4); // Left, right, mid, side
+            for (unsigned int k = 0; k < 4; ++k) {
+                candidates[k].data = channelData[k].data();
+                candidates[k].bitsPerSample = (k == 3) ? bitsPerSample + 1 : bitsPerSample;
+                candidates[k].residuals.resize(blockSize);
+                candidates[k].plan = PlanSubframe(candidates[k].data, blockSize, candidates[k].bitsPerSample, candidates[k].residuals);
+            }
+            const struct { unsigned int assignment; unsigned int first; unsigned int second; } options[4] = {
+                { 1, 0, 1 }, { 8, 0, 3 }, { 9, 3, 1 }, { 10, 2, 3 } // Independent, left/side, right/side, mid/side
+            };
+            unsigned int best = 0;
+            for (unsigned int k = 1; k < 4; ++k) {
+                if (candidates[options[k].first].plan.bits + candidates[options[k].second].plan.bits <
+                    candidates[options[best].first].plan.bits + candidates[options[best].second].plan.bits) {
+                    best = k;
+                }
+            }
+            channelAssignment = options[best].assignment;
+            subframes.push_back(std::move(candidates[options[best].first]));
+            subframes.push_back(std::move(candidates[options[best].second]));
+        }
+        else {
+            for (unsigned int c = 0; c < channels; ++c) {
+                Subframe subframe{ channelData[c].data(), bitsPerSample, SubframePlan(), std::vector<uint64_t>(blockSize) };
+                subframe.plan = PlanSubframe(subframe.data, blockSize, bitsPerSample, subframe.residuals);
+                subframes.push_back(std::move(subframe));
+            }
+        }
+
+        BitWriter writer;
+        writer.Write(0xFFF8, 16); // Sync code, reserved bit, fixed block size strategy
+        writer.Write(0x7, 4);     // Block size: 16-bit (blocksize - 1) at the end of the header
+        writer.Write(0x0, 4);     // Sample rate: from STREAMINFO
+        writer.Write(channelAssignment, 4);
+        writer.Write(0x0, 3);     // Sample size: from STREAMINFO
+        writer.Write(0x0, 1);     // Reserved
+        WriteCodedNumber(writer, frameNumber);
+        writer.Write(blockSize - 1, 16);
+        writer.Write(Crc8(writer.bytes().data(), writer.bytes().size()), 8);
+        for (const Subframe& subframe : subframes) {
+            WriteSubframe(writer, subframe.data, blockSize, subframe.bitsPerSample, subframe.plan, subframe.residuals);
+        }
+        writer.AlignToByte();
+        writer.Write(Crc16(writer.bytes().data(), writer.bytes().size()), 16);
+        return std::move(writer.bytes());
+    }
+}
+
+/**
+ * @class FlacEncoderPool
+ * @brief Persistent worker threads that encode FLAC frame batches, shared by every FLAC sound of an extraction run.
+ *
+ * @details
+ * Start hands a job to all workers and returns at once, so the calling thread can decode the next batch while the
+ * current one is encoded; Wait blocks until every worker has finished the job. An exception thrown by a worker is
+ * caught on that worker and rethrown by Wait on the calling thread. One job runs at a time.
+ */
+class FlacEncoderPool {
+public:
+    /**
+     * @brief Job run by every worker: receives the worker index and the number of workers.
+     */
+    using Job = std::function<void(size_t worker, size_t workers)>;
+
+    /**
+     * @brief Constructor for FlacEncoderPool. Starts the worker threads.
+     *
+     * @param threadCount Number of worker threads (at least 1).
+     */
+    explicit FlacEncoderPool(unsigned int threadCount) {
+        const size_t workers = std::max(1u, threadCount);
+        for (size_t worker = 0; worker < workers; ++worker) {
+            threads_.emplace_back(&FlacEncoderPool::WorkerLoop, this, worker);
+        }
+    }
+
+    /**
+     * @brief Destructor for FlacEncoderPool. Lets a running job finish and stops the workers.
+     */
+    ~FlacEncoderPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        startCondition_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    FlacEncoderPool(const FlacEncoderPool&) = delete;
+    FlacEncoderPool& operator=(const FlacEncoderPool&) = delete;
+
+    size_t workerCount() const { return threads_.size(); }
+
+    /**
+     * @brief Runs a job on every worker without waiting for it. The previous job must have been waited for.
+     */
+    void Start(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = std::move(job);
+            running_ = threads_.size();
+            ++generation_;
+        }
+        startCondition_.notify_all();
+    }
+
+    /**
+     * @brief Waits until every worker has finished the current job. Rethrows the first exception a worker threw.
+     */
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        doneCondition_.wait(lock, [this] { return running_ == 0; });
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+private:
+    void WorkerLoop(size_t worker) {
+        uint64_t seenGeneration = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            startCondition_.wait(lock, [&] { return stop_ || generation_ != seenGeneration; });
+            if (generation_ == seenGeneration) { // Stopping, and no job left to run
+                return;
+            }
+            seenGeneration = generation_;
+            lock.unlock();
+            TraceEvents::NameThread("FLAC encoder", static_cast<long long>(worker) + 1); // One track per worker (no-op once named)
+            std::exception_ptr error;
+            try {
+                job_(worker, threads_.size());
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            lock.lock();
+            if (error && !error_) {
+                error_ = error;
+            }
+            if (--running_ == 0) {
+                doneCondition_.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads_;         // Worker threads
+    std::mutex mutex_;                         // Guards the job state below
+    std::condition_variable startCondition_;   // Wakes the workers for a new job or to stop
+    std::condition_variable doneCondition_;    // Wakes Wait when the last worker finishes
+    Job job_;                                  // Current job (read by the workers while it runs)
+    uint64_t generation_ = 0;                  // Incremented by every Start
+    size_t running_ = 0;                       // Workers that have not finished the current job
+    bool stop_ = false;                        // Set by the destructor
+    std::exception_ptr error_;                 // First exception thrown by a worker during the current job
+};
+
+/**
+ * @class FlacEncoderBuffer
+ * @brief Stream buffer that FLAC-encodes the integer PCM data written into it, using several threads.
+ *
+ * @details
+ * The AudioProcessor chunk writers write decoded PCM into an std::ostream backed by this buffer, exactly as they would write a WAV file.
+ * Incoming bytes are collected into frames of Constants::FLAC_BLOCK_SIZE samples; once a batch of frames is available, it is handed to the
+ * FlacEncoderPool, which encodes the frames in parallel (each frame is independent in FLAC) while the next batch is decoded into a second buffer.
+ * The encoded frames are appended to the output stream in order when the next batch is handed over (or by Finish); an exception thrown
+ * while encoding is rethrown there. Without a pool, each batch is encoded on the calling thread.
+ * Finish() encodes the remaining samples and rewrites the STREAMINFO block with the final totals when the output stream is seekable;
+ * on a pipe the block keeps total samples and frame sizes at 0, which FLAC defines as "unknown".
+ * PCM8 bytes are interpreted as unsigned samples, the same way the WAV output stores them; PCMFLOAT data is not supported by FLAC.
+ */
+class FlacEncoderBuffer : public std::streambuf {
+public:
+    /**
+     * @brief Constructor for FlacEncoderBuffer. Writes the FLAC stream marker and a provisional STREAMINFO block.
+     *
+     * @param output Stream receiving the FLAC file.
+     * @param soundInfo Format of the PCM data that will be written.
+     * @param pool Worker threads encoding the frames, or nullptr to encode on the calling thread.
+     * @param seekableOutput False if the output cannot be rewound (a pipe); STREAMINFO then keeps "unknown" totals.
+     */
+    FlacEncoderBuffer(std::ostream& output, const SoundInfo& soundInfo, FlacEncoderPool* pool, bool seekableOutput)
+        : output_(output), seekableOutput_(seekableOutput), sampleRate_(soundInfo.sampleRate), channels_(static_cast<unsigned int>(soundInfo.channels)),
+        bitsPerSample_(static_cast<unsigned int>(soundInfo.bitsPerSample)), bytesPerSample_(bitsPerSample_ / Constants::BITS_IN_BYTE),
+        unsignedSamples_(soundInfo.format == FMOD_SOUND_FORMAT_PCM8), pool_(pool) {
+        frameBytes_ = static_cast<size_t>(Constants::FLAC_BLOCK_SIZE) * channels_ * bytesPerSample_;
+        const size_t workers = pool_ ? pool_->workerCount() : 1;
+        pending_.reserve(frameBytes_ * workers * Constants::FLAC_FRAMES_PER_THREAD); // A batch is always a whole number of frames
+        encoding_.reserve(pending_.capacity());
+        workerSamples_.resize(workers);
+        output_.write("fLaC", 4);
+        output_.put(static_cast<char>(0x80)); // Last metadata block flag, block type 0 (STREAMINFO)
+        output_.put(0);
+        output_.put(0);
+        output_.put(static_cast<char>(FlacFormat::STREAMINFO_SIZE));
+        WriteStreamInfo();
+    }
+
+    /**
+     * @brief Destructor for FlacEncoderBuffer. Waits for a batch still being encoded (when unwinding after an error); its frames are discarded.
+     */
+    ~FlacEncoderBuffer() override {
+        if (batchInFlight_) {
+            try {
+                pool_->Wait();
+            }
+            catch (...) {
+                // The sound has already failed; the encoder error adds nothing
+            }
+        }
+    }
+
+    FlacEncoderBuffer(const FlacEncoderBuffer&) = delete;
+    FlacEncoderBuffer& operator=(const FlacEncoderBuffer&) = delete;
+
+    /**
+     * @brief Returns true if the sound format can be stored losslessly as FLAC.
+     *
+     * @param soundInfo Format of the sound.
+     * @return bool True for 8/16/24-bit integer PCM with 1 to 8 channels (32-bit PCM is extracted as WAV instead).
+     */
+    static bool IsSupported(const SoundInfo& soundInfo) {
+        bool integerPcm = soundInfo.format == FMOD_SOUND_FORMAT_PCM8 || soundInfo.format == FMOD_SOUND_FORMAT_PCM16 ||
+            soundInfo.format == FMOD_SOUND_FORMAT_PCM24; // 32-bit FLAC is not readable by most decoders (libFLAC < 1.4)
+        return integerPcm && soundInfo.channels >= 1 && static_cast<unsigned int>(soundInfo.channels) <= FlacFormat::MAX_CHANNELS &&
+            soundInfo.bitsPerSample == static_cast<int>(SoundFormatBits(soundInfo.format)) && soundInfo.sampleRate > 0 && soundInfo.sampleRate < (1 << 20);
+    }
+
+    /**
+     * @brief Encodes all remaining samples and patches the STREAMINFO block with the final totals (seekable output only).
+     *
+     * @return bool True if all data was written successfully, false otherwise.
+     */
+    bool Finish() {
+        EncodeBatch(true); // Also collects the batch in flight
+        if (seekableOutput_) {
+            std::streampos end = output_.tellp();
+            output_.seekp(FlacFormat::STREAMINFO_OFFSET, std::ios::beg);
+            WriteStreamInfo();
+            output_.seekp(end);
+        }
+        return output_.good();
+    }
+
+    /**
+     * @brief Returns the number of PCM bytes written into the encoder so far.
+     */
+    uint64_t pcmBytes() const { return pcmBytes_; }
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        const char* cursor = data;
+        std::streamsize remaining = size;
+        while (remaining > 0) {
+            size_t room = pending_.capacity() - pending_.size();
+            size_t take = std::min<size_t>(room, static_cast<size_t>(remaining));
+            pending_.insert(pending_.end(), cursor, cursor + take);
+            cursor += take;
+            remaining -= static_cast<std::streamsize>(take);
+            if (pending_.size() == pending_.capacity()) { // A full batch of frames is ready
+                EncodeBatch(false);
+            }
+        }
+        pcmBytes_ += static_cast<uint64_t>(size);
+        return output_.good() ? size : 0;
+    }
+
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        char c = traits_type::to_char_type(ch);
+        return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+    }
+private:
+    /**
+     * @brief Returns the number of bits per sample of an integer PCM format.
+     */
+    static unsigned int SoundFormatBits(FMOD_SOUND_FORMAT format) {
+        switch (format) {
+        case FMOD_SOUND_FORMAT_PCM8:  return 8;
+        case FMOD_SOUND_FORMAT_PCM16: return 16;
+        case FMOD_SOUND_FORMAT_PCM24: return 24;
+        case FMOD_SOUND_FORMAT_PCM32: return 32;
+        default:                      return 0;
+        }
+    }
+
+    /**
+     * @brief Hands the pending PCM bytes to the encoder as a batch of frames, after writing out the previous batch.
+     *
+     * @param finalBatch True to also encode a trailing partial frame (end of stream) and wait for the batch.
+     */
+    void EncodeBatch(bool finalBatch) {
+        CollectBatch();
+        const size_t sampleFrameBytes = static_cast<size_t>(channels_) * bytesPerSample_;
+        const size_t fullFrames = pending_.size() / frameBytes_;
+        const size_t tailSamples = finalBatch ? (pending_.size() - fullFrames * frameBytes_) / sampleFrameBytes : 0;
+        const size_t frameCount = fullFrames + (tailSamples > 0 ? 1 : 0);
+        if (frameCount == 0) {
+            return;
+        }
+
+        std::swap(pending_, encoding_); // The batch keeps its bytes while the next one is collected
+        const size_t batchBytes = fullFrames * frameBytes_ + tailSamples * sampleFrameBytes;
+        pending_.assign(encoding_.begin() + static_cast<std::ptrdiff_t>(batchBytes), encoding_.end()); // Incomplete frame, if any
+        batchFullFrames_ = fullFrames;
+        batchTailSamples_ = tailSamples;
+        if (frames_.size() < frameCount) {
+            frames_.resize(frameCount);
+        }
+        batchFrameCount_ = frameCount;
+        batchFirstFrame_ = frameNumber_;
+        frameNumber_ += frameCount;
+
+        if (pool_) {
+            pool_->Start([this](size_t worker, size_t workers) { EncodeFrames(worker, workers); });
+            batchInFlight_ = true;
+            if (finalBatch) {
+                CollectBatch();
+            }
+        }
+        else {
+            EncodeFrames(0, 1);
+            batchInFlight_ = true;
+            CollectBatch();
+        }
+    }
+
+    /**
+     * @brief Converts and encodes every step-th frame of the batch, starting at first (runs on the pool workers).
+     */
+    void EncodeFrames(size_t first, size_t step) {
+        TraceEvents::Scope encodeScope("FLAC encode");
+        PerfCounters::Scope perfScope(PerfCounters::Convert);
+        std::vector<int32_t>& samples = workerSamples_[first];
+        for (size_t f = first; f < batchFrameCount_; f += step) {
+            unsigned int blockSize = (f < batchFullFrames_) ? Constants::FLAC_BLOCK_SIZE : static_cast<unsigned int>(batchTailSamples_);
+            ConvertSamples(encoding_.data() + f * frameBytes_, static_cast<size_t>(blockSize) * channels_, samples);
+            frames_[f] = FlacFormat::EncodeFrame(samples.data(), blockSize, channels_, bitsPerSample_, batchFirstFrame_ + f);
+        }
+    }
+
+    /**
+     * @brief Waits for the batch being encoded, if any, and appends its frames to the output in order.
+     */
+    void CollectBatch() {
+        if (!batchInFlight_) {
+            return;
+        }
+        batchInFlight_ = false;
+        if (pool_) {
+            pool_->Wait(); // Rethrows an exception thrown while encoding
+        }
+        for (size_t f = 0; f < batchFrameCount_; ++f) {
+            output_.write(frames_[f].data(), static_cast<std::streamsize>(frames_[f].size()));
+            uint32_t frameSize = static_cast<uint32_t>(frames_[f].size());
+            minFrameSize_ = (minFrameSize_ == 0) ? frameSize : std::min(minFrameSize_, frameSize);
+            maxFrameSize_ = std::max(maxFrameSize_, frameSize);
+        }
+        totalSamples_ += batchFullFrames_ * Constants::FLAC_BLOCK_SIZE + batchTailSamples_;
+        lastBlockSize_ = (batchTailSamples_ > 0) ? static_cast<unsigned int>(batchTailSamples_) : Constants::FLAC_BLOCK_SIZE;
+    }
+
+    /**
+     * @brief Converts little-endian PCM bytes to 32-bit integer samples.
+     */
+    void ConvertSamples(const char* data, size_t sampleCount, std::vector<int32_t>& samples) const {
+        samples.resize(sampleCount);
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < sampleCount; ++i, bytes += bytesPerSample_) {
+            switch (bytesPerSample_) {
+            case 1:
+                samples[i] = unsignedSamples_ ? static_cast<int32_t>(bytes[0]) - 128 : static_cast<int8_t>(bytes[0]);
+                break;
+            case 2:
+                samples[i] = static_cast<int16_t>(bytes[0] | (bytes[1] << 8));
+                break;
+            case 3:
+                samples[i] = static_cast<int32_t>(static_cast<uint32_t>(bytes[0] << 8 | bytes[1] << 16 | bytes[2] << 24)) >> 8; // Sign-extends the 24-bit value
+                break;
+            default:
+                samples[i] = static_cast<int32_t>(static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 | static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24);
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Writes the 34-byte STREAMINFO block data at the current output position.
+     */
+    void WriteStreamInfo() {
+        unsigned int blockSize = Constants::FLAC_BLOCK_SIZE;
+        if (frameNumber_ <= 1 && lastBlockSize_ > 0) { // A single (short) frame defines both block size limits
+            blockSize = std::max(16u, lastBlockSize_);
+        }
+        FlacFormat::BitWriter writer;
+        writer.Write(blockSize, 16);       // Minimum block size
+        writer.Write(blockSize, 16);       // Maximum block size
+        writer.Write(minFrameSize_, 24);   // Minimum frame size (0 = unknown)
+        writer.Write(maxFrameSize_, 24);   // Maximum frame size (0 = unknown)
+        writer.Write(static_cast<uint32_t>(sampleRate_), 20);
+        writer.Write(channels_ - 1, 3);
+        writer.Write(bitsPerSample_ - 1, 5);
+        writer.Write(static_cast<uint32_t>(totalSamples_ >> 32), 4); // Total samples (36 bits)
+        writer.Write(static_cast<uint32_t>(totalSamples_), 32);
+        for (int i = 0; i < 4; ++i) {
+            writer.Write(0, 32); // MD5 signature of the unencoded audio (0 = not computed)
+        }
+        output_.write(writer.bytes().data(), static_cast<std::streamsize>(writer.bytes().size()));
+    }
+
+    std::ostream& output_;            // Stream receiving the FLAC file
+    bool seekableOutput_;             // True if STREAMINFO can be rewritten by Finish()
+    int sampleRate_;                  // Sample rate in Hz
+    unsigned int channels_;           // Number of channels
+    unsigned int bitsPerSample_;      // Bit depth of the PCM data
+    unsigned int bytesPerSample_;     // Bytes per sample of the PCM data
+    bool unsignedSamples_;            // True for PCM8, which is stored unsigned like in WAV files
+    FlacEncoderPool* pool_;           // Worker threads encoding the batches, or nullptr
+    size_t frameBytes_ = 0;           // PCM bytes per full frame
+    std::vector<char> pending_;       // PCM bytes not yet encoded (capacity is one batch)
+    std::vector<char> encoding_;      // PCM bytes of the batch being encoded
+    std::vector<std::string> frames_; // Encoded frames of the batch, in order
+    std::vector<std::vector<int32_t>> workerSamples_; // Sample conversion buffer of each worker
+    size_t batchFullFrames_ = 0;      // Full frames in the batch
+    size_t batchTailSamples_ = 0;     // Samples per channel of the trailing partial frame (final batch only)
+    size_t batchFrameCount_ = 0;      // Frames in the batch
+    uint64_t batchFirstFrame_ = 0;    // Frame number of the first frame of the batch
+    bool batchInFlight_ = false;      // True until the batch's frames have been written
+    uint64_t pcmBytes_ = 0;           // Total PCM bytes received
+    uint64_t frameNumber_ = 0;        // Number of frames written so far
+    uint64_t totalSamples_ = 0;       // Number of samples per channel written so far
+    unsigned int lastBlockSize_ = 0;  // Block size of the most recent frame
+    uint32_t minFrameSize_ = 0;       // Smallest encoded frame in bytes
+    uint32_t maxFrameSize_ = 0;       // Largest encoded frame in bytes
+};
+
+
+namespace TensorFormat {
+    constexpr size_t NPY_HEADER_SIZE = 128;         // Fixed size of the .npy header (magic, version, length and padded dictionary), a multiple of 64
+    constexpr size_t NPY_PREAMBLE_SIZE = 10;        // Magic string, version and header length field that precede the dictionary
+    constexpr size_t CONVERT_BLOCK_SAMPLES = 16384; // Samples converted per block by FloatTensorBuffer
+
+    /**
+     * @brief Writes a .npy (format version 1.0) header for a little-endian float32 array with the given 2-D shape.
+     *
+     * @param output Output stream, positioned where the header starts.
+     * @param rows First dimension of the array (frames for interleaved layout, channels for planar layout).
+     * @param columns Second dimension of the array (channels for interleaved layout, frames for planar layout).
+     * @return bool True if the header was written successfully, false otherwise.
+     *
+     * @details
+     * The dictionary is padded with spaces to a fixed header size, so the header can be rewritten in place
+     * with the final shape once the number of frames is known.
+     */
+    inline bool WriteNpyHeader(std::ostream& output, uint64_t rows, uint64_t columns) {
+        std::string dictionary = "{'descr': '<f4', 'fortran_order': False, 'shape': (" + std::to_string(rows) + ", " + std::to_string(columns) + "), }";
+        dictionary.resize(NPY_HEADER_SIZE - NPY_PREAMBLE_SIZE - 1, ' ');
+        dictionary += '\n';
+        const uint16_t headerLength = static_cast<uint16_t>(dictionary.size());
+        output.write("\x93NUMPY\x01\x00", 8);
+        output.put(static_cast<char>(headerLength & 0xFF));
+        output.put(static_cast<char>(headerLength >> 8));
+        output.write(dictionary.data(), static_cast<std::streamsize>(dictionary.size()));
+        return output.good();
+    }
+
+    /**
+     * @brief Returns the number of bytes per sample of the PCM data written by the chunk writers.
+     */
+    inline size_t BytesPerSample(FMOD_SOUND_FORMAT format) {
+        switch (format) {
+        case FMOD_SOUND_FORMAT_PCM8:     return 1;
+        case FMOD_SOUND_FORMAT_PCM24:    return 3;
+        case FMOD_SOUND_FORMAT_PCM32:    return 4;
+        case FMOD_SOUND_FORMAT_PCMFLOAT: return 4;
+        default:                         return 2; // PCM16, and unsupported formats, which ProcessSubSound extracts as PCM16
+        }
+    }
+    // Sample conversion kernels: plain loops over contiguous arrays with a constant scale, which the compiler may auto-vectorize.
+
+    /**
+     * @brief Converts unsigned 8-bit samples (as stored in WAV files) to float in [-1, 1).
+     */
+    inline void ConvertPCM8(const uint8_t* input, float* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = (static_cast<float>(input[i]) - 128.0f) * (1.0f / 128.0f);
+        }
+    }
+
+    /**
+     * @brief Converts signed 16-bit samples to float in [-1, 1).
+     */
+    inline void ConvertPCM16(const int16_t* input, float* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = static_cast<float>(input[i]) * (1.0f / 32768.0f);
+        }
+    }
+
+    /**
+     * @brief Converts packed little-endian signed 24-bit samples (3 bytes each) to float in [-1, 1).
+     */
+    inline void ConvertPCM24(const uint8_t* input, float* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            int32_t value = static_cast<int32_t>(static_cast<uint32_t>(input[3 * i]) << 8 | static_cast<uint32_t>(input[3 * i + 1]) << 16 | static_cast<uint32_t>(input[3 * i + 2]) << 24) >> 8; // Sign-extends the 24-bit value
+            output[i] = static_cast<float>(value) * (1.0f / 8388608.0f);
+        }
+    }
+
+    /**
+     * @brief Converts signed 32-bit samples to float in [-1, 1].
+     */
+    inline void ConvertPCM32(const int32_t* input, float* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = static_cast<float>(input[i]) * (1.0f / 2147483648.0f);
+        }
+    }
+}
+
+
+/**
+ * @class FloatTensorBuffer
+ * @brief Stream buffer that converts the PCM data written into it to little-endian float32 samples.
+ *
+ * @details
+ * The AudioProcessor chunk writers write decoded PCM into an std::ostream backed by this buffer, exactly as they would write a WAV file.
+ * Whole sample frames are converted block-wise with the TensorFormat kernels; a trailing partial frame is kept until more data arrives.
+ * With interleaved layout the floats are written to the output stream as they are converted ([frame][channel] order).
+ * With planar layout ([channel][frame] order) every channel is collected in memory and written by Finish(), because the
+ * number of frames is not known before the end of the stream.
+ * PCM8 bytes are interpreted as unsigned samples, the same way the WAV output stores them; PCMFLOAT data is copied unchanged.
+ */
+class FloatTensorBuffer : public std::streambuf {
+public:
+    /**
+     * @brief Constructor for FloatTensorBuffer.
+     *
+     * @param output Stream receiving the float32 samples.
+     * @param soundInfo Format of the PCM data that will be written.
+     * @param planarLayout True to write all samples of a channel contiguously, false for interleaved samples.
+     */
+    FloatTensorBuffer(std::ostream& output, const SoundInfo& soundInfo, bool planarLayout)
+        : output_(output), format_(soundInfo.format), channels_(static_cast<size_t>(std::max(1, soundInfo.channels))),
+        bytesPerSample_(TensorFormat::BytesPerSample(soundInfo.format)), planarLayout_(planarLayout),
+        floats_(TensorFormat::CONVERT_BLOCK_SAMPLES), planes_(planarLayout ? channels_ : 0) {
+        frameBytes_ = channels_ * bytesPerSample_;
+    }
+
+    /**
+     * @brief Writes the collected channels (planar layout only). Any trailing partial frame is dropped.
+     *
+     * @return bool True if all data was written successfully, false otherwise.
+     */
+    bool Finish() {
+        if (planarLayout_) {
+            for (std::vector<float>& plane : planes_) {
+                output_.write(reinterpret_cast<const char*>(plane.data()), static_cast<std::streamsize>(plane.size() * sizeof(float)));
+                std::vector<float>().swap(plane);
+            }
+        }
+        return output_.good();
+    }
+
+    /**
+     * @brief Returns the number of PCM bytes written into the buffer so far.
+     */
+    uint64_t pcmBytes() const { return pcmBytes_; }
+
+    /**
+     * @brief Returns the number of complete sample frames (one sample per channel) converted so far.
+     */
+    uint64_t frames() const { return frames_; }
+
+    /**
+     * @brief Returns the number of channels of the converted data.
+     */
+    size_t channels() const { return channels_; }
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        const char* cursor = data;
+        size_t remaining = static_cast<size_t>(size);
+        if (!partial_.empty()) { // Completes the frame left over from the previous write
+            size_t take = std::min(frameBytes_ - partial_.size(), remaining);
+            partial_.insert(partial_.end(), cursor, cursor + take);
+            cursor += take;
+            remaining -= take;
+            if (partial_.size() == frameBytes_) {
+                Convert(partial_.data(), 1);
+                partial_.clear();
+            }
+        }
+        size_t wholeFrames = remaining / frameBytes_;
+        Convert(cursor, wholeFrames);
+        cursor += wholeFrames * frameBytes_;
+        partial_.insert(partial_.end(), cursor, data + size);
+        pcmBytes_ += static_cast<uint64_t>(size);
+        return output_.good() ? size : 0;
+    }
+
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        char c = traits_type::to_char_type(ch);
+        return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+    }
+private:
+    /**
+     * @brief Converts whole sample frames to float and writes (interleaved) or collects (planar) them.
+     *
+     * @param data PCM bytes of the frames.
+     * @param frameCount Number of frames in data.
+     */
+    void Convert(const char* data, size_t frameCount) {
+        PerfCounters::Scope perfScope(PerfCounters::Convert);
+        const size_t framesPerBlock = std::max<size_t>(1, floats_.size() / channels_);
+        while (frameCount > 0) {
+            size_t blockFrames = std::min(frameCount, framesPerBlock);
+            size_t sampleCount = blockFrames * channels_;
+            switch (format_) {
+            case FMOD_SOUND_FORMAT_PCM8:
+                TensorFormat::ConvertPCM8(reinterpret_cast<const uint8_t*>(data), floats_.data(), sampleCount);
+                break;
+            case FMOD_SOUND_FORMAT_PCM24:
+                TensorFormat::ConvertPCM24(reinterpret_cast<const uint8_t*>(data), floats_.data(), sampleCount);
+                break;
+            case FMOD_SOUND_FORMAT_PCM32:
+                integers32_.resize(sampleCount);
+                std::memcpy(integers32_.data(), data, sampleCount * sizeof(int32_t)); // Aligned copy, so the conversion loop reads typed samples
+                TensorFormat::ConvertPCM32(integers32_.data(), floats_.data(), sampleCount);
+                break;
+            case FMOD_SOUND_FORMAT_PCMFLOAT:
+                std::memcpy(floats_.data(), data, sampleCount * sizeof(float));
+                break;
+            default:
+                integers16_.resize(sampleCount);
+                std::memcpy(integers16_.data(), data, sampleCount * sizeof(int16_t)); // Aligned copy, so the conversion loop reads typed samples
+                TensorFormat::ConvertPCM16(integers16_.data(), floats_.data(), sampleCount);
+                break;
+            }
+
+            if (planarLayout_) { // De-interleaves the block into the channel planes
+                for (size_t c = 0; c < channels_; ++c) {
+                    std::vector<float>& plane = planes_[c];
+                    size_t start = plane.size();
+                    plane.resize(start + blockFrames);
+                    for (size_t f = 0; f < blockFrames; ++f) {
+                        plane[start + f] = floats_[f * channels_ + c];
+                    }
+                }
+            }
+            else {
+                output_.write(reinterpret_cast<const char*>(floats_.data()), static_cast<std::streamsize>(sampleCount * sizeof(float)));
+            }
+            frames_ += blockFrames;
+            data += blockFrames * frameBytes_;
+            frameCount -= blockFrames;
+        }
+    }
+
+    std::ostream& output_;                   // Stream receiving the float32 samples
+    FMOD_SOUND_FORMAT format_;               // Format of the incoming PCM data
+    size_t channels_;                        // Number of channels
+    size_t bytesPerSample_;                  // Bytes per incoming sample
+    size_t frameBytes_ = 0;                  // Bytes per incoming sample frame (all channels)
+    bool planarLayout_;                      // True for [channel][frame] order, false for [frame][channel]
+    std::vector<float> floats_;              // Conversion output block
+    std::vector<int16_t> integers16_;        // Aligned copy of incoming 16-bit samples
+    std::vector<int32_t> integers32_;        // Aligned copy of incoming 32-bit samples
+    std::vector<std::vector<float>> planes_; // Collected samples per channel (planar layout only)
+    std::vector<char> partial_;              // Bytes of an incomplete sample frame
+    uint64_t pcmBytes_ = 0;                  // Total PCM bytes received
+    uint64_t frames_ = 0;                    // Complete sample frames converted
+};
+
+
+/**
+ * @class TensorBlobSink
+ * @brief Writes the float32 samples of every extracted sound into one raw blob file, with a JSON Lines offsets index.
+ *
+ * @details
+ * The blob is a plain concatenation of the float32 arrays of all sounds, with no headers, so it can be memory-mapped as a single array.
+ * Each line of the index describes one sound: its name, its byte offset in the blob, its shape and layout, and its source format.
+ * Throws std::runtime_error if either file cannot be created.
+ */
+class TensorBlobSink {
+public:
+    /**
+     * @brief Constructor for TensorBlobSink. Creates the blob file and its index file ("<blob>.jsonl").
+     *
+     * @param blobPath Path of the blob file, e.g. "music.f32".
+     */
+    TensorBlobSink(const std::filesystem::path& blobPath)
+        : blobPath_(blobPath), indexPath_(blobPath), buffer_(Constants::ARCHIVE_BUFFER_SIZE) {
+        indexPath_ += ".jsonl";
+        blobFile_.rdbuf()->pubsetbuf(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        blobFile_.open(blobPath_, std::ios::binary | std::ios::trunc);
+        if (!blobFile_.is_open()) {
+            throw std::runtime_error("Failed to create tensor blob file: " + blobPath_.u8string());
+        }
+        indexFile_.open(indexPath_, std::ios::binary | std::ios::trunc);
+        if (!indexFile_.is_open()) {
+            throw std::runtime_error("Failed to create tensor index file: " + indexPath_.u8string());
+        }
+    }
+
+    TensorBlobSink(const TensorBlobSink&) = delete;
+    TensorBlobSink& operator=(const TensorBlobSink&) = delete;
+
+    /**
+     * @brief Returns the blob stream that the next sound's samples are written into.
+     */
+    std::ostream& stream() { return blobFile_; }
+
+    /**
+     * @brief Appends the index line of a sound whose samples were just written into the blob.
+     *
+     * @param jsonLine JSON object describing the sound, terminated by a newline.
+     */
+    void AddIndexLine(const std::string& jsonLine) {
+        indexFile_.write(jsonLine.data(), static_cast<std::streamsize>(jsonLine.size()));
+        if (!indexFile_.good()) {
+            throw std::runtime_error("Failed to write tensor index file: " + indexPath_.u8string());
+        }
+    }
+
+    /**
+     * @brief Flushes and closes the blob and index files.
+     *
+     * @return bool True if both files were written successfully, false otherwise.
+     */
+    bool Finish() {
+        blobFile_.close();
+        indexFile_.close();
+        return !blobFile_.fail() && !indexFile_.fail();
+    }
+
+    /**
+     * @brief Returns the blob file path.
+     */
+    const std::filesystem::path& path() const { return blobPath_; }
+
+    /**
+     * @brief Returns the index file path.
+     */
+    const std::filesystem::path& indexPath() const { return indexPath_; }
+private:
+    std::filesystem::path blobPath_;  // Path of the raw float32 blob
+    std::filesystem::path indexPath_; // Path of the JSON Lines offsets index
+    std::vector<char> buffer_;        // Stream buffer backing blobFile_ (Constants::ARCHIVE_BUFFER_SIZE bytes)
+    std::ofstream blobFile_;          // Blob output stream
+    std::ofstream indexFile_;         // Index output stream
+};
+
+
+namespace PcmChecksum {
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull; // XXH64 constants
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t RotateLeft(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t Round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * PRIME2;
+        return RotateLeft(accumulator, 31) * PRIME1;
+    }
+
+    inline uint64_t MergeRound(uint64_t accumulator, uint64_t value) {
+        accumulator ^= Round(0, value);
+        return accumulator * PRIME1 + PRIME4;
+    }
+
+    inline uint64_t Read64(const unsigned char* data) {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value)); // Little-endian host, as everywhere else in this file
+        return value;
+    }
+
+    inline uint32_t Read32(const unsigned char* data) {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    /**
+     * @class Hasher
+     * @brief Incremental XXH64 hash of a PCM stream, fed chunk by chunk by the AudioProcessor write loops.
+     *
+     * @details
+     * XXH64 consumes 32-byte stripes in four independent accumulator lanes, so the loop in Update runs at several GB/s
+     * and does not slow down extraction. Digests are identical to the reference implementation ("xxhsum -H1"),
+     * so a raw PCM file can be checked against the manifest with standard tools.
+     */
+    class Hasher {
+    public:
+        /**
+         * @brief Constructor for Hasher.
+         *
+         * @param seed Hash seed (0 for the standard XXH64 digest).
+         */
+        explicit Hasher(uint64_t seed = 0) : seed_(seed) {
+            lanes_[0] = seed + PRIME1 + PRIME2;
+            lanes_[1] = seed + PRIME2;
+            lanes_[2] = seed;
+            lanes_[3] = seed - PRIME1;
+        }
+
+        /**
+         * @brief Adds bytes to the hash.
+         *
+         * @param data Bytes to hash.
+         * @param size Number of bytes.
+         */
+        void Update(const void* data, size_t size) {
+            const unsigned char* input = static_cast<const unsigned char*>(data);
+            length_ += size;
+            if (pendingSize_ > 0) { // Completes the stripe left over from the previous chunk
+                size_t take = std::min(size, STRIPE_SIZE - pendingSize_);
+                std::memcpy(pending_ + pendingSize_, input, take);
+                pendingSize_ += take;
+                input += take;
+                size -= take;
+                if (pendingSize_ < STRIPE_SIZE) {
+                    return;
+                }
+                ConsumeStripes(pending_, 1);
+                pendingSize_ = 0;
+            }
+            size_t stripes = size / STRIPE_SIZE;
+            ConsumeStripes(input, stripes);
+            input += stripes * STRIPE_SIZE;
+            size -= stripes * STRIPE_SIZE;
+            std::memcpy(pending_, input, size);
+            pendingSize_ = size;
+        }
+
+        /**
+         * @brief Returns the XXH64 digest of all bytes added so far (the hash can still be updated afterwards).
+         */
+        uint64_t Digest() const {
+            uint64_t hash;
+            if (length_ >= STRIPE_SIZE) {
+                hash = RotateLeft(lanes_[0], 1) + RotateLeft(lanes_[1], 7) + RotateLeft(lanes_[2], 12) + RotateLeft(lanes_[3], 18);
+                for (uint64_t lane : lanes_) {
+                    hash = MergeRound(hash, lane);
+                }
+            }
+            else {
+                hash = seed_ + PRIME5;
+            }
+            hash += length_;
+
+            const unsigned char* tail = pending_;
+            size_t remaining = pendingSize_;
+            for (; remaining >= 8; tail += 8, remaining -= 8) {
+                hash ^= Round(0, Read64(tail));
+                hash = RotateLeft(hash, 27) * PRIME1 + PRIME4;
+            }
+            if (remaining >= 4) {
+                hash ^= static_cast<uint64_t>(Read32(tail)) * PRIME1;
+                hash = RotateLeft(hash, 23) * PRIME2 + PRIME3;
+                tail += 4;
+                remaining -= 4;
+            }
+            for (; remaining > 0; ++tail, --remaining) {
+                hash ^= *tail * PRIME5;
+                hash = RotateLeft(hash, 11) * PRIME1;
+            }
+
+            hash ^= hash >> 33; // Final avalanche
+            hash *= PRIME2;
+            hash ^= hash >> 29;
+            hash *= PRIME3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        /**
+         * @brief Returns the digest as 16 lowercase hexadecimal digits, as printed by xxhsum.
+         */
+        std::string HexDigest() const {
+            char text[17];
+            std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(Digest()));
+            return text;
+        }
+
+        /**
+         * @brief Returns the number of bytes hashed so far.
+         */
+        uint64_t length() const { return length_; }
+    private:
+        static constexpr size_t STRIPE_SIZE = 32; // Bytes consumed per round (four 8-byte lanes)
+
+        /**
+         * @brief Runs the four lanes over whole stripes.
+         */
+        void ConsumeStripes(const unsigned char* input, size_t stripes) {
+            uint64_t lane0 = lanes_[0], lane1 = lanes_[1], lane2 = lanes_[2], lane3 = lanes_[3]; // Kept in registers for the loop
+            for (size_t i = 0; i < stripes; ++i, input += STRIPE_SIZE) {
+                lane0 = Round(lane0, Read64(input));
+                lane1 = Round(lane1, Read64(input + 8));
+                lane2 = Round(lane2, Read64(input + 16));
+                lane3 = Round(lane3, Read64(input + 24));
+            }
+            lanes_[0] = lane0;
+            lanes_[1] = lane1;
+            lanes_[2] = lane2;
+            lanes_[3] = lane3;
+        }
+
+        uint64_t seed_;                       // Hash seed
+        uint64_t lanes_[4];                   // Accumulator lanes
+        unsigned char pending_[STRIPE_SIZE];  // Bytes of an incomplete stripe
+        size_t pendingSize_ = 0;              // Number of bytes in pending_
+        uint64_t length_ = 0;                 // Total bytes hashed
+    };
+}
+
+
+/**
+ * @class ManifestSink
+ * @brief Writes a JSON Lines manifest with the PCM checksum and source location of every extracted sound ("-manifest <file>").
+ *
+ * @details
+ * The checksums are computed while the sounds are decoded (see PcmChecksum::Hasher), so verifying or deduplicating
+ * the output later only needs this file, not another pass over the audio.
+ * Throws std::runtime_error if the file cannot be created or written.
+ */
+class ManifestSink {
+public:
+    /**
+     * @brief Constructor for ManifestSink. Creates the manifest file.
+     *
+     * @param manifestPath Path of the manifest file, e.g. "music.jsonl".
+     */
+    explicit ManifestSink(const std::filesystem::path& manifestPath) : manifestPath_(manifestPath) {
+        manifestFile_.open(manifestPath_, std::ios::binary | std::ios::trunc);
+        if (!manifestFile_.is_open()) {
+            throw std::runtime_error("Failed to create manifest file: " + manifestPath_.u8string());
+        }
+    }
+
+    ManifestSink(const ManifestSink&) = delete;
+    ManifestSink& operator=(const ManifestSink&) = delete;
+
+    /**
+     * @brief Appends the manifest line of an extracted sound.
+     *
+     * @param jsonLine JSON object describing the sound, terminated by a newline.
+     */
+    void AddLine(const std::string& jsonLine) {
+        manifestFile_.write(jsonLine.data(), static_cast<std::streamsize>(jsonLine.size()));
+        if (!manifestFile_.good()) {
+            throw std::runtime_error("Failed to write manifest file: " + manifestPath_.u8string());
+        }
+    }
+
+    /**
+     * @brief Flushes and closes the manifest file.
+     *
+     * @return bool True if the file was written successfully, false otherwise.
+     */
+    bool Finish() {
+        manifestFile_.close();
+        return !manifestFile_.fail();
+    }
+
+    /**
+     * @brief Returns the manifest file path.
+     */
+    const std::filesystem::path& path() const { return manifestPath_; }
+private:
+    std::filesystem::path manifestPath_; // Path of the JSON Lines manifest
+    std::ofstream manifestFile_;         // Manifest output stream
+};
+
+
+/**
+ * @class RunSummary
+ * @brief Collects per-sound throughput figures and prints the end-of-run summary table ("-summary-json <file>" also writes it as JSON).
+ *
+ * @details
+ * ProcessSubSound reports every extracted sound with AddSound: its codec (FMOD sound type), encoded input size, output size,
+ * the time spent in FMOD readData (decode), in writing the chunks (write, including clipping, conversion and encoding), and in
+ * the whole sound. Totals are kept per codec, and only the slowest sounds are kept individually (a small min-heap), so the memory
+ * used does not grow with the number of sounds. AddSound and AddFailure are guarded by a mutex, so several workers can share one instance.
+ */
+class RunSummary {
+public:
+    /**
+     * @struct SoundRecord
+     * @brief Figures of one extracted sound.
+     */
+    struct SoundRecord {
+        std::string name;             // Output name, e.g. "music/ko/voice.wav"
+        const char* codec = "";       // FMOD sound type name (see SoundTypeName)
+        uint64_t inputBytes = 0;      // Encoded size in the FSB (FMOD_TIMEUNIT_RAWBYTES)
+        uint64_t outputBytes = 0;     // Bytes written for the sound (header included)
+        int64_t decodeNanoseconds = 0; // Time spent in FMOD::Sound::readData
+        int64_t writeNanoseconds = 0;  // Time spent writing the chunks
+        int64_t totalNanoseconds = 0;  // Time spent in ProcessSubSound
+    };
+
+    /**
+     * @brief Constructor for RunSummary. The wall time of the run is measured from here.
+     *
+     * @param slowestCount Number of slowest sounds listed in the summary.
+     */
+    explicit RunSummary(size_t slowestCount) : slowestCount_(slowestCount), start_(std::chrono::steady_clock::now()) {
+    }
+
+    /**
+     * @brief Adds an extracted sound.
+     */
+    void AddSound(SoundRecord record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Add(totals_, record);
+        Add(codecs_[record.codec], record);
+        auto slower = [](const SoundRecord& a, const SoundRecord& b) { return a.totalNanoseconds > b.totalNanoseconds; }; // Min-heap on time
+        if (slowest_.size() < slowestCount_) {
+            slowest_.push_back(std::move(record));
+            std::push_heap(slowest_.begin(), slowest_.end(), slower);
+        }
+        else if (slowestCount_ > 0 && record.totalNanoseconds > slowest_.front().totalNanoseconds) {
+            std::pop_heap(slowest_.begin(), slowest_.end(), slower);
+            slowest_.back() = std::move(record);
+            std::push_heap(slowest_.begin(), slowest_.end(), slower);
+        }
+    }
+
+    /**
+     * @brief Counts a sub-sound that could not be extracted.
+     */
+    void AddFailure() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++failedSounds_;
+    }
+
+    /**
+     * @brief Prints the summary table: one row per codec, the totals, the wall time and the slowest sounds.
+     *
+     * @param output Stream to print to (the console).
+     */
+    void Print(std::ostream& output) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const double wallSeconds = WallSeconds();
+        char line[256];
+        output << std::endl << " ===== Summary =====" << std::endl;
+        std::snprintf(line, sizeof(line), " %-12s %8s %11s %11s %10s %10s %9s %9s", "Codec", "Sounds", "Input MB", "Output MB", "Decode s", "Write s", "MB/s", "Sounds/s");
+        output << line << std::endl;
+        for (const auto& codec : SortedCodecs()) {
+            output << FormatRow(line, sizeof(line), codec.first.c_str(), *codec.second) << std::endl;
+        }
+        output << FormatRow(line, sizeof(line), "Total", totals_) << std::endl;
+        std::snprintf(line, sizeof(line), " Wall time: %.3f s (%.2f MB/s, %.1f sounds/s), failed sounds: %llu", wallSeconds,
+            Rate(static_cast<double>(totals_.outputBytes) / MEGABYTE, wallSeconds), Rate(static_cast<double>(totals_.sounds), wallSeconds), static_cast<unsigned long long>(failedSounds_));
+        output << line << std::endl;
+        if (!slowest_.empty()) {
+            output << " Slowest sounds:" << std::endl;
+            std::vector<SoundRecord> slowest = SortedSlowest();
+            for (size_t i = 0; i < slowest.size(); ++i) {
+                std::snprintf(line, sizeof(line), " %3zu. %9.3f ms  %-10s %9.2f MB  ", i + 1, static_cast<double>(slowest[i].totalNanoseconds) / 1e6, slowest[i].codec,
+                    static_cast<double>(slowest[i].outputBytes) / MEGABYTE);
+                output << line << slowest[i].name << std::endl;
+            }
+        }
+    }
+
+    /**
+     * @brief Writes the summary as a JSON document.
+     *
+     * @param summaryPath Path of the JSON file.
+     * @return bool True if the file was written successfully, false otherwise.
+     */
+    bool WriteJson(const std::filesystem::path& summaryPath) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ofstream summaryFile(summaryPath, std::ios::binary | std::ios::trunc);
+        if (!summaryFile.is_open()) {
+            return false;
+        }
+        summaryFile << "{\"wall_seconds\":" << WallSeconds()
+            << ",\"failed_sounds\":" << failedSounds_
+            << ",\"total\":" << TotalsJson(totals_)
+            << ",\"codecs\":[";
+        bool first = true;
+        for (const auto& codec : SortedCodecs()) {
+            summaryFile << (first ? "" : ",") << "{\"codec\":\"" << EscapeJsonString(codec.first) << "\"," << TotalsJson(*codec.second).substr(1);
+            first = false;
+        }
+        summaryFile << "],\"slowest\":[";
+        first = true;
+        for (const SoundRecord& record : SortedSlowest()) {
+            summaryFile << (first ? "" : ",") << "{\"name\":\"" << EscapeJsonString(record.name) << "\""
+                << ",\"codec\":\"" << EscapeJsonString(record.codec) << "\""
+                << ",\"input_bytes\":" << record.inputBytes
+                << ",\"output_bytes\":" << record.outputBytes
+                << ",\"decode_seconds\":" << static_cast<double>(record.decodeNanoseconds) / 1e9
+                << ",\"write_seconds\":" << static_cast<double>(record.writeNanoseconds) / 1e9
+                << ",\"seconds\":" << static_cast<double>(record.totalNanoseconds) / 1e9 << "}";
+            first = false;
+        }
+        summaryFile << "]}\n";
+        summaryFile.close();
+        return !summaryFile.fail();
+    }
+private:
+    static constexpr double MEGABYTE = 1024.0 * 1024.0; // Bytes per MB in the table
+
+    /**
+     * @struct Totals
+     * @brief Sums over a group of sounds (one codec, or all).
+     */
+    struct Totals {
+        uint64_t sounds = 0;
+        uint64_t inputBytes = 0;
+        uint64_t outputBytes = 0;
+        int64_t decodeNanoseconds = 0;
+        int64_t writeNanoseconds = 0;
+        int64_t totalNanoseconds = 0;
+    };
+
+    static void Add(Totals& totals, const SoundRecord& record) {
+        ++totals.sounds;
+        totals.inputBytes += record.inputBytes;
+        totals.outputBytes += record.outputBytes;
+        totals.decodeNanoseconds += record.decodeNanoseconds;
+        totals.writeNanoseconds += record.writeNanoseconds;
+        totals.totalNanoseconds += record.totalNanoseconds;
+    }
+
+    /**
+     * @brief Returns amount / seconds, or 0 if no time was measured.
+     */
+    static double Rate(double amount, double seconds) {
+        return seconds > 0 ? amount / seconds : 0.0;
+    }
+
+    /**
+     * @brief Formats a table row. Rates are per second spent extracting the sounds of the row (not wall time).
+     */
+    static const char* FormatRow(char* line, size_t size, const char* label, const Totals& totals) {
+        const double seconds = static_cast<double>(totals.totalNanoseconds) / 1e9;
+        std::snprintf(line, size, " %-12s %8llu %11.2f %11.2f %10.3f %10.3f %9.2f %9.1f", label, static_cast<unsigned long long>(totals.sounds),
+            static_cast<double>(totals.inputBytes) / MEGABYTE, static_cast<double>(totals.outputBytes) / MEGABYTE,
+            static_cast<double>(totals.decodeNanoseconds) / 1e9, static_cast<double>(totals.writeNanoseconds) / 1e9,
+            Rate(static_cast<double>(totals.outputBytes) / MEGABYTE, seconds), Rate(static_cast<double>(totals.sounds), seconds));
+        return line;
+    }
+
+    static std::string TotalsJson(const Totals& totals) {
+        const double seconds = static_cast<double>(totals.totalNanoseconds) / 1e9;
+        std::ostringstream json;
+        json << "{\"sounds\":" << totals.sounds
+            << ",\"input_bytes\":" << totals.inputBytes
+            << ",\"output_bytes\":" << totals.outputBytes
+            << ",\"decode_seconds\":" << static_cast<double>(totals.decodeNanoseconds) / 1e9
+            << ",\"write_seconds\":" << static_cast<double>(totals.writeNanoseconds) / 1e9
+            << ",\"seconds\":" << seconds
+            << ",\"mb_per_second\":" << Rate(static_cast<double>(totals.outputBytes) / MEGABYTE, seconds)
+            << ",\"sounds_per_second\":" << Rate(static_cast<double>(totals.sounds), seconds) << "}";
+        return json.str();
+    }
+
+    double WallSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    std::vector<std::pair<std::string, const Totals*>> SortedCodecs() const {
+        std::vector<std::pair<std::string, const Totals*>> codecs;
+        for (const auto& codec : codecs_) {
+            codecs.emplace_back(codec.first, &codec.second);
+        }
+        std::sort(codecs.begin(), codecs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        return codecs;
+    }
+
+    std::vector<SoundRecord> SortedSlowest() const {
+        std::vector<SoundRecord> slowest = slowest_;
+        std::sort(slowest.begin(), slowest.end(), [](const SoundRecord& a, const SoundRecord& b) { return a.totalNanoseconds > b.totalNanoseconds; });
+        return slowest;
+    }
+
+    size_t slowestCount_;                                // Number of slowest sounds kept
+    std::chrono::steady_clock::time_point start_;        // Start of the run (wall time origin)
+    Totals totals_;                                      // Sums over all sounds
+    std::unordered_map<std::string, Totals> codecs_;     // Sums per codec
+    std::vector<SoundRecord> slowest_;                   // Slowest sounds so far (min-heap on totalNanoseconds)
+    uint64_t failedSounds_ = 0;                          // Sub-sounds that could not be extracted
+    std::mutex mutex_;                                   // Serializes concurrent AddSound/AddFailure calls
+};
+
+
+/**
+ * @namespace Metrics
+ * @brief Live extraction metrics (counters, gauges, histograms) in the Prometheus text format ("-metrics-file <file>").
+ *
+ * @details
+ * Every metric is a relaxed std::atomic, so the extraction threads update them without locks and the exporter thread reads
+ * them at any time; a rendered snapshot may mix values from slightly different moments, which Prometheus tolerates.
+ * Histogram observations are integers (nanoseconds, bytes) scaled to the exported unit when rendered, so no floating-point
+ * atomics are needed. The metrics are always updated (a few atomic additions per chunk and per sound); they are only
+ * rendered when an exporter is running.
+ */
+namespace Metrics {
+    /**
+     * @class Counter
+     * @brief Monotonically increasing value.
+     */
+    class Counter {
+    public:
+        void Add(uint64_t amount) { value_.fetch_add(amount, std::memory_order_relaxed); }
+        uint64_t Value() const { return value_.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<uint64_t> value_{ 0 };
+    };
+
+    /**
+     * @class Gauge
+     * @brief Value that can go up and down.
+     */
+    class Gauge {
+    public:
+        void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+        int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<int64_t> value_{ 0 };
+    };
+
+    /**
+     * @class Histogram
+     * @brief Distribution of integer observations over fixed bucket bounds.
+     */
+    class Histogram {
+    public:
+        /**
+         * @brief Constructor for Histogram.
+         *
+         * @param bounds Upper bucket bounds in observation units, ascending.
+         * @param unitScale Factor converting observation units to the exported unit (e.g. 1e-9 for nanoseconds to seconds).
+         */
+        Histogram(std::vector<uint64_t> bounds, double unitScale)
+            : bounds_(std::move(bounds)), unitScale_(unitScale), buckets_(bounds_.size() + 1) {
+        }
+
+        void Observe(uint64_t value) {
+            size_t bucket = static_cast<size_t>(std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin()); // First bound >= value, or +Inf
+            buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Appends the cumulative buckets, sum and count of the histogram.
+         */
+        void Render(std::string& text, const char* name) const {
+            char line[160];
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < buckets_.size(); ++i) {
+                cumulative += buckets_[i].load(std::memory_order_relaxed);
+                if (i < bounds_.size()) {
+                    std::snprintf(line, sizeof(line), "%s_bucket{le=\"%.12g\"} %llu\n", name, static_cast<double>(bounds_[i]) * unitScale_, static_cast<unsigned long long>(cumulative));
+                }
+                else {
+                    std::snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n", name, static_cast<unsigned long long>(cumulative));
+                }
+                text += line;
+            }
+            std::snprintf(line, sizeof(line), "%s_sum %.9g\n%s_count %llu\n", name, static_cast<double>(sum_.load(std::memory_order_relaxed)) * unitScale_, name, static_cast<unsigned long long>(cumulative));
+            text += line;
+        }
+    private:
+        std::vector<uint64_t> bounds_;                // Upper bucket bounds (observation units)
+        double unitScale_;                            // Observation unit to exported unit
+        std::vector<std::atomic<uint64_t>> buckets_;  // Observations per bucket (not cumulative), the last one is +Inf
+        std::atomic<uint64_t> sum_{ 0 };              // Sum of the observations (observation units)
+    };
+
+    constexpr size_t FMOD_RESULT_SLOTS = 128; // FMOD_RESULT values counted individually (larger codes share the last slot)
+
+    /**
+     * @struct Registry
+     * @brief The metrics of the process.
+     */
+    struct Registry {
+        Counter soundsDone;       // Sub-sounds extracted successfully
+        Counter soundsFailed;     // Sub-sounds that could not be extracted
+        Counter bytesDecoded;     // PCM bytes returned by FMOD readData
+        Counter bytesWritten;     // Bytes written for the extracted sounds
+        Gauge filesQueued;        // FSB files not yet started (including the current one)
+        Gauge soundsQueued;       // Sub-sounds of the current FSB not yet started
+        std::array<std::atomic<uint64_t>, FMOD_RESULT_SLOTS> fmodErrors{}; // FMOD errors by result code
+        Histogram soundSeconds{ { 1000000ull, 5000000ull, 10000000ull, 50000000ull, 100000000ull, 500000000ull, 1000000000ull, 5000000000ull, 30000000000ull }, 1e-9 }; // Time per sub-sound
+        Histogram soundBytes{ { 64ull << 10, 256ull << 10, 1ull << 20, 4ull << 20, 16ull << 20, 64ull << 20, 256ull << 20 }, 1.0 }; // Output bytes per sub-sound
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(); // Process start, for the run time gauge
+    };
+
+    inline Registry& Global() {
+        static Registry registry;
+        return registry;
+    }
+
+    /**
+     * @brief Counts an FMOD error by its result code.
+     */
+    inline void CountFMODError(FMOD_RESULT result) {
+        size_t slot = std::min(static_cast<size_t>(result), FMOD_RESULT_SLOTS - 1);
+        Global().fmodErrors[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Renders every metric in the Prometheus text exposition format (version 0.0.4).
+     */
+    inline std::string RenderText() {
+        Registry& registry = Global();
+        std::string text;
+        text.reserve(4096);
+        auto scalar = [&text](const char* name, const char* type, const char* help, double value) {
+            char line[96];
+            std::snprintf(line, sizeof(line), "%.17g", value);
+            text += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n" + name + " " + line + "\n";
+            };
+        scalar("fsbx_sounds_done_total", "counter", "Sub-sounds extracted successfully.", static_cast<double>(registry.soundsDone.Value()));
+        scalar("fsbx_sounds_failed_total", "counter", "Sub-sounds that could not be extracted.", static_cast<double>(registry.soundsFailed.Value()));
+        scalar("fsbx_bytes_decoded_total", "counter", "PCM bytes decoded by FMOD readData.", static_cast<double>(registry.bytesDecoded.Value()));
+        scalar("fsbx_bytes_written_total", "counter", "Bytes written for the extracted sounds.", static_cast<double>(registry.bytesWritten.Value()));
+        scalar("fsbx_files_queued", "gauge", "FSB files not yet finished.", static_cast<double>(registry.filesQueued.Value()));
+        scalar("fsbx_sounds_queued", "gauge", "Sub-sounds of the current FSB not yet started.", static_cast<double>(registry.soundsQueued.Value()));
+        scalar("fsbx_run_seconds", "gauge", "Time since the extraction started.", std::chrono::duration<double>(std::chrono::steady_clock::now() - registry.start).count());
+
+        text += "# HELP fsbx_fmod_errors_total FMOD errors by result code.\n# TYPE fsbx_fmod_errors_total counter\n";
+        for (size_t code = 0; code < FMOD_RESULT_SLOTS; ++code) {
+            uint64_t count = registry.fmodErrors[code].load(std::memory_order_relaxed);
+            if (count > 0) {
+                std::string error = FMOD_ErrorString(static_cast<FMOD_RESULT>(code));
+                std::string escaped; // Label values escape backslash, double quote and newline
+                for (char c : error) {
+                    escaped += (c == '\\' || c == '"') ? std::string("\\") + c : (c == '\n' ? std::string("\\n") : std::string(1, c));
+                }
+                text += "fsbx_fmod_errors_total{code=\"" + std::to_string(code) + "\",error=\"" + escaped + "\"} " + std::to_string(count) + "\n";
+            }
+        }
+        text += "# HELP fsbx_sound_duration_seconds Time spent extracting each sub-sound.\n# TYPE fsbx_sound_duration_seconds histogram\n";
+        registry.soundSeconds.Render(text, "fsbx_sound_duration_seconds");
+        text += "# HELP fsbx_sound_output_bytes Bytes written for each sub-sound.\n# TYPE fsbx_sound_output_bytes histogram\n";
+        registry.soundBytes.Render(text, "fsbx_sound_output_bytes");
+        return text;
+    }
+
+    /**
+     * @class TextfileExporter
+     * @brief Periodically writes the metrics to a file for the node_exporter textfile collector.
+     *
+     * @details
+     * A background thread renders the metrics every interval, writes them to "<file>.tmp" and renames that over the file, so the
+     * collector never reads a partial file. The final values are written once more when the exporter is destroyed.
+     */
+    class TextfileExporter {
+    public:
+        /**
+         * @brief Constructor for TextfileExporter. Writes the file once and starts the export thread.
+         *
+         * @param metricsPath Path of the metrics file (the collector reads "*.prom" files).
+         * @param intervalSeconds Seconds between two exports.
+         */
+        TextfileExporter(const std::filesystem::path& metricsPath, uint64_t intervalSeconds)
+            : metricsPath_(metricsPath), interval_(std::chrono::seconds(std::max<uint64_t>(intervalSeconds, 1))) {
+            Export();
+            exporter_ = std::thread([this] {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (!stopCondition_.wait_for(lock, interval_, [this] { return stop_; })) {
+                    Export();
+                }
+                });
+        }
+
+        /**
+         * @brief Destructor for TextfileExporter. Stops the export thread and writes the final values.
+         */
+        ~TextfileExporter() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            stopCondition_.notify_one();
+            exporter_.join();
+            Export();
+        }
+
+        TextfileExporter(const TextfileExporter&) = delete;
+        TextfileExporter& operator=(const TextfileExporter&) = delete;
+    private:
+        /**
+         * @brief Writes the current metrics and replaces the file. Reports the first failure on std::cerr.
+         */
+        void Export() {
+            std::filesystem::path tempPath = metricsPath_;
+            tempPath += ".tmp";
+            std::string text = RenderText();
+            std::ofstream metricsFile(tempPath, std::ios::binary | std::ios::trunc);
+            metricsFile.write(text.data(), static_cast<std::streamsize>(text.size()));
+            metricsFile.close();
+            std::error_code error;
+            if (!metricsFile.fail()) {
+                std::filesystem::rename(tempPath, metricsPath_, error);
+            }
+            if ((metricsFile.fail() || error) && !failureReported_) {
+                std::cerr << " Error writing metrics file: " << metricsPath_.u8string() << std::endl;
+                failureReported_ = true;
+            }
+        }
+
+        std::filesystem::path metricsPath_;      // Path of the metrics file
+        std::chrono::seconds interval_;          // Time between two exports
+        bool failureReported_ = false;           // True once a write failure has been printed
+        bool stop_ = false;                      // Set by the destructor (guarded by mutex_)
+        std::mutex mutex_;                       // Guards stop_
+        std::condition_variable stopCondition_;  // Wakes the export thread early when stopping
+        std::thread exporter_;                   // Export thread
+    };
+}
+
+
+namespace PeakFormat {
+    constexpr uint32_t SAMPLES_PER_PEAK = 256; // Frames summarized by one peak of the finest level
+    constexpr uint32_t LEVEL_FACTOR = 4;       // Each level summarizes this many peaks of the level below
+    constexpr uint32_t LEVEL_COUNT = 4;        // Number of levels (256, 1024, 4096 and 16384 frames per peak)
+
+    // Sample conversion and reduction kernels, written like those of TensorFormat. Peaks are stored at 16-bit resolution for every format.
+
+    /**
+     * @brief Converts unsigned 8-bit samples (as stored in WAV files) to signed 16-bit samples.
+     */
+    inline void ConvertPCM8(const uint8_t* input, int16_t* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = static_cast<int16_t>((static_cast<int>(input[i]) - 128) * 256);
+        }
+    }
+
+    /**
+     * @brief Converts packed little-endian signed 24-bit samples (3 bytes each) to signed 16-bit samples (upper 16 bits).
+     */
+    inline void ConvertPCM24(const uint8_t* input, int16_t* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = static_cast<int16_t>(static_cast<uint16_t>(input[3 * i + 1] | input[3 * i + 2] << 8));
+        }
+    }
+
+    /**
+     * @brief Converts signed 32-bit samples to signed 16-bit samples (upper 16 bits).
+     */
+    inline void ConvertPCM32(const int32_t* input, int16_t* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = static_cast<int16_t>(input[i] >> 16);
+        }
+    }
+
+    /**
+     * @brief Converts float samples to signed 16-bit samples, clamped to [-1, 1].
+     */
+    inline void ConvertPCMFloat(const float* input, int16_t* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = static_cast<int16_t>(std::min(std::max(input[i], -1.0f), 1.0f) * 32767.0f);
+        }
+    }
+
+    /**
+     * @brief Extends a minimum and maximum by a run of contiguous samples.
+     */
+    inline void MinMax(const int16_t* samples, size_t count, int16_t& minimum, int16_t& maximum) {
+        int16_t low = minimum;
+        int16_t high = maximum;
+        for (size_t i = 0; i < count; ++i) {
+            low = std::min(low, samples[i]);
+            high = std::max(high, samples[i]);
+        }
+        minimum = low;
+        maximum = high;
+    }
+
+    /**
+     * @brief Extends a minimum and maximum by one channel of interleaved samples (every stride-th sample).
+     */
+    inline void MinMaxStrided(const int16_t* samples, size_t count, size_t stride, int16_t& minimum, int16_t& maximum) {
+        int16_t low = minimum;
+        int16_t high = maximum;
+        for (size_t i = 0; i < count; ++i) {
+            low = std::min(low, samples[i * stride]);
+            high = std::max(high, samples[i * stride]);
+        }
+        minimum = low;
+        maximum = high;
+    }
+}
+
+
+/**
+ * @class PeakSummaryBuffer
+ * @brief Stream buffer that passes PCM data through to the output unchanged and computes waveform peaks on the way.
+ *
+ * @details
+ * It sits between the AudioProcessor chunk writers and the output stream (WAV file, FLAC encoder, float32 converter),
+ * so the peaks of a sound are available as soon as it has been written, without reading the output file again.
+ * Every SAMPLES_PER_PEAK frames, the minimum and maximum of each channel are stored; coarser levels are
+ * reduced from the finest one by Finish(). Finish() returns the sidecar file contents:
+ *   "PEAK" (4 bytes), uint16 version (1), uint16 channels, uint32 sample rate, uint32 level count, uint64 frames,
+ *   then per level: uint32 frames per peak, uint32 peak count,
+ *   then per level: peak count x channels x (int16 minimum, int16 maximum). All values are little-endian.
+ */
+class PeakSummaryBuffer : public std::streambuf {
+public:
+    /**
+     * @brief Constructor for PeakSummaryBuffer.
+     *
+     * @param output Stream receiving the PCM data.
+     * @param soundInfo Format of the PCM data that will be written.
+     */
+    PeakSummaryBuffer(std::ostream& output, const SoundInfo& soundInfo)
+        : output_(output), format_(soundInfo.format), channels_(static_cast<size_t>(std::max(1, soundInfo.channels))),
+        sampleRate_(static_cast<uint32_t>(std::max(0, soundInfo.sampleRate))),
+        frameBytes_(channels_ * TensorFormat::BytesPerSample(soundInfo.format)), samples_(TensorFormat::CONVERT_BLOCK_SAMPLES) {
+        ResetPeak();
+    }
+
+    /**
+     * @brief Stores the last, incomplete peak and returns the sidecar file contents.
+     *
+     * @return std::string The binary peak file (see the class description).
+     */
+    std::string Finish() {
+        if (peakFrames_ > 0) {
+            StorePeak();
+        }
+        std::vector<std::vector<int16_t>> levels(PeakFormat::LEVEL_COUNT);
+        levels[0] = std::move(peaks_);
+        for (size_t level = 1; level < levels.size(); ++level) { // Each peak covers LEVEL_FACTOR peaks of the level below
+            const std::vector<int16_t>& finer = levels[level - 1];
+            const size_t finerCount = finer.size() / (2 * channels_);
+            const size_t count = (finerCount + PeakFormat::LEVEL_FACTOR - 1) / PeakFormat::LEVEL_FACTOR;
+            std::vector<int16_t>& coarser = levels[level];
+            coarser.resize(count * 2 * channels_);
+            for (size_t peak = 0; peak < count; ++peak) {
+                for (size_t c = 0; c < channels_; ++c) {
+                    int16_t minimum = std::numeric_limits<int16_t>::max();
+                    int16_t maximum = std::numeric_limits<int16_t>::min();
+                    for (size_t f = peak * PeakFormat::LEVEL_FACTOR; f < std::min(finerCount, (peak + 1) * PeakFormat::LEVEL_FACTOR); ++f) {
+                        minimum = std::min(minimum, finer[(f * channels_ + c) * 2]);
+                        maximum = std::max(maximum, finer[(f * channels_ + c) * 2 + 1]);
+                    }
+                    coarser[(peak * channels_ + c) * 2] = minimum;
+                    coarser[(peak * channels_ + c) * 2 + 1] = maximum;
+                }
+            }
+        }
+
+        std::ostringstream file;
+        file.write("PEAK", 4);
+        ArchiveFormat::WriteLE<uint16_t>(file, 1);
+        ArchiveFormat::WriteLE<uint16_t>(file, static_cast<uint16_t>(channels_));
+        ArchiveFormat::WriteLE<uint32_t>(file, sampleRate_);
+        ArchiveFormat::WriteLE<uint32_t>(file, PeakFormat::LEVEL_COUNT);
+        ArchiveFormat::WriteLE<uint64_t>(file, frames_);
+        uint32_t framesPerPeak = PeakFormat::SAMPLES_PER_PEAK;
+        for (const std::vector<int16_t>& level : levels) {
+            ArchiveFormat::WriteLE<uint32_t>(file, framesPerPeak);
+            ArchiveFormat::WriteLE<uint32_t>(file, static_cast<uint32_t>(level.size() / (2 * channels_)));
+            framesPerPeak *= PeakFormat::LEVEL_FACTOR;
+        }
+        for (const std::vector<int16_t>& level : levels) {
+            for (int16_t value : level) {
+                ArchiveFormat::WriteLE<uint16_t>(file, static_cast<uint16_t>(value));
+            }
+        }
+        return file.str();
+    }
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        output_.write(data, size);
+        const char* cursor = data;
+        size_t remaining = static_cast<size_t>(size);
+        if (!partial_.empty()) { // Completes the frame left over from the previous write
+            size_t take = std::min(frameBytes_ - partial_.size(), remaining);
+            partial_.insert(partial_.end(), cursor, cursor + take);
+            cursor += take;
+            remaining -= take;
+            if (partial_.size() == frameBytes_) {
+                Summarize(partial_.data(), 1);
+                partial_.clear();
+            }
+        }
+        size_t wholeFrames = remaining / frameBytes_;
+        Summarize(cursor, wholeFrames);
+        cursor += wholeFrames * frameBytes_;
+        partial_.insert(partial_.end(), cursor, data + size);
+        return output_.good() ? size : 0;
+    }
+
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        char c = traits_type::to_char_type(ch);
+        return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+    }
+private:
+    /**
+     * @brief Converts whole sample frames to 16-bit samples and folds them into the current peak.
+     *
+     * @param data PCM bytes of the frames.
+     * @param frameCount Number of frames in data.
+     */
+    void Summarize(const char* data, size_t frameCount) {
+        const size_t framesPerBlock = std::max<size_t>(1, samples_.size() / channels_);
+        while (frameCount > 0) {
+            size_t blockFrames = std::min(frameCount, framesPerBlock);
+            size_t sampleCount = blockFrames * channels_;
+            switch (format_) {
+            case FMOD_SOUND_FORMAT_PCM8:
+                PeakFormat::ConvertPCM8(reinterpret_cast<const uint8_t*>(data), samples_.data(), sampleCount);
+                break;
+            case FMOD_SOUND_FORMAT_PCM24:
+                PeakFormat::ConvertPCM24(reinterpret_cast<const uint8_t*>(data), samples_.data(), sampleCount);
+                break;
+            case FMOD_SOUND_FORMAT_PCM32:
+                integers32_.resize(sampleCount);
+                std::memcpy(integers32_.data(), data, sampleCount * sizeof(int32_t)); // Aligned copy, as in FloatTensorBuffer
+                PeakFormat::ConvertPCM32(integers32_.data(), samples_.data(), sampleCount);
+                break;
+            case FMOD_SOUND_FORMAT_PCMFLOAT:
+                floats_.resize(sampleCount);
+                std::memcpy(floats_.data(), data, sampleCount * sizeof(float)); // Aligned copy, as in FloatTensorBuffer
+                PeakFormat::ConvertPCMFloat(floats_.data(), samples_.data(), sampleCount);
+                break;
+            default:
+                std::memcpy(samples_.data(), data, sampleCount * sizeof(int16_t)); // PCM16, and unsupported formats extracted as PCM16
+                break;
+            }
+
+            size_t frame = 0;
+            while (frame < blockFrames) { // Splits the block at peak boundaries
+                size_t take = std::min<size_t>(blockFrames - frame, PeakFormat::SAMPLES_PER_PEAK - peakFrames_);
+                if (channels_ == 1) {
+                    PeakFormat::MinMax(samples_.data() + frame, take, peakMin_[0], peakMax_[0]);
+                }
+                else {
+                    for (size_t c = 0; c < channels_; ++c) { // One pass per channel, so the running minimum and maximum stay in registers
+                        PeakFormat::MinMaxStrided(samples_.data() + frame * channels_ + c, take, channels_, peakMin_[c], peakMax_[c]);
+                    }
+                }
+                frame += take;
+                peakFrames_ += static_cast<uint32_t>(take);
+                if (peakFrames_ == PeakFormat::SAMPLES_PER_PEAK) {
+                    StorePeak();
+                }
+            }
+            frames_ += blockFrames;
+            data += blockFrames * frameBytes_;
+            frameCount -= blockFrames;
+        }
+    }
+
+    /**
+     * @brief Appends the current peak of every channel to the finest level and starts a new one.
+     */
+    void StorePeak() {
+        for (size_t c = 0; c < channels_; ++c) {
+            peaks_.push_back(peakMin_[c]);
+            peaks_.push_back(peakMax_[c]);
+        }
+        ResetPeak();
+    }
+
+    /**
+     * @brief Starts a new, empty peak.
+     */
+    void ResetPeak() {
+        peakMin_.assign(channels_, std::numeric_limits<int16_t>::max());
+        peakMax_.assign(channels_, std::numeric_limits<int16_t>::min());
+        peakFrames_ = 0;
+    }
+
+    std::ostream& output_;            // Stream receiving the PCM data
+    FMOD_SOUND_FORMAT format_;        // Format of the incoming PCM data
+    size_t channels_;                 // Number of channels
+    uint32_t sampleRate_;             // Sample rate, stored in the sidecar header
+    size_t frameBytes_;               // Bytes per incoming sample frame (all channels)
+    std::vector<int16_t> samples_;    // Conversion output block
+    std::vector<int32_t> integers32_; // Aligned copy of incoming 32-bit samples
+    std::vector<float> floats_;       // Aligned copy of incoming float samples
+    std::vector<char> partial_;       // Bytes of an incomplete sample frame
+    std::vector<int16_t> peakMin_;    // Minimum of each channel in the current peak
+    std::vector<int16_t> peakMax_;    // Maximum of each channel in the current peak
+    uint32_t peakFrames_ = 0;         // Frames in the current peak
+    std::vector<int16_t> peaks_;      // Finest level: (minimum, maximum) per channel per peak
+    uint64_t frames_ = 0;             // Complete sample frames received
+};
+
+
+/**
+ * @class PipeSink
+ * @brief Writes extracted sounds to standard output ("-o -") so they can be piped straight into other tools.
+ *
+ * @details
+ * Output goes through a large stream buffer that is handed to fwrite() only when full (or at the end), so the pipe sees
+ * a few big writes instead of one per decoded chunk; stdout's own buffering is disabled to avoid copying the data twice.
+ * In direct mode a single selected sound is written as-is (WAV, FLAC, raw PCM or float32), streaming while it is decoded.
+ * In framed mode every sound is rendered to memory first and written as one frame:
+ *   "FSBX" (4 bytes), metadata length (uint32 LE), metadata JSON (UTF-8), payload length (uint64 LE), payload.
+ * Standard output is not seekable, so nothing written here is patched afterwards (see ProcessSubSound).
+ */
+class PipeSink {
+public:
+    /**
+     * @brief Constructor for PipeSink. Switches standard output to binary mode and disables its buffering.
+     *
+     * @param framed True to write every sound as a frame with metadata, false to write a single sound directly.
+     */
+    explicit PipeSink(bool framed) : buffer_(Constants::ARCHIVE_BUFFER_SIZE), stream_(&buffer_), framed_(framed) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY); // Prevents "\n" from being expanded to "\r\n" in the audio data
+#endif
+        std::setvbuf(stdout, nullptr, _IONBF, 0); // StdoutBuffer already batches the writes
+    }
+
+    PipeSink(const PipeSink&) = delete;
+    PipeSink& operator=(const PipeSink&) = delete;
+
+    /**
+     * @brief Returns the stream that a directly written sound goes to.
+     */
+    std::ostream& stream() { return stream_; }
+
+    /**
+     * @brief Writes one sound as a frame (framed mode).
+     *
+     * @param metadataJson JSON metadata document for the sound.
+     * @param data Complete sound contents.
+     */
+    void AddFrame(const std::string& metadataJson, const std::string& data) {
+        stream_.write("FSBX", 4);
+        ArchiveFormat::WriteLE<uint32_t>(stream_, static_cast<uint32_t>(metadataJson.size()));
+        stream_.write(metadataJson.data(), static_cast<std::streamsize>(metadataJson.size()));
+        ArchiveFormat::WriteLE<uint64_t>(stream_, static_cast<uint64_t>(data.size()));
+        stream_.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!stream_.good()) {
+            throw std::runtime_error("Failed to write to standard output");
+        }
+    }
+
+    /**
+     * @brief Flushes the buffered data to standard output.
+     *
+     * @return bool True if all data was written successfully, false otherwise (e.g. the reading process exited).
+     */
+    bool Finish() {
+        stream_.flush();
+        return stream_.good() && std::fflush(stdout) == 0;
+    }
+
+    /**
+     * @brief Returns true if sounds are written as frames with metadata.
+     */
+    bool framed() const { return framed_; }
+private:
+    /**
+     * @class StdoutBuffer
+     * @brief Stream buffer that collects output in a large buffer and hands it to fwrite(stdout) in big blocks.
+     */
+    class StdoutBuffer : public std::streambuf {
+    public:
+        explicit StdoutBuffer(size_t size) : data_(size) {
+            setp(data_.data(), data_.data() + data_.size());
+        }
+    protected:
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            if (static_cast<size_t>(size) >= data_.size()) { // Large writes bypass the buffer
+                if (sync() != 0) {
+                    return 0;
+                }
+                size_t written = std::fwrite(data, 1, static_cast<size_t>(size), stdout);
+                written_ += written;
+                return static_cast<std::streamsize>(written);
+            }
+            return std::streambuf::xsputn(data, size);
+        }
+
+        int_type overflow(int_type ch) override {
+            if (sync() != 0) {
+                return traits_type::eof();
+            }
+            if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(ch);
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+
+        int sync() override {
+            size_t pending = static_cast<size_t>(pptr() - pbase());
+            if (pending > 0 && std::fwrite(pbase(), 1, pending, stdout) != pending) {
+                return -1;
+            }
+            written_ += pending;
+            setp(data_.data(), data_.data() + data_.size());
+            return 0;
+        }
+
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override {
+            if (offset == 0 && direction == std::ios_base::cur && (which & std::ios_base::out)) { // tellp() reports the bytes written so far
+                return pos_type(static_cast<off_type>(written_ + static_cast<uint64_t>(pptr() - pbase())));
+            }
+            return pos_type(off_type(-1)); // A pipe cannot be rewound
+        }
+    private:
+        std::vector<char> data_; // Output buffer (Constants::ARCHIVE_BUFFER_SIZE bytes)
+        uint64_t written_ = 0;   // Bytes handed to stdout so far
+    };
+
+    StdoutBuffer buffer_;  // Buffer in front of stdout
+    std::ostream stream_;  // Stream over buffer_
+    bool framed_;          // True for framed multi-sound output
+};
+
+
+/**
+ * @brief Returns the file extension (including the dot) used for a sub-sound in the given output format.
+ *
+ * @param outputFormat Output format selected on the command line.
+ * @param soundInfo Format of the sub-sound (only the FLAC fallback to WAV depends on it).
+ * @return const char* The file extension, e.g. ".wav".
+ */
+const char* OutputFileExtension(OutputFormat outputFormat, const SoundInfo& soundInfo) {
+    switch (outputFormat) {
+    case OutputFormat::Flac: return FlacEncoderBuffer::IsSupported(soundInfo) ? ".flac" : ".wav"; // 32-bit and float PCM fall back to WAV
+    case OutputFormat::Npy:  return ".npy";
+    case OutputFormat::F32:  return ".f32";
+    case OutputFormat::Pcm:  return ".pcm";
+    default:                 return ".wav";
+    }
+}
+
+/**
+ * @class SharedMemoryRingSink
+ * @brief Publishes the decoded PCM data of every sound into a POSIX shared-memory ring buffer ("-shm <name>"),
+ * so that a consumer process on the same host can read it without any file system or pipe copies.
+ *
+ * @details
+ * The shared-memory object "/<name>" consists of a 128-byte header followed by the ring data area.
+ * Header (little-endian, host byte order):
+ *   0: "FSBR", 4: uint32 version (1), 8: uint64 data area size in bytes,
+ *   16: uint64 write position (total bytes published, only ever increases), 24: uint64 read position (set by the consumer),
+ *   32: uint32 write signal (futex word, incremented after every publish), 36: uint32 read signal (futex word,
+ *   to be incremented by the consumer after it advances the read position), 40: uint32 state (0 running, 1 finished,
+ *   2 aborted: the consumer stopped reading), 44: uint32 consumer attached (set to 1 by the consumer once it has mapped the object).
+ * Records start at (position % data area size) and never wrap; every record is a multiple of 32 bytes:
+ *   uint32 type, uint32 sound ID (1-based, in extraction order), uint64 sequence number (0, 1, 2, ... over all records),
+ *   uint32 payload size, uint32 reserved, payload.
+ * Types: 1 sound start (payload: JSON metadata with name, format, channels, sample rate and bits per sample),
+ * 2 PCM data (raw samples as decoded, interleaved), 3 sound end (payload: uint64 total PCM bytes of the sound),
+ * 4 padding (skip to the start of the data area), 5 sound aborted (no payload: the extraction of the sound failed, its data
+ * is incomplete). The header magic is written last, once the object is initialized.
+ * The producer waits while the ring is full. On Linux both sides sleep on the futex words (FUTEX_WAIT/FUTEX_WAKE on
+ * the shared mapping); elsewhere the producer polls. If the read position does not move for
+ * Constants::SHM_CONSUMER_TIMEOUT_SECONDS while the ring is full, the producer throws, and every later record fails at once.
+ * The object is not removed at the end of the run: the consumer calls shm_unlink once it has read the final records.
+ * Only if no consumer ever attached and the ring was abandoned does the producer remove the object itself.
+ * Throws std::runtime_error if the shared-memory object cannot be created (always on Windows, which has no POSIX shared memory).
+ */
+class SharedMemoryRingSink {
+public:
+    static constexpr size_t HEADER_SIZE = 128;       // Size of the shared header in front of the data area
+    static constexpr size_t RECORD_HEADER_SIZE = 24; // Size of a record header (type, sound ID, sequence, payload size, reserved)
+    static constexpr size_t RECORD_ALIGNMENT = 32;   // Records start at multiples of this, so a padding record always fits
+    static constexpr uint32_t RECORD_SOUND_START = 1;
+    static constexpr uint32_t RECORD_DATA = 2;
+    static constexpr uint32_t RECORD_SOUND_END = 3;
+    static constexpr uint32_t RECORD_PADDING = 4;
+    static constexpr uint32_t RECORD_SOUND_ABORT = 5;
+
+    /**
+     * @brief Constructor for SharedMemoryRingSink. Creates (or replaces) the shared-memory object and maps it.
+     *
+     * @param name Name of the shared-memory object, without the leading '/'.
+     * @param capacityBytes Size of the ring data area in bytes (rounded down to a multiple of RECORD_ALIGNMENT).
+     */
+    SharedMemoryRingSink(const std::string& name, size_t capacityBytes)
+        : name_("/" + name), capacity_(capacityBytes / RECORD_ALIGNMENT * RECORD_ALIGNMENT), buffer_(this), stream_(&buffer_) {
+#ifdef _WIN32
+        throw std::runtime_error("Shared-memory output is only available on POSIX systems");
+#else
+        if (capacity_ < 16 * RECORD_ALIGNMENT) {
+            throw std::runtime_error("Shared-memory ring is too small");
+        }
+        int fd = ::shm_open(name_.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create shared-memory object: " + name_);
+        }
+        mappedSize_ = HEADER_SIZE + capacity_;
+        bool sized = ::ftruncate(fd, 0) == 0 && ::ftruncate(fd, static_cast<off_t>(mappedSize_)) == 0; // Zeroes a reused object
+        void* mapping = sized ? ::mmap(nullptr, mappedSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            ::shm_unlink(name_.c_str());
+            throw std::runtime_error("Failed to map shared-memory object: " + name_);
+        }
+        base_ = static_cast<char*>(mapping);
+        uint32_t version = 1;
+        uint64_t capacity = capacity_;
+        std::memcpy(base_ + 4, &version, sizeof(version));
+        std::memcpy(base_ + 8, &capacity, sizeof(capacity));
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(base_, "FSBR", 4); // Consumers wait for the magic before reading anything else
+        chunk_.reserve(std::min<size_t>(capacity_ / 4, Constants::ARCHIVE_BUFFER_SIZE) - RECORD_ALIGNMENT);
+#endif
+    }
+
+    /**
+     * @brief Destructor for SharedMemoryRingSink. Marks the stream as finished (or aborted) and unmaps the object.
+     *
+     * @details
+     * An abandoned ring that no consumer ever attached to is also removed, so it does not stay behind in /dev/shm.
+     */
+    ~SharedMemoryRingSink() {
+#ifndef _WIN32
+        if (base_) {
+            Word(STATE_OFFSET).store(consumerLost_ ? 2 : 1, std::memory_order_release);
+            Signal(WRITE_SIGNAL_OFFSET);
+            const bool consumerAttached = Word(CONSUMER_OFFSET).load(std::memory_order_acquire) != 0;
+            ::munmap(base_, mappedSize_);
+            if (consumerLost_ && !consumerAttached) {
+                ::shm_unlink(name_.c_str());
+            }
+        }
+#endif
+    }
+
+    SharedMemoryRingSink(const SharedMemoryRingSink&) = delete;
+    SharedMemoryRingSink& operator=(const SharedMemoryRingSink&) = delete;
+
+    /**
+     * @class SoundGuard
+     * @brief Publishes an abort record for the current sound if it is left without EndSound (its extraction threw).
+     */
+    class SoundGuard {
+    public:
+        explicit SoundGuard(SharedMemoryRingSink* sink) : sink_(sink) {}
+
+        ~SoundGuard() {
+            if (sink_) {
+                sink_->AbortSound();
+            }
+        }
+
+        SoundGuard(const SoundGuard&) = delete;
+        SoundGuard& operator=(const SoundGuard&) = delete;
+    private:
+        SharedMemoryRingSink* sink_; // Ring of the current sound, or nullptr
+    };
+
+    /**
+     * @brief Publishes the start record of a sound and returns the stream its PCM data is written to.
+     *
+     * @param metadataJson JSON metadata document for the sound.
+     * @return std::ostream& Stream publishing PCM data records; tellp() counts the bytes of the current sound.
+     */
+    std::ostream& BeginSound(const std::string& metadataJson) {
+        ++soundId_;
+        soundBytes_ = 0;
+        Publish(RECORD_SOUND_START, metadataJson.data(), metadataJson.size());
+        soundOpen_ = true;
+        stream_.clear();
+        return stream_;
+    }
+
+    /**
+     * @brief Publishes the remaining PCM data and the end record of the current sound.
+     */
+    void EndSound() {
+        stream_.flush();
+        if (!stream_.good()) { // The guard publishes the abort record instead
+            throw std::runtime_error(consumerLost_ ? consumerError_ : "Failed to write to shared-memory ring");
+        }
+        uint64_t totalBytes = soundBytes_;
+        Publish(RECORD_SOUND_END, reinterpret_cast<const char*>(&totalBytes), sizeof(totalBytes));
+        soundOpen_ = false;
+    }
+
+    /**
+     * @brief Publishes the abort record of the current sound, if it has not ended, dropping its unpublished data.
+     * Does nothing once the consumer is lost. Never throws (called while unwinding).
+     */
+    void AbortSound() noexcept {
+        if (!soundOpen_) {
+            return;
+        }
+        soundOpen_ = false;
+        chunk_.clear();
+        if (!consumerLost_) {
+            try {
+                Publish(RECORD_SOUND_ABORT, "", 0);
+            }
+            catch (const std::exception&) {
+                // The consumer is lost as well; the ring state tells it so
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the name of the shared-memory object (with the leading '/').
+     */
+    const std::string& name() const { return name_; }
+private:
+    static constexpr size_t WRITE_POSITION_OFFSET = 16;
+    static constexpr size_t READ_POSITION_OFFSET = 24;
+    static constexpr size_t WRITE_SIGNAL_OFFSET = 32;
+    static constexpr size_t READ_SIGNAL_OFFSET = 36;
+    static constexpr size_t STATE_OFFSET = 40;
+    static constexpr size_t CONSUMER_OFFSET = 44;
+
+    /**
+     * @class RingStreamBuffer
+     * @brief Stream buffer that collects PCM data and publishes it as data records of up to a quarter of the ring.
+     */
+    class RingStreamBuffer : public std::streambuf {
+    public:
+        explicit RingStreamBuffer(SharedMemoryRingSink* sink) : sink_(sink) {}
+    protected:
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            std::vector<char>& chunk = sink_->chunk_;
+            std::streamsize written = 0;
+            while (written < size) {
+                size_t room = chunk.capacity() - chunk.size();
+                size_t count = std::min<size_t>(room, static_cast<size_t>(size - written));
+                chunk.insert(chunk.end(), data + written, data + written + count);
+                written += static_cast<std::streamsize>(count);
+                if (chunk.size() == chunk.capacity() && sync() != 0) {
+                    return written;
+                }
+            }
+            return written;
+        }
+
+        int_type overflow(int_type ch) override {
+            if (traits_type::eq_int_type(ch, traits_type::eof())) {
+                return sync() == 0 ? traits_type::not_eof(ch) : traits_type::eof();
+            }
+            char c = traits_type::to_char_type(ch);
+            return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+        }
+
+        int sync() override {
+            std::vector<char>& chunk = sink_->chunk_;
+            if (!chunk.empty()) {
+                sink_->Publish(RECORD_DATA, chunk.data(), chunk.size());
+                sink_->soundBytes_ += chunk.size();
+                chunk.clear();
+            }
+            return 0;
+        }
+
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override {
+            if (offset == 0 && direction == std::ios_base::cur && (which & std::ios_base::out)) { // tellp(): bytes of the current sound
+                return pos_type(static_cast<off_type>(sink_->soundBytes_ + sink_->chunk_.size()));
+            }
+            return pos_type(off_type(-1)); // The ring cannot be rewound
+        }
+    private:
+        SharedMemoryRingSink* sink_; // Owner receiving the data records
+    };
+
+    /**
+     * @brief Returns a 32-bit word of the shared header as an atomic.
+     */
+    std::atomic<uint32_t>& Word(size_t offset) { return *reinterpret_cast<std::atomic<uint32_t>*>(base_ + offset); }
+
+    /**
+     * @brief Returns a 64-bit position of the shared header as an atomic.
+     */
+    std::atomic<uint64_t>& Position(size_t offset) { return *reinterpret_cast<std::atomic<uint64_t>*>(base_ + offset); }
+
+    /**
+     * @brief Increments a futex word and wakes every process waiting on it.
+     */
+    void Signal(size_t offset) {
+        Word(offset).fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(base_ + offset), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    /**
+     * @brief Waits until the consumer has freed at least the given number of bytes.
+     *
+     * @details
+     * Throws std::runtime_error (and marks the consumer as lost) if the read position does not move for
+     * Constants::SHM_CONSUMER_TIMEOUT_SECONDS, whether no consumer is attached or an attached one stopped reading.
+     */
+    void WaitForSpace(uint64_t writePosition, size_t bytes) {
+        uint64_t lastReadPosition = Position(READ_POSITION_OFFSET).load(std::memory_order_acquire);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(Constants::SHM_CONSUMER_TIMEOUT_SECONDS);
+        while (writePosition + bytes - Position(READ_POSITION_OFFSET).load(std::memory_order_acquire) > capacity_) {
+            uint32_t readSignal = Word(READ_SIGNAL_OFFSET).load(std::memory_order_acquire);
+            const uint64_t readPosition = Position(READ_POSITION_OFFSET).load(std::memory_order_acquire);
+            if (writePosition + bytes - readPosition <= capacity_) {
+                break; // The consumer advanced in between
+            }
+            if (readPosition != lastReadPosition) { // The consumer is alive, but has not freed enough yet
+                lastReadPosition = readPosition;
+                deadline = std::chrono::steady_clock::now() + std::chrono::seconds(Constants::SHM_CONSUMER_TIMEOUT_SECONDS);
+            }
+            else if (std::chrono::steady_clock::now() >= deadline) {
+                consumerLost_ = true;
+                consumerError_ = (Word(CONSUMER_OFFSET).load(std::memory_order_acquire) == 0 ? "No consumer attached to shared-memory ring " : "Shared-memory consumer stopped reading ")
+                    + name_ + " (ring full for " + std::to_string(Constants::SHM_CONSUMER_TIMEOUT_SECONDS) + " s)";
+                throw std::runtime_error(consumerError_);
+            }
+#ifdef __linux__
+            timespec timeout = { 0, 100 * 1000 * 1000 }; // Re-checks periodically in case a consumer does not signal
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(base_ + READ_SIGNAL_OFFSET), FUTEX_WAIT, readSignal, &timeout, nullptr, 0);
+#else
+            (void)readSignal;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+        }
+    }
+
+    /**
+     * @brief Writes one record into the ring (waiting for space if needed) and signals the consumer.
+     */
+    void Publish(uint32_t type, const char* payload, size_t payloadSize) {
+        if (consumerLost_) {
+            throw std::runtime_error(consumerError_);
+        }
+        size_t recordSize = (RECORD_HEADER_SIZE + payloadSize + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+        if (recordSize > capacity_ / 2) {
+            throw std::runtime_error("Record too large for shared-memory ring");
+        }
+        uint64_t writePosition = Position(WRITE_POSITION_OFFSET).load(std::memory_order_relaxed);
+        size_t offset = static_cast<size_t>(writePosition % capacity_);
+        if (capacity_ - offset < recordSize) { // The record would wrap: pad to the end of the data area first
+            size_t paddingSize = capacity_ - offset;
+            WaitForSpace(writePosition, paddingSize);
+            WriteRecordHeader(offset, RECORD_PADDING, paddingSize - RECORD_HEADER_SIZE);
+            writePosition += paddingSize;
+            offset = 0;
+        }
+        WaitForSpace(writePosition, recordSize);
+        WriteRecordHeader(offset, type, payloadSize);
+        std::memcpy(base_ + HEADER_SIZE + offset + RECORD_HEADER_SIZE, payload, payloadSize);
+        Position(WRITE_POSITION_OFFSET).store(writePosition + recordSize, std::memory_order_release); // Publishes the records
+        Signal(WRITE_SIGNAL_OFFSET);
+    }
+
+    /**
+     * @brief Writes a record header at the given offset of the data area.
+     */
+    void WriteRecordHeader(size_t offset, uint32_t type, size_t payloadSize) {
+        char* record = base_ + HEADER_SIZE + offset;
+        uint32_t soundId = soundId_;
+        uint64_t sequence = sequence_++;
+        uint32_t size = static_cast<uint32_t>(payloadSize);
+        uint32_t reserved = 0;
+        std::memcpy(record, &type, 4);
+        std::memcpy(record + 4, &soundId, 4);
+        std::memcpy(record + 8, &sequence, 8);
+        std::memcpy(record + 16, &size, 4);
+        std::memcpy(record + 20, &reserved, 4);
+    }
+
+    std::string name_;           // Name of the shared-memory object, with the leading '/'
+    size_t capacity_;            // Size of the ring data area in bytes
+    size_t mappedSize_ = 0;      // Size of the mapping (header plus data area)
+    char* base_ = nullptr;       // Start of the mapping
+    uint32_t soundId_ = 0;       // ID of the current sound (1-based)
+    uint64_t sequence_ = 0;      // Sequence number of the next record
+    uint64_t soundBytes_ = 0;    // PCM bytes published for the current sound
+    bool soundOpen_ = false;     // True between the start record and the end (or abort) record of a sound
+    bool consumerLost_ = false;  // True once a wait for the consumer timed out; every later record fails at once
+    std::string consumerError_;  // Reason the consumer was given up on
+    std::vector<char> chunk_;    // PCM data collected for the next data record
+    RingStreamBuffer buffer_;    // Buffer publishing chunk_
+    std::ostream stream_;        // Stream over buffer_
+};
+
+
+/**
+ * @struct OutputPlan
+ * @brief Output paths and language IDs of all sub-sounds of an FSB, computed by PlanOutputPaths before extraction.
+ */
+struct OutputPlan {
+    std::vector<std::filesystem::path> outputPaths;     // Output path of each sub-sound, by index (empty if the sub-sound cannot be opened)
+    std::vector<uint16_t> languageIds;                  // Language of each sub-sound, by index (0 for no language tag)
+    std::vector<std::string> languages;                 // Language tag of each ID (ID 0: "")
+    std::vector<std::filesystem::path> languageFolders; // Output folder of each ID (ID 0: the output directory of the FSB)
+
+    /**
+     * @brief Returns the language tag of a sub-sound, or an empty string if it has none.
+     */
+    const std::string& Language(int subSoundIndex) const {
+        return languages[static_cast<size_t>(subSoundIndex) < languageIds.size() ? languageIds[subSoundIndex] : 0];
+    }
+};
+
+/**
+ * @brief Computes the output path of every sub-sound of an FSB before any sound is extracted.
+ *
+ * @param sound FMOD Sound object of the FSB file.
+ * @param numSubSounds Number of sub-sounds in the FSB file.
+ * @param baseFileName Base file name (stem of the input FSB file name).
+ * @param outputDirectory Output directory of the FSB file.
+ * @param usedFileNames Output paths used so far in the extraction session, with their next free suffixes.
+ * @param outputFormat Output format selected on the command line.
+ * @param sampleKeyNames True if the file names become WebDataset sample keys (shards and framed stdout output), see GetOutputFilePath.
+ * @return OutputPlan The output path and language ID of each sub-sound, and the tag and folder of each language.
+ *
+ * @details
+ * Only header metadata is read here (name, language tag, format and default frequency), no audio is decoded.
+ * Name collisions are resolved in sub-sound index order, so the same input always produces the same file names,
+ * whichever sounds are selected and in whatever order they are extracted later; extraction only looks its path up.
+ * FMOD exposes the language only as a per-sub-sound tag, so it is read once per sub-sound in this pass and
+ * interned as a small integer ID; each distinct language is sanitized and turned into a folder path only once.
+ * ProcessSubSound reads a sound's language for its metadata through the same ID (OutputPlan::Language).
+ */
+OutputPlan PlanOutputPaths(FMOD::Sound* sound, int numSubSounds, const std::string& baseFileName, const std::filesystem::path& outputDirectory, OutputFileNames& usedFileNames, OutputFormat outputFormat, bool sampleKeyNames) {
+    OutputPlan plan;
+    plan.outputPaths.resize(static_cast<size_t>(numSubSounds));
+    plan.languageIds.assign(static_cast<size_t>(numSubSounds), 0);
+    plan.languages.emplace_back();
+    plan.languageFolders.push_back(outputDirectory);
+    std::unordered_map<std::string, uint16_t> languageIdsByTag; // Language tag -> ID (IDs start at 1)
+    uint16_t previousLanguageId = 0; // Sounds of one language are usually stored together, so the last ID is checked first
+
+    for (int i = 0; i < numSubSounds; ++i) {
+        FMOD::Sound* subSound = nullptr;
+        if (sound->getSubSound(i, &subSound) != FMOD_OK || !subSound) {
+            continue; // Reported when the sub-sound is extracted
+        }
+
+        SoundInfo soundInfo; // Header fields only, see GetSoundInfo for the complete query
+        float defaultFrequency = 0.0f;
+        subSound->getFormat(&soundInfo.soundType, &soundInfo.format, &soundInfo.channels, &soundInfo.bitsPerSample);
+        subSound->getDefaults(&defaultFrequency, nullptr);
+        soundInfo.sampleRate = (defaultFrequency > 0) ? static_cast<int>(defaultFrequency) : 44100; // Same fallback as GetSoundInfo
+        subSound->getName(soundInfo.subSoundName, sizeof(soundInfo.subSoundName));
+
+        uint16_t languageId = 0;
+        FMOD_TAG tag;
+        if (subSound->getTag("language", 0, &tag) == FMOD_OK && tag.datatype == FMOD_TAGDATATYPE_STRING) {
+            const char* language = static_cast<const char*>(tag.data);
+            if (language[0] == '\0') {
+                languageId = 0;
+            }
+            else if (previousLanguageId != 0 && plan.languages[previousLanguageId] == language) {
+                languageId = previousLanguageId; // Same language as the previous sound, no hashing needed
+            }
+            else {
+                auto it = languageIdsByTag.find(language);
+                if (it == languageIdsByTag.end()) { // First sound of this language
+                    if (plan.languages.size() > std::numeric_limits<uint16_t>::max()) {
+                        throw std::runtime_error("Too many distinct language tags in FSB file");
+                    }
+                    it = languageIdsByTag.emplace(language, static_cast<uint16_t>(plan.languages.size())).first;
+                    plan.languages.push_back(it->first);
+                    plan.languageFolders.push_back(outputDirectory / SanitizeFileName(it->first)); // Language folder, e.g. "ko"
+                }
+                languageId = it->second;
+            }
+            previousLanguageId = languageId;
+        }
+        plan.languageIds[i] = languageId;
+        plan.outputPaths[i] = GetOutputFilePath(plan.languageFolders[languageId], baseFileName, soundInfo, i, usedFileNames, OutputFileExtension(outputFormat, soundInfo), sampleKeyNames);
+    }
+    return plan;
+}
+
+
+/**
+ * @namespace FSBExtractorAPI
+ * @brief In-process API for programs that embed the extractor: opens FSB and BANK files and decodes sub-sounds
+ * into caller-supplied buffers or callbacks.
+ *
+ * @details
+ * This is the same pipeline as the command line (bank scanning, FSB open, GetSoundInfo, readData loop) without any
+ * output stage: nothing is written to the file system (FSBs embedded in a bank are opened in place at their offset,
+ * not copied to temporary files) and nothing is printed, except an FMOD release failure in a destructor, which goes to
+ * std::cerr because it cannot be thrown. Define FSB_EXTRACTOR_LIBRARY when compiling this file into another program to
+ * leave out main. Errors are thrown as std::runtime_error, like everywhere else in the extractor (an unknown sound number
+ * as std::out_of_range).
+ * The decoded data has the same layout as the data chunk of the extracted WAV file (FMOD's PCM format, interleaved),
+ * except that PCM float samples are returned as decoded, without the clipping to [-1, 1] applied for WAV output.
+ * An Extractor owns one FMOD system and is not thread-safe; use one instance per thread.
+ */
+namespace FSBExtractorAPI {
+    /**
+     * @brief Receives one chunk of decoded PCM data. Returns false to stop decoding the sound early.
+     */
+    using ChunkCallback = std::function<bool(const char* data, size_t size)>;
+
+    /**
+     * @class Extractor
+     * @brief Opens FSB and BANK files and decodes their sub-sounds into memory.
+     */
+    class Extractor {
+    public:
+        Extractor() = default;
+
+        Extractor(const Extractor&) = delete;
+        Extractor& operator=(const Extractor&) = delete;
+
+        /**
+         * @brief Opens an *.fsb file, or every FSB embedded in a *.bank file, and appends its sub-sounds to the sound list.
+         *
+         * @param inputFilePath Path to the *.fsb or *.bank file.
+         * @return size_t Number of sub-sounds added. Throws std::runtime_error if the file cannot be opened or a bank is truncated.
+         */
+        size_t Open(const std::filesystem::path& inputFilePath) {
+            const size_t firstSound = sounds_.size();
+            std::string extension = inputFilePath.extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (extension == ".bank") {
+                std::string error;
+                std::vector<BANKtoFSBExtractor::EmbeddedFSB> embeddedFsbs = BANKtoFSBExtractor::FindFSBsInBankFile(inputFilePath, &error);
+                if (!error.empty()) { // Thrown before any FSB is opened, so the sound list is unchanged
+                    throw std::runtime_error(error);
+                }
+                for (const BANKtoFSBExtractor::EmbeddedFSB& fsb : embeddedFsbs) {
+                    AddContainer(std::make_unique<FMODSound>(system_.get(), inputFilePath.u8string(), fsb.offset, fsb.size));
+                }
+            }
+            else {
+                AddContainer(std::make_unique<FMODSound>(system_.get(), inputFilePath.u8string()));
+            }
+            return sounds_.size() - firstSound;
+        }
+
+        /**
+         * @brief Returns the number of sub-sounds opened so far (over all files and FSBs).
+         */
+        size_t soundCount() const { return sounds_.size(); }
+
+        /**
+         * @brief Returns format, length and name of a sub-sound.
+         *
+         * @param soundNumber 0-based number of the sub-sound, in the order the files were opened.
+         * @return SoundInfo The sub-sound information; soundLengthBytes is the buffer size Decode needs.
+         */
+        SoundInfo GetInfo(size_t soundNumber) {
+            FMOD::Sound* subSound = SubSound(soundNumber); // Range-checked before sounds_ is indexed
+            const int subSoundIndex = sounds_[soundNumber].subSoundIndex;
+            return GetSoundInfo(subSound, subSoundIndex, false, noLog_, false);
+        }
+
+        /**
+         * @brief Decodes a sub-sound into a caller-supplied buffer.
+         *
+         * @param soundNumber 0-based number of the sub-sound.
+         * @param buffer Destination of the PCM data.
+         * @param bufferSize Size of buffer in bytes (GetInfo(soundNumber).soundLengthBytes for the whole sound).
+         * @return size_t Number of bytes decoded (less than bufferSize if the sound is shorter).
+         *
+         * @details
+         * FMOD decodes straight into the buffer, without an intermediate copy. In the allocation-counting build, readData runs
+         * in the Decode phase (tests/alloc_steady_state.cpp checks that it allocates nothing).
+         */
+        size_t Decode(size_t soundNumber, char* buffer, size_t bufferSize) {
+            FMOD::Sound* subSound = SubSound(soundNumber);
+            CheckFMODResult(subSound->seekData(0), "FMOD::Sound::seekData failed for sound " + std::to_string(soundNumber));
+            size_t totalBytesRead = 0;
+            while (totalBytesRead < bufferSize) {
+                unsigned int bytesToRead = static_cast<unsigned int>(std::min<size_t>(bufferSize - totalBytesRead, std::numeric_limits<unsigned int>::max()));
+                unsigned int bytesRead = 0;
+                FMOD_RESULT result;
+                {
+                    PerfCounters::Scope perfScope(PerfCounters::Decode);
+                    result = subSound->readData(buffer + totalBytesRead, bytesToRead, &bytesRead);
+                }
+                if (result != FMOD_OK && result != FMOD_ERR_FILE_EOF) {
+                    CheckFMODResult(result, "FMOD::Sound::readData failed for sound " + std::to_string(soundNumber));
+                }
+                totalBytesRead += bytesRead;
+                if (result == FMOD_ERR_FILE_EOF || bytesRead == 0) {
+                    break;
+                }
+            }
+            return totalBytesRead;
+        }
+
+        /**
+         * @brief Decodes a sub-sound chunk by chunk and passes every chunk to a callback.
+         *
+         * @param soundNumber 0-based number of the sub-sound.
+         * @param onChunk Callback receiving the decoded data; the chunk is only valid during the call.
+         * @return uint64_t Number of bytes decoded.
+         *
+         * @details
+         * The chunk buffer is allocated once per call. For the performance counters, readData runs in the Decode phase and the
+         * callback in the Write phase, like the reads and writes of the command line's chunk writers.
+         */
+        uint64_t Decode(size_t soundNumber, const ChunkCallback& onChunk) {
+            FMOD::Sound* subSound = SubSound(soundNumber);
+            CheckFMODResult(subSound->seekData(0), "FMOD::Sound::seekData failed for sound " + std::to_string(soundNumber));
+            std::vector<char> chunk(Constants::CHUNK_SIZE);
+            uint64_t totalBytesRead = 0;
+            while (true) {
+                unsigned int bytesRead = 0;
+                FMOD_RESULT result;
+                {
+                    PerfCounters::Scope perfScope(PerfCounters::Decode);
+                    result = subSound->readData(chunk.data(), Constants::CHUNK_SIZE, &bytesRead);
+                }
+                if (result != FMOD_OK && result != FMOD_ERR_FILE_EOF) {
+                    CheckFMODResult(result, "FMOD::Sound::readData failed for sound " + std::to_string(soundNumber));
+                }
+                totalBytesRead += bytesRead;
+                if (bytesRead > 0) {
+                    bool keepGoing;
+                    {
+                        PerfCounters::Scope perfScope(PerfCounters::Write);
+                        keepGoing = onChunk(chunk.data(), bytesRead);
+                    }
+                    if (!keepGoing) {
+                        break; // Stopped by the caller
+                    }
+                }
+                if (result == FMOD_ERR_FILE_EOF || bytesRead == 0) {
+                    break;
+                }
+            }
+            return totalBytesRead;
+        }
+    private:
+        /**
+         * @struct SoundEntry
+         * @brief Location of one sub-sound: the FSB it belongs to and its index in that FSB.
+         */
+        struct SoundEntry {
+            size_t container;  // Index into containers_
+            int subSoundIndex; // Index of the sub-sound within the FSB
+        };
+
+        /**
+         * @brief Takes ownership of an opened FSB and adds its sub-sounds to the sound list.
+         */
+        void AddContainer(std::unique_ptr<FMODSound> container) {
+            int numSubSounds = 0;
+            CheckFMODResult(container->get()->getNumSubSounds(&numSubSounds), "FMOD::Sound::getNumSubSounds failed");
+            containers_.push_back(std::move(container));
+            for (int i = 0; i < numSubSounds; ++i) {
+                sounds_.push_back({ containers_.size() - 1, i });
+            }
+        }
+
+        /**
+         * @brief Returns the FMOD sub-sound for a sound number. Throws std::out_of_range for an unknown number.
+         */
+        FMOD::Sound* SubSound(size_t soundNumber) {
+            if (soundNumber >= sounds_.size()) {
+                throw std::out_of_range("Sound number " + std::to_string(soundNumber) + " out of range");
+            }
+            const SoundEntry& entry = sounds_[soundNumber];
+            FMOD::Sound* subSound = nullptr;
+            CheckFMODResult(containers_[entry.container]->get()->getSubSound(entry.subSoundIndex, &subSound), "FMOD::Sound::getSubSound failed for sound " + std::to_string(soundNumber));
+            return subSound;
+        }
+
+        FMODSystem system_;                                  // FMOD system used for all files (declared first, released last)
+        std::vector<std::unique_ptr<FMODSound>> containers_; // Opened FSBs
+        std::vector<SoundEntry> sounds_;                     // Every sub-sound, in the order the files were opened
+        std::ofstream noLog_;                                // Never opened: GetSoundInfo logs nothing
+    };
+}
+
+
+namespace LogTimestamp {
+    constexpr size_t WALL_CLOCK_LENGTH = 23; // "YYYY-mm-dd HH:MM:SS.mmm"
+
+    /**
+     * @brief Returns the flag selecting relative timestamps (time since start from the monotonic clock) for log lines.
+     */
+    inline std::atomic<bool>& RelativeMode() {
+        static std::atomic<bool> relative{ false };
+        return relative;
+    }
+
+    /**
+     * @brief Returns the reference point of relative timestamps (the first call, i.e. program start).
+     */
+    inline std::chrono::steady_clock::time_point StartTime() {
+        static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        return start;
+    }
+
+    /**
+     * @brief Switches the log to relative timestamps ("-log-relative").
+     */
+    inline void UseRelativeTime() {
+        StartTime();
+        RelativeMode().store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the current log time in nanoseconds: since the epoch (wall clock), or since StartTime() in relative mode.
+     */
+    inline int64_t Now() {
+        if (RelativeMode().load(std::memory_order_relaxed)) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - StartTime()).count();
+        }
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Appends a log time returned by Now() to a line: "YYYY-mm-dd HH:MM:SS.mmm" (local time), or "+seconds.microseconds".
      *
-     * @param reader The std::ifstream to search within.
-     * @return bool True if the "FSB5" signature is found, false otherwise.
+     * @details
+     * Converting to local time (localtime_r) and formatting the date are by far the most expensive parts of a log line,
+     * but the result only changes once per second. Each thread therefore keeps the text of the last second it formatted
+     * and only writes the three millisecond digits for the following lines of that second.
      */
-    bool FindFSB5Signature(std::ifstream& reader) {
-        std::streampos startPosition = reader.tellg(); // Store the initial position of the stream
-        reader.seekg(0, std::ios::end);
-        long long fileSize = reader.tellg();
-        reader.seekg(startPosition);
+    inline void Append(std::string& line, int64_t nanoseconds) {
+        if (RelativeMode().load(std::memory_order_relaxed)) {
+            char text[32];
+            int64_t microseconds = std::max<int64_t>(0, nanoseconds / 1000);
+            text[0] = '+';
+            char* end = std::to_chars(text + 1, text + sizeof(text) - 7, microseconds / 1000000).ptr;
+            *end++ = '.';
+            for (int i = 5; i >= 0; --i, microseconds /= 10) {
+                end[i] = static_cast<char>('0' + microseconds % 10);
+            }
+            line.append(text, end + 6);
+            return;
+        }
 
-        while (static_cast<long long>(reader.tellg()) < fileSize - 3) {
-            char signature[4];
-            reader.read(signature, 4);
-            if (reader.gcount() == 4) { // Ensure 4 bytes were read
-                if (std::string(signature, 4) == "FSB5") {
-                    reader.seekg(-4, std::ios::cur); // Rewind by 4 bytes
-                    return true;
-                }
+        struct Cache {
+            int64_t second = std::numeric_limits<int64_t>::min(); // Second the text was formatted for
+            char text[WALL_CLOCK_LENGTH + 1];                      // "YYYY-mm-dd HH:MM:SS.mmm"
+        };
+        thread_local Cache cache;
+        const int64_t milliseconds = nanoseconds / 1000000;
+        const int64_t second = milliseconds / 1000;
+        if (second != cache.second) { // First line of a new second: full conversion and formatting
+            std::time_t time_t_value = static_cast<std::time_t>(second);
+            std::tm time_components; // Struct to store time components (year, month, day, hour, minute, second)
+#ifdef _WIN32
+            localtime_s(&time_components, &time_t_value); // Converts time_t to local time and fills time_components struct (thread-safe version for Windows)
+#else
+            localtime_r(&time_t_value, &time_components); // POSIX version
+#endif
+            std::strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S.", &time_components);
+            cache.second = second;
+        }
+        const int millisecond = static_cast<int>(milliseconds % 1000); // Patched into the cached text
+        cache.text[20] = static_cast<char>('0' + millisecond / 100);
+        cache.text[21] = static_cast<char>('0' + millisecond / 10 % 10);
+        cache.text[22] = static_cast<char>('0' + millisecond % 10);
+        line.append(cache.text, WALL_CLOCK_LENGTH);
+    }
+}
+
+
+/**
+ * @brief Formats one log line: "[timestamp] [level] [function] message (Error code: n)" plus a newline.
+ *
+ * @param line String the line is appended to.
+ * @param timestamp Time the message was logged, as returned by LogTimestamp::Now().
+ * @param level Log level (e.g., "INFO", "WARNING", "ERROR").
+ * @param functionName Name of the function where the log message originates.
+ * @param message The log message string.
+ * @param errorCode FMOD_RESULT error code (FMOD_OK if no error).
+ */
+void FormatLogLine(std::string& line, int64_t timestamp, const char* level, const char* functionName, const std::string& message, FMOD_RESULT errorCode) {
+    line += '[';
+    LogTimestamp::Append(line, timestamp); // Timestamp
+    line += "] [";
+    line += level;        // Log level
+    line += "] [";
+    line += functionName; // Function name
+    line += "] ";
+    line += message;
+    if (errorCode != FMOD_OK) { // If an FMOD error code is provided (not FMOD_OK)
+        line += " (Error code: " + std::to_string(errorCode) + ")"; // Appends error code to the log message
+    }
+    line += '\n';
+}
+
+
+namespace BinaryLog {
+    constexpr char MAGIC[8] = { 'F', 'S', 'B', 'X', 'L', 'O', 'G', '1' }; // File signature
+    constexpr uint8_t FLAG_RELATIVE_TIME = 1;   // Header flag: timestamps are nanoseconds since start, not since the epoch
+    constexpr uint8_t RECORD_SITE = 1;          // Record: defines a (level, function) pair used by later messages
+    constexpr uint8_t RECORD_MESSAGE = 2;       // Record: one log message
+    constexpr uint8_t RECORD_SEPARATOR = 3;     // Record: blank line
+    constexpr size_t MAX_DICTIONARY_TEXT = 256; // Longest message text kept in the repeat dictionary
+    constexpr size_t MAX_DICTIONARY_SIZE = 65536; // Dictionary entries at most (encoder and decoder apply the same rules)
+
+    /**
+     * @brief Appends an unsigned LEB128 varint (7 bits per byte, low bits first).
+     */
+    inline void WriteVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    /**
+     * @brief Reads an unsigned LEB128 varint.
+     *
+     * @return bool True on success, false at end of input or on a malformed value.
+     */
+    inline bool ReadVarint(std::istream& in, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int byte = in.get();
+            if (byte == std::char_traits<char>::eof()) {
+                return false;
             }
-            else {
-                break; // Reached end of file prematurely
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
             }
-            reader.seekg(-3, std::ios::cur); // Move back 3 bytes to check next sequence
         }
-        reader.clear(); // Clear any EOF flags
-        reader.seekg(startPosition); // Reset stream position if not found
         return false;
     }
 
+    /**
+     * @brief Maps a signed value to an unsigned one with small magnitudes staying small (zigzag encoding).
+     */
+    inline uint64_t ZigZag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t UnZigZag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
 
     /**
-     * @brief Extracts FSB files embedded within a BANK file (ported from C#).
+     * @class Encoder
+     * @brief Encodes log messages into the compact binary log format ("-log-binary").
      *
-     * @param bankFilePath Path to the BANK file to extract FSBs from.
-     * @return std::vector<std::filesystem::path> List of temporary file paths for the extracted FSB files.
-     *         Returns an empty list if no FSB files are found or if an error occurs.
+     * @details
+     * The file starts with MAGIC and a flags byte, followed by records, each introduced by a type byte:
+     *   RECORD_SITE:      varint site ID, varint length + level, varint length + function name.
+     *   RECORD_MESSAGE:   varint zigzag timestamp delta (ns), varint site ID, varint zigzag FMOD error code,
+     *                     varint text reference: 0 followed by varint length + text, or n for dictionary entry n - 1.
+     *   RECORD_SEPARATOR: no payload.
+     * Level and function name, which are string literals, are written once per pair as a site. Timestamps are stored as
+     * the difference to the previous message, usually one to three bytes. Messages of up to MAX_DICTIONARY_TEXT bytes
+     * are added to a dictionary when first written, so fixed messages ("Getting sound format...") cost a few bytes after
+     * their first occurrence. An encoder is used by a single thread (the AsyncLogger writer).
      */
-    std::vector<std::filesystem::path> ExtractFSBsFromBankFile(const std::filesystem::path& bankFilePath) {
-        std::vector<std::filesystem::path> tempFsbFiles;
-        std::string baseBankFileName = bankFilePath.stem().string();
-        std::filesystem::path tempPath = std::filesystem::temp_directory_path();
+    class Encoder {
+    public:
+        /**
+         * @brief Appends the file header.
+         */
+        void WriteHeader(std::string& out) const {
+            out.append(MAGIC, sizeof(MAGIC));
+            out += static_cast<char>(LogTimestamp::RelativeMode().load(std::memory_order_relaxed) ? FLAG_RELATIVE_TIME : 0);
+        }
 
-        try {
-            std::ifstream bankFileStream(bankFilePath, std::ios::binary);
-            if (!bankFileStream.is_open()) {
-                std::cerr << "Error opening bank file: " << bankFilePath.u8string() << std::endl;
-                return tempFsbFiles; // Return empty vector on error
+        /**
+         * @brief Appends one message record (preceded by a site record the first time its level and function are used).
+         */
+        void WriteMessage(std::string& out, int64_t timestamp, const char* level, const char* functionName, const std::string& message, FMOD_RESULT errorCode) {
+            auto site = sites_.try_emplace(SiteKey(level, functionName), static_cast<uint64_t>(sites_.size()));
+            if (site.second) { // New site: defines it before its first use
+                out += static_cast<char>(RECORD_SITE);
+                WriteVarint(out, site.first->second);
+                WriteText(out, level);
+                WriteText(out, functionName);
             }
+            out += static_cast<char>(RECORD_MESSAGE);
+            WriteVarint(out, ZigZag(timestamp - lastTimestamp_)); // Messages from several threads may be slightly out of order
+            lastTimestamp_ = timestamp;
+            WriteVarint(out, site.first->second);
+            WriteVarint(out, ZigZag(errorCode));
+            auto entry = dictionary_.find(message);
+            if (entry != dictionary_.end()) {
+                WriteVarint(out, entry->second + 1);
+                return;
+            }
+            WriteVarint(out, 0);
+            WriteText(out, message);
+            if (message.size() <= MAX_DICTIONARY_TEXT && dictionary_.size() < MAX_DICTIONARY_SIZE) {
+                dictionary_.emplace(message, static_cast<uint64_t>(dictionary_.size()));
+            }
+        }
 
-            int fsbCount = 0;
-            while (FindFSB5Signature(bankFileStream)) {
-                fsbCount++;
-                std::string tempFileName;
-                if (fsbCount > 1) {
-                    tempFileName = baseBankFileName + "_" + std::to_string(fsbCount) + ".fsb";
-                }
-                else {
-                    tempFileName = baseBankFileName + ".fsb";
-                }
-                std::filesystem::path tempFilePath = tempPath / tempFileName;
-                tempFsbFiles.push_back(tempFilePath);
-
-                try {
-                    std::ofstream tempFsbStream(tempFilePath, std::ios::binary | std::ios::trunc);
-                    if (!tempFsbStream.is_open()) {
-                        std::cerr << "Error creating temporary *.fsb file: " << tempFilePath.u8string() << std::endl;
-                        tempFsbFiles.pop_back(); // Remove from list
-                        continue;
-                    }
+        /**
+         * @brief Appends a blank line record.
+         */
+        void WriteSeparator(std::string& out) const {
+            out += static_cast<char>(RECORD_SEPARATOR);
+        }
+    private:
+        static void WriteText(std::string& out, const std::string& text) {
+            WriteVarint(out, text.size());
+            out += text;
+        }
 
-                    // Read FSB header information (structure based on QuickBMS script analysis)
-                    char fsbSign[4];
-                    uint32_t version, numSamples, shdrSize, nameSize, dataSize;
+        /**
+         * @brief Returns the key of a (level, function) pair. The arguments are string literals, so their addresses identify them.
+         */
+        static std::pair<const char*, const char*> SiteKey(const char* level, const char* functionName) {
+            return { level, functionName };
+        }
 
-                    bankFileStream.read(fsbSign, 4);
-                    bankFileStream.read(reinterpret_cast<char*>(&version), sizeof(version));
-                    bankFileStream.read(reinterpret_cast<char*>(&numSamples), sizeof(numSamples));
-                    bankFileStream.read(reinterpret_cast<char*>(&shdrSize), sizeof(shdrSize));
-                    bankFileStream.read(reinterpret_cast<char*>(&nameSize), sizeof(nameSize));
-                    bankFileStream.read(reinterpret_cast<char*>(&dataSize), sizeof(dataSize));
+        struct SiteKeyHash {
+            size_t operator()(const std::pair<const char*, const char*>& key) const {
+                return std::hash<const void*>()(key.first) * 31 + std::hash<const void*>()(key.second);
+            }
+        };
 
-                    uint32_t fsbFileSize = 0x3C + shdrSize + nameSize + dataSize;
+        std::unordered_map<std::pair<const char*, const char*>, uint64_t, SiteKeyHash> sites_; // Site ID of every (level, function) pair written
+        std::unordered_map<std::string, uint64_t> dictionary_;                                // Dictionary index of repeated message texts
+        int64_t lastTimestamp_ = 0;                                                           // Timestamp of the previous message
+    };
 
-                    bankFileStream.seekg(-24, std::ios::cur); // Seek back to the beginning of FSB header
-                    std::vector<char> fsbData(fsbFileSize);
-                    bankFileStream.read(fsbData.data(), fsbFileSize);
-                    tempFsbStream.write(fsbData.data(), fsbFileSize);
+    /**
+     * @brief Renders a binary log as the text log it replaces ("program -decode-log <file>").
+     *
+     * @param binaryLogPath Path of the binary log file.
+     * @param output Stream receiving the text lines.
+     * @return bool True if the whole file was decoded, false if it could not be read or is malformed (lines decoded so far are written).
+     */
+    inline bool DecodeToText(const std::filesystem::path& binaryLogPath, std::ostream& output) {
+        std::ifstream input(binaryLogPath, std::ios::binary);
+        char magic[sizeof(MAGIC)];
+        if (!input.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+            std::cerr << " Error: Not a binary log file: " << binaryLogPath.u8string() << std::endl;
+            return false;
+        }
+        const int flags = input.get();
+        if (flags == std::char_traits<char>::eof() || (flags & ~FLAG_RELATIVE_TIME) != 0) { // Missing flags byte, or flags this version does not know
+            std::cerr << " Error: Truncated or unsupported binary log header in " << binaryLogPath.u8string() << std::endl;
+            return false;
+        }
+        if (flags & FLAG_RELATIVE_TIME) {
+            LogTimestamp::UseRelativeTime(); // Only changes how Append formats the stored times
+        }
 
+        auto readText = [&input](std::string& text) {
+            uint64_t length;
+            if (!ReadVarint(input, length) || length > (1u << 24)) {
+                return false;
+            }
+            text.resize(static_cast<size_t>(length));
+            return static_cast<bool>(input.read(&text[0], static_cast<std::streamsize>(length)));
+        };
 
+        std::vector<std::pair<std::string, std::string>> sites; // (level, function) by site ID
+        std::vector<std::string> dictionary;                     // Repeated message texts, in the order the encoder added them
+        std::string line;
+        std::string message;
+        int64_t timestamp = 0;
+        bool malformed = false;
+        for (int type = input.get(); type != std::char_traits<char>::eof(); type = input.get()) {
+            line.clear();
+            if (type == RECORD_SITE) {
+                uint64_t id;
+                std::pair<std::string, std::string> site;
+                if (!ReadVarint(input, id) || id != sites.size() || !readText(site.first) || !readText(site.second)) {
+                    malformed = true;
+                    break;
+                }
+                sites.push_back(std::move(site));
+                continue;
+            }
+            if (type == RECORD_SEPARATOR) {
+                output << '\n';
+                continue;
+            }
+            uint64_t delta, siteId, errorCode, reference;
+            if (type != RECORD_MESSAGE || !ReadVarint(input, delta) || !ReadVarint(input, siteId) || siteId >= sites.size()
+                || !ReadVarint(input, errorCode) || !ReadVarint(input, reference) || reference > dictionary.size()) {
+                malformed = true;
+                break;
+            }
+            timestamp += UnZigZag(delta);
+            if (reference > 0) {
+                message = dictionary[static_cast<size_t>(reference - 1)];
+            }
+            else {
+                if (!readText(message)) {
+                    malformed = true;
+                    break;
                 }
-                catch (const std::exception& ex) {
-                    std::cerr << "Error creating temporary *.fsb file: " << tempFilePath.u8string() << " - " << ex.what() << std::endl;
-                    tempFsbFiles.pop_back(); // Remove from list
-                    std::filesystem::remove(tempFilePath); // Delete the temporary file if it exists
-                    continue;
+                if (message.size() <= MAX_DICTIONARY_TEXT && dictionary.size() < MAX_DICTIONARY_SIZE) {
+                    dictionary.push_back(message);
                 }
-                // No explicit offset update needed, FindFSB5Signature handles stream position
             }
+            FormatLogLine(line, timestamp, sites[siteId].first.c_str(), sites[siteId].second.c_str(), message, static_cast<FMOD_RESULT>(UnZigZag(errorCode)));
+            output << line;
         }
-        catch (const std::exception& ex) {
-            std::cerr << "*.bank file processing error: " << bankFilePath.u8string() << " - " << ex.what() << std::endl;
+        output.flush();
+        if (malformed) {
+            std::cerr << " Error: Truncated or malformed binary log record in " << binaryLogPath.u8string() << std::endl;
+            return false;
         }
-        return tempFsbFiles;
+        return true;
     }
 }
 
+
 /**
- * @brief Gets a unique full output file path for a sub-sound WAV file, handling potential name collisions.
+ * @class AsyncLogger
+ * @brief Writes the verbose log on a background thread, so the extraction threads only copy each message into a ring.
  *
- * @param outputDirectoryPath The base output directory path.
- * @param baseFileName The base file name (stem of the input FSB file name).
- * @param soundInfo The SoundInfo struct containing information about the sub-sound.
- * @param subSoundIndex The index of the sub-sound being processed.
- * @param usedFileNames A set containing file paths already used in the current extraction session to prevent overwrites.
- * @return std::filesystem::path The unique full output file path for the WAV file.
+ * @details
+ * Producers reserve fixed-size slots in a lock-free multi-producer ring (a bounded sequence-numbered queue): a message
+ * takes as many consecutive slots as its length needs, all claimed with a single compare-and-swap. The writer thread
+ * drains the ring in order, formats the lines and writes them to the log file in large blocks, flushing whenever the
+ * ring runs empty (instead of after every line, as std::endl did).
+ * When the ring is full, Push either waits for the writer (default) or drops the message; the number of dropped
+ * messages is reported in the log. While an instance exists, WriteLogMessage sends every message for its file here.
+ * With binary output, the writer encodes the messages with BinaryLog::Encoder instead of formatting them.
  */
-std::filesystem::path GetOutputFilePath(const std::filesystem::path& outputDirectoryPath, const std::string& baseFileName, const SoundInfo& soundInfo, int subSoundIndex, std::unordered_set<std::string>& usedFileNames) {
-    std::string outputFileName = std::strlen(soundInfo.subSoundName) > 0
-        ? SanitizeFileName(soundInfo.subSoundName)
-        : SanitizeFileName(baseFileName + "_" + std::to_string(subSoundIndex));
+class AsyncLogger {
+public:
+    /**
+     * @brief Constructor for AsyncLogger. Starts the writer thread and routes WriteLogMessage calls for logFile to it.
+     *
+     * @param logFile Open log file; it must not be written to directly until the logger is destroyed.
+     * @param dropWhenFull True to drop messages when the ring is full, false to wait for free slots.
+     * @param binaryFormat True to write the binary log format ("-log-binary"), false for text lines.
+     */
+    AsyncLogger(std::ofstream& logFile, bool dropWhenFull, bool binaryFormat)
+        : logFile_(logFile), dropWhenFull_(dropWhenFull), slots_(RING_SLOTS), binaryEncoder_(binaryFormat ? std::make_unique<BinaryLog::Encoder>() : nullptr) {
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        writer_ = std::thread(&AsyncLogger::WriterLoop, this);
+        Active().store(this, std::memory_order_release);
+    }
+
+    /**
+     * @brief Destructor for AsyncLogger. Writes all queued messages, flushes the log file and stops the writer thread.
+     */
+    ~AsyncLogger() {
+        Active().store(nullptr, std::memory_order_release);
+        stop_.store(true, std::memory_order_release);
+        writer_.join();
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    /**
+     * @brief Returns the logger that WriteLogMessage currently sends messages to, or nullptr.
+     */
+    static std::atomic<AsyncLogger*>& Active() {
+        static std::atomic<AsyncLogger*> active{ nullptr };
+        return active;
+    }
+
+    /**
+     * @brief Returns the log file this logger writes to.
+     */
+    const std::ofstream* file() const { return &logFile_; }
 
-    std::filesystem::path finalPath = outputDirectoryPath / (outputFileName + ".wav");
-    int counter = 1;
+    /**
+     * @brief Queues one message (a blank line if level is nullptr).
+     *
+     * @param timestamp Time the message was logged, as returned by LogTimestamp::Now().
+     * @param level Log level (string literal), or nullptr for a blank separator line.
+     * @param functionName Name of the function where the message originates (string literal).
+     * @param message The log message string.
+     * @param errorCode FMOD_RESULT error code (FMOD_OK if no error).
+     */
+    void Push(int64_t timestamp, const char* level, const char* functionName, const std::string& message, FMOD_RESULT errorCode) {
+        const size_t length = std::min(message.size(), MAX_MESSAGE_SLOTS * SLOT_TEXT_SIZE); // Longer messages are truncated
+        const uint64_t slotCount = std::max<uint64_t>(1, (length + SLOT_TEXT_SIZE - 1) / SLOT_TEXT_SIZE);
 
-    std::string finalPathStr = finalPath.u8string();
+        uint64_t position = enqueuePosition_.load(std::memory_order_relaxed);
+        for (;;) { // Claims slotCount consecutive slots
+            const uint64_t lastPosition = position + slotCount - 1;
+            const uint64_t sequence = slots_[lastPosition & RING_MASK].sequence.load(std::memory_order_acquire);
+            const int64_t difference = static_cast<int64_t>(sequence - lastPosition);
+            if (difference == 0) { // The writer frees slots in order, so all earlier slots of the range are free as well
+                if (enqueuePosition_.compare_exchange_weak(position, position + slotCount, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (difference < 0) { // Ring full
+                if (dropWhenFull_) {
+                    droppedMessages_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                std::this_thread::yield(); // Waits for the writer to free slots
+                position = enqueuePosition_.load(std::memory_order_relaxed);
+            }
+            else { // Another producer claimed the position first
+                position = enqueuePosition_.load(std::memory_order_relaxed);
+            }
+        }
 
-    while (usedFileNames.count(finalPathStr)) {
-        std::string tempFileName = outputFileName + "_" + std::to_string(counter++);
-        finalPath = outputDirectoryPath / (tempFileName + ".wav");
-        finalPathStr = finalPath.u8string();
+        for (uint64_t i = 0; i < slotCount; ++i) {
+            Slot& slot = slots_[(position + i) & RING_MASK];
+            const size_t offset = static_cast<size_t>(i) * SLOT_TEXT_SIZE;
+            slot.timestamp = timestamp;
+            slot.level = level;
+            slot.functionName = functionName;
+            slot.errorCode = errorCode;
+            slot.slotCount = static_cast<uint16_t>(slotCount);
+            slot.textLength = static_cast<uint16_t>(std::min(SLOT_TEXT_SIZE, length - std::min(length, offset)));
+            std::memcpy(slot.text, message.data() + std::min(length, offset), slot.textLength);
+            slot.sequence.store(position + i + 1, std::memory_order_release); // Publishes the slot to the writer
+        }
     }
+private:
+    static constexpr size_t RING_SLOTS = 4096;           // Slots in the ring (power of two)
+    static constexpr uint64_t RING_MASK = RING_SLOTS - 1; // Position to slot index mask
+    static constexpr size_t SLOT_TEXT_SIZE = 208;        // Message bytes per slot (slot size 256 bytes)
+    static constexpr size_t MAX_MESSAGE_SLOTS = 64;      // Slots per message at most (about 13 KB of text)
+    static constexpr size_t WRITE_BLOCK_SIZE = 64 * 1024; // Formatted bytes collected before each write to the log file
 
-    usedFileNames.insert(finalPathStr);
-    return finalPath;
-}
+    /**
+     * @struct Slot
+     * @brief One fixed-size ring entry: the message header and up to SLOT_TEXT_SIZE bytes of its text.
+     */
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence{ 0 }; // Position + 1 when published, position + RING_SLOTS when free again
+        int64_t timestamp = 0;               // Logging time (LogTimestamp::Now())
+        const char* level = nullptr;         // Log level literal, or nullptr for a blank line
+        const char* functionName = nullptr;  // Function name literal
+        FMOD_RESULT errorCode = FMOD_OK;     // FMOD error code
+        uint16_t slotCount = 1;              // Slots used by the whole message
+        uint16_t textLength = 0;             // Message bytes in this slot
+        char text[SLOT_TEXT_SIZE];           // Part of the message text
+    };
 
-/**
- * @brief Prepares the output directory by creating it if it doesn't exist.
- *
- * @param outputDirectory The path to the output directory to prepare.
- */
-void PrepareOutputDirectory(const std::filesystem::path& outputDirectory) {
-    if (!std::filesystem::exists(outputDirectory)) {
-        std::error_code ec;
-        std::filesystem::create_directories(outputDirectory, ec);
-        if (ec) {
-            std::cerr << "Error creating directory: " << outputDirectory.u8string() << " - " << ec.message() << std::endl;
+    /**
+     * @brief Writer thread: drains the ring, formats the lines and writes them in blocks until stopped.
+     */
+    void WriterLoop() {
+        std::string block;   // Formatted lines waiting to be written
+        std::string message; // Message text reassembled from its slots
+        block.reserve(WRITE_BLOCK_SIZE + 16 * 1024);
+        uint64_t reportedDrops = 0;
+        if (binaryEncoder_) {
+            binaryEncoder_->WriteHeader(block);
         }
-        else {
-            std::cout << " Created directory: " << std::filesystem::absolute(outputDirectory).u8string() << std::endl;
+        for (;;) {
+            const bool stopping = stop_.load(std::memory_order_acquire); // Read before draining, so nothing queued before the stop is lost
+            bool drained = false;
+            while (block.size() < WRITE_BLOCK_SIZE) {
+                Slot& first = slots_[dequeuePosition_ & RING_MASK];
+                if (first.sequence.load(std::memory_order_acquire) != dequeuePosition_ + 1) {
+                    drained = true; // Nothing (more) published
+                    break;
+                }
+                const uint64_t slotCount = first.slotCount;
+                if (slots_[(dequeuePosition_ + slotCount - 1) & RING_MASK].sequence.load(std::memory_order_acquire) != dequeuePosition_ + slotCount) {
+                    drained = true; // The producer is still copying the rest of the message
+                    break;
+                }
+                message.clear();
+                for (uint64_t i = 0; i < slotCount; ++i) {
+                    const Slot& slot = slots_[(dequeuePosition_ + i) & RING_MASK];
+                    message.append(slot.text, slot.textLength);
+                }
+                if (!first.level) {
+                    binaryEncoder_ ? binaryEncoder_->WriteSeparator(block) : static_cast<void>(block += '\n');
+                }
+                else if (binaryEncoder_) {
+                    binaryEncoder_->WriteMessage(block, first.timestamp, first.level, first.functionName, message, first.errorCode);
+                }
+                else {
+                    FormatLogLine(block, first.timestamp, first.level, first.functionName, message, first.errorCode);
+                }
+                for (uint64_t i = 0; i < slotCount; ++i) { // Hands the slots back to the producers
+                    slots_[(dequeuePosition_ + i) & RING_MASK].sequence.store(dequeuePosition_ + i + RING_SLOTS, std::memory_order_release);
+                }
+                dequeuePosition_ += slotCount;
+            }
+
+            const uint64_t drops = droppedMessages_.load(std::memory_order_relaxed);
+            if (drops != reportedDrops) {
+                std::string warning = std::to_string(drops - reportedDrops) + " log message(s) dropped (log ring full)";
+                if (binaryEncoder_) {
+                    binaryEncoder_->WriteMessage(block, LogTimestamp::Now(), "WARNING", "AsyncLogger", warning, FMOD_OK);
+                }
+                else {
+                    FormatLogLine(block, LogTimestamp::Now(), "WARNING", "AsyncLogger", warning, FMOD_OK);
+                }
+                reportedDrops = drops;
+            }
+            if (!block.empty()) {
+                logFile_.write(block.data(), static_cast<std::streamsize>(block.size()));
+                block.clear();
+            }
+            if (drained) {
+                logFile_.flush(); // The ring ran empty: make everything logged so far visible
+                if (stopping) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
         }
     }
-}
 
+    std::ofstream& logFile_;                         // Log file (written by the writer thread only)
+    bool dropWhenFull_;                              // Drop messages instead of waiting when the ring is full
+    std::vector<Slot> slots_;                        // The ring
+    alignas(64) std::atomic<uint64_t> enqueuePosition_{ 0 }; // Next position to claim (producers)
+    alignas(64) uint64_t dequeuePosition_ = 0;       // Next position to read (writer thread)
+    std::atomic<uint64_t> droppedMessages_{ 0 };     // Messages dropped because the ring was full
+    std::atomic<bool> stop_{ false };                // Set by the destructor to end the writer thread after draining
+    std::unique_ptr<BinaryLog::Encoder> binaryEncoder_; // Binary log encoder, or nullptr for text lines
+    std::thread writer_;                             // Writer thread
+};
+
+
+#ifndef FSB_EXTRACTOR_LIBRARY
 
 /**
  * @brief Main entry point of the FSB Extractor program.
@@ -415,6 +5778,14 @@ int main(int argc, const char** argv) {
         return 1;       // Return 1 to indicate an error (incorrect usage - missing input file)
     }
 
+    if (std::string(argv[1]) == "-decode-log") { // Subcommand: render a binary log (-log-binary) as text
+        if (argc != 3) {
+            std::cerr << "Error: -decode-log requires exactly one *.binlog file path." << std::endl;
+            return 1;
+        }
+        return BinaryLog::DecodeToText(std::filesystem::u8path(argv[2]), std::cout) ? 0 : 1; // Text goes to standard output
+    }
+
     // Improved argument processing starts
     if (argc == 2) { // If there are exactly two command-line arguments (program name and one argument)
         std::string arg = argv[1]; // Get the first argument (after the program name)
@@ -441,8 +5812,33 @@ int main(int argc, const char** argv) {
     int option_count = 0;                     // Counter to track the number of output directory options used (should be at most one)
     bool help_option_used = false;            // Flag to indicate if the help option (-h or -help) was used
     bool verboseLogEnabled = false;           // Flag to enable or disable verbose logging
+    OutputOptions outputOptions;              // Output settings shared by all sub-sounds (single-pass header patching, archive output)
+    std::filesystem::path archiveFilePath;    // Path of the tar/zip archive to write all WAV files into (empty for individual files)
+    std::filesystem::path shardDirectoryPath; // Directory receiving WebDataset tar shards (empty for no shard output)
+    bool stdoutOutput = false;                // Write the sounds to standard output ("-o -") instead of files
+    uint64_t selectedSound = 0;               // 1-based number of the only sound to extract, counted across all FSBs of the input (0 for all sounds)
+    int exitCode = 0;                         // Process exit code
+    DurabilityMode durabilityMode = DurabilityMode::None; // When extracted files are flushed to disk
+    bool atomicRename = false;                // Write "*.tmp" files and publish them by batched renames
+    uint64_t syncBatchFiles = 256;            // Files per durability batch (0 for no count limit)
+    uint64_t syncBatchMB = 256;               // Megabytes per durability batch (0 for no size limit)
+    uint64_t shardSizeMB = 1024;              // Maximum shard size in megabytes (0 for no size limit)
+    uint64_t shardSampleCount = 0;            // Maximum number of samples per shard (0 for no count limit)
+    std::string shmName;                      // Name of the shared-memory ring receiving the PCM data (empty for no ring output)
+    uint64_t shmSizeMB = 64;                  // Size of the shared-memory ring data area in megabytes
+    std::filesystem::path manifestFilePath;   // Path of the JSON Lines checksum manifest (empty for no manifest)
+    outputOptions.encoderThreads = std::max(1u, std::thread::hardware_concurrency()); // Default FLAC encoding threads: one per hardware thread
     std::ofstream logFile;                    // Output file stream for writing log messages to a file (if verbose logging is enabled)
-    std::vector<std::filesystem::path> tempFilesToDelete; // Vector to store paths of temp files to delete.
+    bool logDropWhenFull = false;             // Drop log messages instead of waiting when the log ring is full
+    bool logBinary = false;                   // Write the compact binary log format instead of text lines
+    std::unique_ptr<AsyncLogger> asyncLogger; // Background writer of the log file (destroyed before logFile)
+    std::filesystem::path traceFilePath;      // Path of the Trace Event JSON file (empty for no trace)
+    std::filesystem::path summaryFilePath;    // Path of the JSON end-of-run summary (empty to only print it)
+    std::filesystem::path metricsFilePath;    // Path of the Prometheus textfile-collector file (empty for no metrics export)
+    uint64_t metricsIntervalSeconds = 15;     // Seconds between two metrics exports
+    bool perfCountersEnabled = false;         // Count cycles, instructions and misses per phase (Linux only)
+    std::unique_ptr<Metrics::TextfileExporter> metricsExporter; // Writes the metrics file periodically, last values written when it goes out of scope
+    std::unique_ptr<TraceEvents::Session> traceSession; // Records the extraction phases, trace file written when it goes out of scope
 
     try { // Begin of try block to catch exceptions that might occur during program execution
         FMODSystem fmodSystem; // Create an instance of FMODSystem class, which initializes the FMOD engine
@@ -469,7 +5865,12 @@ int main(int argc, const char** argv) {
                 option_count++; // Increment the output directory option counter
             }
             else if (arg == "-o") { // Check if the argument is "-o" (output to user-specified directory option)
-                if (i + 1 < argc) { // Check if there is another argument following "-o" (which should be the output directory path)
+                if (i + 1 < argc && std::string(argv[i + 1]) == "-") { // "-o -" writes to standard output instead of a directory
+                    stdoutOutput = true;
+                    ++i; // Skip the "-" argument (the default output directory is kept for the -v log file)
+                    option_count++; // Increment the output directory option counter
+                }
+                else if (i + 1 < argc) { // Check if there is another argument following "-o" (which should be the output directory path)
                     outputDirectoryPath = std::filesystem::u8path(argv[++i]); // Get the next argument as the output directory path and convert it to a filesystem path, handling UTF-8 encoding. Increment 'i' to move to the next argument in the next iteration (skipping the directory path argument in the loop).
                     option_count++; // Increment the output directory option counter
                 }
@@ -481,6 +5882,187 @@ int main(int argc, const char** argv) {
             else if (arg == "-v") { // Check if the argument is "-v" (verbose logging option)
                 verboseLogEnabled = true; // Enable verbose logging
             }
+            else if (arg == "-log-drop") { // Check if the argument is "-log-drop" (log ring overflow option)
+                logDropWhenFull = true; // Drop log messages when the writer thread falls behind
+            }
+            else if (arg == "-log-relative") { // Check if the argument is "-log-relative" (log timestamp option)
+                LogTimestamp::UseRelativeTime(); // Log seconds since start from the monotonic clock
+            }
+            else if (arg == "-log-binary") { // Check if the argument is "-log-binary" (log format option)
+                logBinary = true; // Write "_<name>.binlog", rendered as text by "-decode-log"
+            }
+            else if (arg == "-single-pass") { // Check if the argument is "-single-pass" (placeholder header option)
+                outputOptions.singlePassEnabled = true; // Enable single-pass output with header patching
+            }
+            else if (arg == "-archive") { // Check if the argument is "-archive" (single archive output option)
+                if (i + 1 < argc) { // Check if there is another argument following "-archive" (which should be the archive file path)
+                    archiveFilePath = std::filesystem::u8path(argv[++i]); // Get the next argument as the archive file path
+                }
+                else { // If "-archive" is used but no archive file path is provided
+                    std::cerr << " Error: -archive option requires an archive file path (*.tar or *.zip)." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (missing archive path for -archive option)
+                }
+            }
+            else if (arg == "-perf-counters") { // Check if the argument is "-perf-counters" (hardware counter option)
+#ifdef __linux__
+                perfCountersEnabled = true; // Read perf_event_open counter groups at the phase boundaries
+#else
+                std::cerr << " Error: -perf-counters is only available on Linux." << std::endl; // Display error message
+                return 1;       // Return 1 to indicate an error (unsupported option)
+#endif
+            }
+            else if (arg == "-metrics-file") { // Check if the argument is "-metrics-file" (live metrics option)
+                if (i + 1 < argc) { // Check if there is another argument following "-metrics-file" (which should be the metrics file path)
+                    metricsFilePath = std::filesystem::u8path(argv[++i]); // Get the next argument as the metrics file path
+                }
+                else { // If "-metrics-file" is used but no metrics file path is provided
+                    std::cerr << " Error: -metrics-file option requires a metrics file path (*.prom)." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (missing metrics path for -metrics-file option)
+                }
+            }
+            else if (arg == "-metrics-interval") { // Check if the argument is "-metrics-interval" (metrics export period option)
+                if (i + 1 < argc && ParseUnsignedArgument(argv[i + 1], metricsIntervalSeconds) && metricsIntervalSeconds >= 1) {
+                    ++i; // Skip the value argument
+                }
+                else { // If the value is missing or zero
+                    std::cerr << " Error: -metrics-interval option requires a positive number of seconds." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid metrics interval)
+                }
+            }
+            else if (arg == "-summary-json") { // Check if the argument is "-summary-json" (summary report option)
+                if (i + 1 < argc) { // Check if there is another argument following "-summary-json" (which should be the summary file path)
+                    summaryFilePath = std::filesystem::u8path(argv[++i]); // Get the next argument as the summary file path
+                }
+                else { // If "-summary-json" is used but no summary file path is provided
+                    std::cerr << " Error: -summary-json option requires a summary file path (*.json)." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (missing summary path for -summary-json option)
+                }
+            }
+            else if (arg == "-trace") { // Check if the argument is "-trace" (phase timeline option)
+                if (i + 1 < argc) { // Check if there is another argument following "-trace" (which should be the trace file path)
+                    traceFilePath = std::filesystem::u8path(argv[++i]); // Get the next argument as the trace file path
+                }
+                else { // If "-trace" is used but no trace file path is provided
+                    std::cerr << " Error: -trace option requires a trace file path (*.json)." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (missing trace path for -trace option)
+                }
+            }
+            else if (arg == "-manifest") { // Check if the argument is "-manifest" (checksum manifest option)
+                if (i + 1 < argc) { // Check if there is another argument following "-manifest" (which should be the manifest file path)
+                    manifestFilePath = std::filesystem::u8path(argv[++i]); // Get the next argument as the manifest file path
+                }
+                else { // If "-manifest" is used but no manifest file path is provided
+                    std::cerr << " Error: -manifest option requires a manifest file path (*.jsonl)." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (missing manifest path for -manifest option)
+                }
+            }
+            else if (arg == "-format") { // Check if the argument is "-format" (output file format option)
+                std::string format = (i + 1 < argc) ? argv[i + 1] : "";
+                static const std::unordered_map<std::string, OutputFormat> formats = {
+                    { "wav", OutputFormat::Wav }, { "flac", OutputFormat::Flac }, { "npy", OutputFormat::Npy }, { "f32", OutputFormat::F32 }, { "pcm", OutputFormat::Pcm }
+                };
+                auto it = formats.find(format);
+                if (it != formats.end()) {
+                    outputOptions.outputFormat = it->second;
+                    ++i; // Skip the format argument
+                }
+                else { // If the format is missing or unknown
+                    std::cerr << " Error: -format option requires 'wav', 'flac', 'npy', 'f32' or 'pcm'." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid output format)
+                }
+            }
+            else if (arg == "-sound") { // Check if the argument is "-sound" (single sound selection option)
+                if (i + 1 < argc && ParseUnsignedArgument(argv[i + 1], selectedSound) && selectedSound >= 1) {
+                    ++i; // Skip the value argument
+                }
+                else { // If the value is missing or not a positive number
+                    std::cerr << " Error: -sound option requires a sound number (1 for the first sound)." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid sound number)
+                }
+            }
+            else if (arg == "-durability") { // Check if the argument is "-durability" (flush policy option)
+                static const std::unordered_map<std::string, DurabilityMode> modes = {
+                    { "none", DurabilityMode::None }, { "file", DurabilityMode::PerFile }, { "batch", DurabilityMode::Batch }
+                };
+                auto it = (i + 1 < argc) ? modes.find(argv[i + 1]) : modes.end();
+                if (it != modes.end()) {
+                    durabilityMode = it->second;
+                    ++i; // Skip the mode argument
+                }
+                else { // If the mode is missing or unknown
+                    std::cerr << " Error: -durability option requires 'none', 'file' or 'batch'." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid durability mode)
+                }
+            }
+            else if (arg == "-atomic") { // Check if the argument is "-atomic" (write-to-temp-then-rename option)
+                atomicRename = true; // Publish files by batched renames
+            }
+            else if (arg == "-sync-files" || arg == "-sync-mb") { // Check if the argument sets a durability batch limit
+                uint64_t value = 0;
+                if (i + 1 < argc && ParseUnsignedArgument(argv[i + 1], value)) { // The limit must be a non-negative integer
+                    (arg == "-sync-files" ? syncBatchFiles : syncBatchMB) = value;
+                    ++i; // Skip the value argument
+                }
+                else { // If the value is missing or not a number
+                    std::cerr << " Error: " << arg << " option requires a non-negative integer value." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid batch limit)
+                }
+            }
+            else if (arg == "-planar") { // Check if the argument is "-planar" (channel-major float32 layout option)
+                outputOptions.planarLayout = true; // Write all samples of a channel contiguously
+            }
+            else if (arg == "-peaks") { // Check if the argument is "-peaks" (waveform peak sidecar option)
+                outputOptions.peaksEnabled = true; // Write a "*.peaks" file next to every output file
+            }
+            else if (arg == "-threads") { // Check if the argument is "-threads" (encoding thread count option)
+                uint64_t threads = 0;
+                if (i + 1 < argc && ParseUnsignedArgument(argv[i + 1], threads) && threads >= 1 && threads <= 256) {
+                    outputOptions.encoderThreads = static_cast<unsigned int>(threads);
+                    ++i; // Skip the value argument
+                }
+                else { // If the value is missing or out of range
+                    std::cerr << " Error: -threads option requires a thread count between 1 and 256." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid thread count)
+                }
+            }
+            else if (arg == "-shards") { // Check if the argument is "-shards" (WebDataset shard output option)
+                if (i + 1 < argc) { // Check if there is another argument following "-shards" (which should be the shard directory)
+                    shardDirectoryPath = std::filesystem::u8path(argv[++i]); // Get the next argument as the shard directory
+                }
+                else { // If "-shards" is used but no directory is provided
+                    std::cerr << " Error: -shards option requires a shard directory path." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (missing directory for -shards option)
+                }
+            }
+            else if (arg == "-shard-size" || arg == "-shard-count") { // Check if the argument sets a shard rollover limit
+                uint64_t value = 0;
+                if (i + 1 < argc && ParseUnsignedArgument(argv[i + 1], value)) { // The limit must be a non-negative integer
+                    (arg == "-shard-size" ? shardSizeMB : shardSampleCount) = value;
+                    ++i; // Skip the value argument
+                }
+                else { // If the value is missing or not a number
+                    std::cerr << " Error: " << arg << " option requires a non-negative integer value." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid shard limit)
+                }
+            }
+            else if (arg == "-shm") { // Check if the argument is "-shm" (shared-memory ring output option)
+                if (i + 1 < argc && argv[i + 1][0] != '\0' && std::strchr(argv[i + 1], '/') == nullptr) { // POSIX object names are a single path component
+                    shmName = argv[++i]; // Get the next argument as the shared-memory object name
+                }
+                else { // If "-shm" is used but no valid name is provided
+                    std::cerr << " Error: -shm option requires a shared-memory object name (without '/')." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (missing name for -shm option)
+                }
+            }
+            else if (arg == "-shm-mb") { // Check if the argument is "-shm-mb" (shared-memory ring size option)
+                if (i + 1 < argc && ParseUnsignedArgument(argv[i + 1], shmSizeMB) && shmSizeMB >= 1 && shmSizeMB <= 4096) {
+                    ++i; // Skip the value argument
+                }
+                else { // If the value is missing or out of range
+                    std::cerr << " Error: -shm-mb option requires a ring size between 1 and 4096 megabytes." << std::endl; // Display error message
+                    return 1;       // Return 1 to indicate an error (invalid ring size)
+                }
+            }
             else if (arg == "-h" || arg == "-help") { // Check if the argument is "-h" or "-help" (help option)
                 help_option_used = true; // Set the help option used flag to true
             }
@@ -494,7 +6076,43 @@ int main(int argc, const char** argv) {
         if (option_count > 1 && !help_option_used) { // Check if more than one output directory option was used and help option was not used
             std::cerr << " Error: Only one output directory option (-res, -exe, -o <output_directory>) can be used." << std::endl; // Display error message for using multiple output directory options
             Usage_Simple(); // Display simple usage instructions
-            return 1;       // Return 1 to indicate an error (multiple output directory options used)
+            return 1;       // Return 1 to indicate an error (multiple output directory options used)
+        }
+
+        if (!archiveFilePath.empty() && !shardDirectoryPath.empty()) { // Archive and shard output both replace individual files and cannot be combined
+            std::cerr << " Error: -archive and -shards options cannot be used together." << std::endl; // Display error message
+            Usage_Simple(); // Display simple usage instructions
+            return 1;       // Return 1 to indicate an error (conflicting output modes)
+        }
+        if (stdoutOutput && (!archiveFilePath.empty() || !shardDirectoryPath.empty())) { // Standard output replaces the archive or shard files
+            std::cerr << " Error: -o - cannot be used with -archive or -shards." << std::endl; // Display error message
+            Usage_Simple(); // Display simple usage instructions
+            return 1;       // Return 1 to indicate an error (conflicting output modes)
+        }
+        if (stdoutOutput && selectedSound > 0 && outputOptions.outputFormat == OutputFormat::Npy) { // The NPY header needs the final shape, which a pipe cannot patch
+            std::cerr << " Error: -format npy cannot be streamed with -o - and -sound (omit -sound for framed output, or use -format f32)." << std::endl; // Display error message
+            Usage_Simple(); // Display simple usage instructions
+            return 1;       // Return 1 to indicate an error (unsupported stream format)
+        }
+        if (!shmName.empty() && (stdoutOutput || !archiveFilePath.empty() || !shardDirectoryPath.empty())) { // The ring replaces every other output
+            std::cerr << " Error: -shm cannot be used with -o -, -archive or -shards." << std::endl; // Display error message
+            Usage_Simple(); // Display simple usage instructions
+            return 1;       // Return 1 to indicate an error (conflicting output modes)
+        }
+        if (!shmName.empty() && outputOptions.outputFormat != OutputFormat::Wav && outputOptions.outputFormat != OutputFormat::Pcm) { // The ring carries the decoded PCM data
+            std::cerr << " Error: -shm publishes raw PCM data and cannot be used with -format flac, npy or f32." << std::endl; // Display error message
+            Usage_Simple(); // Display simple usage instructions
+            return 1;       // Return 1 to indicate an error (unsupported ring format)
+        }
+        if (outputOptions.outputFormat == OutputFormat::F32 && (!archiveFilePath.empty() || !shardDirectoryPath.empty())) { // The blob already collects every sound in one file
+            std::cerr << " Error: -format f32 cannot be used with -archive or -shards (use -format npy instead)." << std::endl; // Display error message
+            Usage_Simple(); // Display simple usage instructions
+            return 1;       // Return 1 to indicate an error (conflicting output modes)
+        }
+        if (outputOptions.peaksEnabled && (stdoutOutput || !shardDirectoryPath.empty() || !shmName.empty() || outputOptions.outputFormat == OutputFormat::F32)) { // Peak sidecars need individual files or archive entries
+            std::cerr << " Error: -peaks cannot be used with -o -, -shards, -shm or -format f32." << std::endl; // Display error message
+            Usage_Simple(); // Display simple usage instructions
+            return 1;       // Return 1 to indicate an error (conflicting output modes)
         }
 
         if (help_option_used) { // If the help option was used
@@ -509,82 +6127,263 @@ int main(int argc, const char** argv) {
             }
         }
 
-        std::vector<std::filesystem::path> filesToProcess; // Vector to store paths of files to be processed (FSB or extracted FSBs from BANK)
+        if (stdoutOutput) { // Before anything is printed: the setup messages below and the bank scan must not reach the audio stream
+            std::cout.rdbuf(std::cerr.rdbuf()); // Keeps progress messages out of the audio stream
+        }
+
+        if (!traceFilePath.empty()) { // Starts recording before the bank scan, the first traced phase
+            traceSession = std::make_unique<TraceEvents::Session>(traceFilePath);
+        }
+        if (perfCountersEnabled && !PerfCounters::Enable()) { // Extraction goes on without counters
+            std::cerr << " Warning: hardware counters unavailable (perf_event_open failed, see /proc/sys/kernel/perf_event_paranoid)." << std::endl;
+            perfCountersEnabled = false;
+        }
+        if (!metricsFilePath.empty()) { // Exports the live metrics until the end of the run
+            metricsExporter = std::make_unique<Metrics::TextfileExporter>(metricsFilePath, metricsIntervalSeconds);
+            std::cout << " Metrics file path: " << std::filesystem::absolute(metricsFilePath).u8string() << " (every " << metricsIntervalSeconds << " s)" << std::endl;
+        }
+
+        RunSummary runSummary(Constants::SUMMARY_SLOWEST_SOUNDS); // Throughput figures, printed at the end
+        outputOptions.runSummary = &runSummary;
+
         std::string inputFilePathLower = inputFilePath.string(); // Convert input file path to lowercase string for extension check
         std::transform(inputFilePathLower.begin(), inputFilePathLower.end(), inputFilePathLower.begin(), [](unsigned char c) { return std::tolower(c); });
+        const bool bankInput = inputFilePathLower.length() >= 5 && inputFilePathLower.substr(inputFilePathLower.length() - 5) == ".bank";
 
-        if (inputFilePathLower.length() >= 5 && inputFilePathLower.substr(inputFilePathLower.length() - 5) == ".bank") { // If the input file is a BANK file
-            filesToProcess = BANKtoFSBExtractor::ExtractFSBsFromBankFile(inputFilePath); // Extract embedded FSB files from the BANK file
-            if (filesToProcess.empty()) { // If no FSB files were found inside the BANK file
+        std::vector<BANKtoFSBExtractor::EmbeddedFSB> embeddedFsbs; // FSBs to process, opened in place (a stand-alone FSB spans the whole input file)
+        if (bankInput) { // If the input file is a BANK file
+            std::string bankError;
+            embeddedFsbs = BANKtoFSBExtractor::FindFSBsInBankFile(inputFilePath, &bankError); // Locates the embedded FSB files, nothing is copied
+            if (!bankError.empty()) { // The FSBs found before the error are still extracted
+                std::cerr << " Error: " << bankError << std::endl;
+                exitCode = 1;
+            }
+            if (embeddedFsbs.empty()) { // If no FSB files were found inside the BANK file
                 std::cout << "No FSB files found inside bank file: " << inputFilePath.u8string() << std::endl; // Output message to console
-                return 0; // Exit gracefully if no FSBs are found in the bank.
+                return exitCode; // Exit gracefully if no FSBs are found in the bank.
             }
-            // Add extracted temp files to the deletion list.
-            tempFilesToDelete.insert(tempFilesToDelete.end(), filesToProcess.begin(), filesToProcess.end());
-
         }
         else { // If the input file is an FSB file
-            filesToProcess.push_back(inputFilePath); // Add the input FSB file path to the processing list
+            embeddedFsbs.push_back({ 0, 0 });
         }
 
         // Added from C# version to track used filenames
-        std::unordered_set<std::string> usedFileNames;
+        OutputFileNames usedFileNames;
+        uint64_t soundNumber = 0; // 1-based number of the current sub-sound across all FSBs, matched against -sound
+
+        std::unique_ptr<OutputDurability> durability; // Flush and rename policy, last batch published when it goes out of scope
+        if (durabilityMode != DurabilityMode::None || atomicRename) {
+            durability = std::make_unique<OutputDurability>(durabilityMode, atomicRename, syncBatchFiles, syncBatchMB * 1024 * 1024);
+            outputOptions.durability = durability.get();
+        }
+
+        std::unique_ptr<ArchiveSink> archiveSink; // Archive output, discarded if it goes out of scope before Finish()
+        if (!archiveFilePath.empty()) {
+            archiveSink = std::make_unique<ArchiveSink>(archiveFilePath, durability.get()); // Creates the archive file under its temporary name (throws on failure)
+            outputOptions.archiveSink = archiveSink.get();
+            std::cout << " Archive file path: " << std::filesystem::absolute(archiveFilePath).u8string() << std::endl; // Display archive file path in console
+        }
 
-        for (const auto& currentInputFilePath : filesToProcess) { // Loop through each file to process (could be original FSB or extracted FSB from BANK)
-            FMODSound soundWrapper(fmodSystem.get(), currentInputFilePath.string()); // Create FMODSound object to load the FSB file, using RAII for resource management
-            FMOD::Sound* sound = soundWrapper.get(); // Get the raw FMOD::Sound pointer from the wrapper
+        std::unique_ptr<ShardSink> shardSink; // Shard output, last shard finalized when it goes out of scope
+        if (!shardDirectoryPath.empty()) {
+            shardSink = std::make_unique<ShardSink>(shardDirectoryPath, inputFilePath.stem().u8string(), shardSizeMB * 1024 * 1024, shardSampleCount, durability.get());
+            outputOptions.shardSink = shardSink.get();
+            outputOptions.sourceFileName = inputFilePath.filename().u8string();
+            std::cout << " Shard directory path: " << std::filesystem::absolute(shardDirectoryPath).u8string() << std::endl; // Display shard directory in console
+        }
+
+        std::unique_ptr<PipeSink> pipeSink; // Standard output, flushed at the end
+        if (stdoutOutput) {
+            pipeSink = std::make_unique<PipeSink>(selectedSound == 0); // Several sounds need frames to be told apart
+            outputOptions.pipeSink = pipeSink.get();
+            outputOptions.sourceFileName = inputFilePath.filename().u8string(); // "source_file" of the frame metadata
+            std::cout << " Output: standard output (" << (pipeSink->framed() ? "framed sounds" : "single sound") << ")" << std::endl;
+        }
+
+        std::unique_ptr<SharedMemoryRingSink> ringSink; // Shared-memory ring, marked as finished when it goes out of scope
+        if (!shmName.empty()) {
+            ringSink = std::make_unique<SharedMemoryRingSink>(shmName, static_cast<size_t>(shmSizeMB) * 1024 * 1024); // Creates and maps the object (throws on failure)
+            outputOptions.ringSink = ringSink.get();
+            outputOptions.outputFormat = OutputFormat::Pcm; // Records carry the PCM data without a file header
+            std::cout << " Output: shared memory " << ringSink->name() << " (" << shmSizeMB << " MB ring)" << std::endl;
+        }
+
+        std::unique_ptr<TensorBlobSink> tensorBlobSink; // Float32 blob output, closed when it goes out of scope
+        if (outputOptions.outputFormat == OutputFormat::F32 && !stdoutOutput) { // On standard output the float32 samples are streamed instead
+            std::string blobBaseName = inputFilePath.stem().string();
+            PrepareOutputDirectory(outputDirectoryPath / blobBaseName); // The blob lives in the usual per-input output folder
+            tensorBlobSink = std::make_unique<TensorBlobSink>(outputDirectoryPath / blobBaseName / (blobBaseName + ".f32")); // Creates the blob and index files (throws on failure)
+            outputOptions.tensorBlobSink = tensorBlobSink.get();
+            std::cout << " Tensor blob path: " << std::filesystem::absolute(tensorBlobSink->path()).u8string() << std::endl; // Display blob file path in console
+        }
+
+        std::unique_ptr<FlacEncoderPool> flacEncoderPool; // FLAC encoding threads, kept for the whole run
+        if (outputOptions.outputFormat == OutputFormat::Flac) {
+            flacEncoderPool = std::make_unique<FlacEncoderPool>(outputOptions.encoderThreads);
+            outputOptions.flacEncoderPool = flacEncoderPool.get();
+        }
+
+        std::unique_ptr<ManifestSink> manifestSink; // Checksum manifest, closed at the end
+        if (!manifestFilePath.empty()) {
+            manifestSink = std::make_unique<ManifestSink>(manifestFilePath); // Creates the manifest file (throws on failure)
+            outputOptions.manifestSink = manifestSink.get();
+            outputOptions.sourceFileName = inputFilePath.filename().u8string();
+            std::cout << " Manifest file path: " << std::filesystem::absolute(manifestFilePath).u8string() << std::endl; // Display manifest file path in console
+        }
+
+        for (size_t fileIndex = 0; fileIndex < embeddedFsbs.size(); ++fileIndex) { // Loop through each FSB to process (the input FSB, or the FSBs embedded in the BANK)
+            const BANKtoFSBExtractor::EmbeddedFSB& embeddedFsb = embeddedFsbs[fileIndex];
+            Metrics::Global().filesQueued.Set(static_cast<int64_t>(embeddedFsbs.size() - fileIndex));
+            std::string fsbFileName = inputFilePath.filename().u8string(); // Name shown and recorded as "container_file", e.g. "music_2.fsb" for the second FSB of "music.bank"
+            if (bankInput) {
+                fsbFileName = inputFilePath.stem().u8string() + (fileIndex > 0 ? "_" + std::to_string(fileIndex + 1) : std::string()) + ".fsb";
+            }
+            std::unique_ptr<FMODSound> soundWrapper = bankInput // Create FMODSound object to load the FSB file, using RAII for resource management
+                ? std::make_unique<FMODSound>(fmodSystem.get(), inputFilePath.string(), embeddedFsb.offset, embeddedFsb.size) // FMOD reads the FSB in place inside the BANK file
+                : std::make_unique<FMODSound>(fmodSystem.get(), inputFilePath.string());
+            FMOD::Sound* sound = soundWrapper->get(); // Get the raw FMOD::Sound pointer from the wrapper
 
             int numSubSounds = 0;
             CheckFMODResult(sound->getNumSubSounds(&numSubSounds), "FMOD::Sound::getNumSubSounds failed"); // Get the number of sub-sounds within the loaded FSB file
 
             if (numSubSounds > 0) { // If the FSB file contains one or more sub-sounds
-                std::cout << std::endl << " ===== '" << currentInputFilePath.filename().u8string() << "' Processing Start =====" << std::endl << std::endl; // Display processing start message in console
+                std::cout << std::endl << " ===== '" << fsbFileName << "' Processing Start =====" << std::endl << std::endl; // Display processing start message in console
 
                 // Use original input file name for base folder and log name
                 std::string baseFileName = inputFilePath.stem().string();
                 std::filesystem::path outputDirectory = outputDirectoryPath / baseFileName;
                 std::filesystem::path logFilePath;     // Filesystem path for the log file
 
-                // Using PrepareOutputDirectory helper now
-                PrepareOutputDirectory(outputDirectory);
+                // Using PrepareOutputDirectory helper now (in archive mode the folder is only needed for the log file)
+                const bool fileOutput = !outputOptions.archiveSink && !outputOptions.shardSink && !outputOptions.tensorBlobSink && !outputOptions.pipeSink && !outputOptions.ringSink;
+                if (fileOutput || verboseLogEnabled) {
+                    PrepareOutputDirectory(outputDirectory);
+                }
+
+                usedFileNames.Reserve(static_cast<size_t>(numSubSounds)); // One name per sub-sound, no rehashing during planning
+                const bool sampleKeyNames = outputOptions.shardSink || (outputOptions.pipeSink && outputOptions.pipeSink->framed()); // File names become WebDataset keys
+                OutputPlan outputPlan = PlanOutputPaths(sound, numSubSounds, baseFileName, outputDirectory, usedFileNames, outputOptions.outputFormat, sampleKeyNames); // Every output path, fixed before extraction
+                if (fileOutput) { // Creates the whole output tree (one folder per language) before extraction starts
+                    for (size_t languageId = 1; languageId < outputPlan.languageFolders.size(); ++languageId) {
+                        PrepareOutputDirectory(outputPlan.languageFolders[languageId]);
+                    }
+                }
+                outputOptions.outputPlan = &outputPlan; // Language of each sub-sound, for the shard and manifest metadata
 
                 if (verboseLogEnabled && !logFile.is_open()) { // If verbose logging is enabled and log file is not yet open
-                    logFilePath = outputDirectory / ("_" + baseFileName + ".log");
-                    logFile.open(logFilePath, std::ios::trunc); // Open log file in truncate mode (overwrite existing)
+                    logFilePath = outputDirectory / ("_" + baseFileName + (logBinary ? ".binlog" : ".log"));
+                    logFile.open(logFilePath, logBinary ? std::ios::trunc | std::ios::binary : std::ios::trunc); // Open log file in truncate mode (overwrite existing)
                     if (!logFile.is_open()) { // Check if log file opening failed
                         std::cerr << "Error creating log file: " << logFilePath.u8string() << std::endl; // Display error message if log file creation fails
                         verboseLogEnabled = false; // Disable verbose logging if log file can't be opened
                     }
                     else { // If log file opened successfully
+                        asyncLogger = std::make_unique<AsyncLogger>(logFile, logDropWhenFull, logBinary); // Log lines are written by a background thread from now on
                         std::cout << " Log file path: " << std::filesystem::absolute(logFilePath).u8string() << std::endl; // Display log file path in console
-                        WriteLogMessage(logFile, "INFO", "main", "Log file opened: " + std::filesystem::absolute(logFilePath).u8string(), verboseLogEnabled, FMOD_OK); // Log message for log file opened
+                        LOG_MESSAGE(logFile, "INFO", "main", "Log file opened: " + std::filesystem::absolute(logFilePath).u8string(), verboseLogEnabled, FMOD_OK); // Log message for log file opened
                     }
                 }
 
-                WriteLogMessage(logFile, "INFO", "main", "Processing file: " + std::filesystem::absolute(currentInputFilePath).u8string(), verboseLogEnabled, FMOD_OK);
+                LOG_MESSAGE(logFile, "INFO", "main", "Processing file: " + std::filesystem::absolute(inputFilePath).u8string() + (bankInput ? " (" + fsbFileName + " at offset " + std::to_string(embeddedFsb.offset) + ")" : std::string()), verboseLogEnabled, FMOD_OK);
+                outputOptions.containerFileName = fsbFileName; // Provenance for shard metadata
+                if (outputOptions.manifestSink) { // Provenance for the manifest: where this FSB and its sub-sounds' data are in the input file
+                    outputOptions.containerOffset = embeddedFsb.offset;
+                    outputOptions.sampleDataOffsets = BANKtoFSBExtractor::ReadFSB5SampleDataOffsets(inputFilePath, embeddedFsb.offset);
+                }
 
                 for (int i = 0; i < numSubSounds; ++i) { // Loop through each sub-sound in the FSB file
+                    Metrics::Global().soundsQueued.Set(numSubSounds - i);
+                    if (selectedSound > 0 && ++soundNumber != selectedSound) { // Only the selected sound is extracted
+                        continue;
+                    }
                     FMOD::Sound* subSound = nullptr; // Pointer to hold the sub-sound object
-                    FMOD_RESULT result = sound->getSubSound(i, &subSound); // Get the i-th sub-sound from the FSB file
+                    FMOD_RESULT result;
+                    {
+                        TraceEvents::Scope getSubSoundScope("getSubSound", i);
+                        result = sound->getSubSound(i, &subSound); // Get the i-th sub-sound from the FSB file
+                    }
                     if (result != FMOD_OK) { // Check if getting sub-sound failed
                         std::cerr << " FMOD::Sound::getSubSound failed for sub-sound " << i << ": " << FMOD_ErrorString(result) << std::endl; // Display error message if getting sub-sound fails
+                        Metrics::CountFMODError(result);
+                        runSummary.AddFailure();
+                        Metrics::Global().soundsFailed.Add(1);
                         continue; // Skip to the next sub-sound if this one failed
                     }
                     try {
-                        // Pass usedFileNames to ProcessSubSound
-                        ProcessSubSound(fmodSystem.get(), subSound, i, numSubSounds, baseFileName, outputDirectory, verboseLogEnabled, std::ref(logFile), usedFileNames); // Process the sub-sound (extract to WAV)
+                        TraceEvents::Scope subSoundScope("sub-sound", i); // Encloses the phases of this sub-sound
+                        if (subSoundScope.active()) {
+                            subSoundScope.SetLabel(outputPlan.outputPaths[i].filename().u8string());
+                        }
+                        // Pass the planned output path to ProcessSubSound
+                        ProcessSubSound(fmodSystem.get(), subSound, i, numSubSounds, outputDirectory, verboseLogEnabled, std::ref(logFile), outputPlan.outputPaths[i], outputOptions); // Process the sub-sound (extract to WAV)
                     }
                     catch (const std::exception& ex) {
                         std::cerr << " Exception caught while processing sub-sound " << i << ": " << ex.what() << std::endl;
+                        runSummary.AddFailure();
+                        Metrics::Global().soundsFailed.Add(1);
                     }
                     if (subSound) subSound->release(); // Release the sub-sound object after processing
                 }
+                outputOptions.outputPlan = nullptr; // The plan goes out of scope with this FSB
             }
             else { // If no sub-sounds are found in the FSB file
                 std::cout << " No sub-sounds found in the audio file." << std::endl; // Display message if no sub-sounds found
             }
-        } // End of filesToProcess loop.
+        } // End of embeddedFsbs loop.
+        Metrics::Global().filesQueued.Set(0);
+        Metrics::Global().soundsQueued.Set(0);
 
+        if (archiveSink) { // Writes the archive trailer once every sub-sound has been added, flushes it (durability policy) and publishes it
+            archiveSink->Finish();
+            std::cout << std::endl << " Archive written: " << std::filesystem::absolute(archiveSink->path()).u8string() << std::endl;
+        }
+        if (selectedSound > soundNumber) { // The selected sound does not exist
+            std::cerr << " Error: -sound " << selectedSound << " is out of range (the input contains " << soundNumber << " sounds)." << std::endl;
+            exitCode = 1;
+        }
+        if (pipeSink && !pipeSink->Finish()) { // Hands the last buffered block to standard output
+            throw std::runtime_error("Failed to write to standard output");
+        }
+        if (tensorBlobSink) { // Flushes the blob and its index
+            if (!tensorBlobSink->Finish()) {
+                throw std::runtime_error("Failed to write tensor blob: " + tensorBlobSink->path().u8string());
+            }
+            if (durability) {
+                durability->SyncFile(tensorBlobSink->path());
+                durability->SyncFile(tensorBlobSink->indexPath());
+            }
+            std::cout << std::endl << " Tensor blob written: " << std::filesystem::absolute(tensorBlobSink->path()).u8string() << " (index: " << tensorBlobSink->indexPath().filename().u8string() << ")" << std::endl;
+        }
+        if (manifestSink) { // Flushes the manifest
+            if (!manifestSink->Finish()) {
+                throw std::runtime_error("Failed to write manifest file: " + manifestSink->path().u8string());
+            }
+            if (durability) {
+                durability->SyncFile(manifestSink->path());
+            }
+            std::cout << std::endl << " Manifest written: " << std::filesystem::absolute(manifestSink->path()).u8string() << std::endl;
+        }
+        if (shardSink) { // Finalizes and publishes the last shard
+            shardSink->Finish();
+            std::cout << std::endl << " Shards written: " << shardSink->completedShards() << " in " << std::filesystem::absolute(shardSink->directory()).u8string() << std::endl;
+        }
+        if (durability) { // Flushes and publishes the last batch of files
+            durability->Finish();
+            std::cout << std::endl << " Durability: " << durability->syncCalls() << " flush call(s)" << (atomicRename ? ", files published by rename" : "") << std::endl;
+        }
+        runSummary.Print(std::cout); // Totals and per-codec throughput, slowest sounds
+        if (perfCountersEnabled) {
+            PerfCounters::Print(std::cout, Metrics::Global().bytesDecoded.Value());
+        }
+#ifdef FSB_EXTRACTOR_COUNT_ALLOCATIONS
+        PerfCounters::PrintAllocations(std::cout, Metrics::Global().soundsDone.Value(), Metrics::Global().bytesDecoded.Value()); // Always reported in this build
+#endif
+        if (!summaryFilePath.empty()) {
+            if (!runSummary.WriteJson(summaryFilePath)) {
+                throw std::runtime_error("Failed to write summary file: " + summaryFilePath.u8string());
+            }
+            std::cout << std::endl << " Summary written: " << std::filesystem::absolute(summaryFilePath).u8string() << std::endl;
+        }
     }
     catch (const std::exception& e) { // Catch any standard exceptions during program execution
         std::cerr << "\n\n\n";
@@ -597,27 +6396,16 @@ int main(int argc, const char** argv) {
     }
 
     if (logFile.is_open()) { // If the log file is open (verbose logging was enabled)
-        logFile << std::endl; // Add a newline at the end of the log file for better formatting
-        WriteLogMessage(logFile, "INFO", "main", "Processing finished for Input file: " + inputFilePath.filename().u8string(), verboseLogEnabled, FMOD_OK); // Write log message indicating processing finished
+        WriteLogSeparator(logFile, verboseLogEnabled); // Add an empty line at the end of the log file for better formatting
+        LOG_MESSAGE(logFile, "INFO", "main", "Processing finished for Input file: " + inputFilePath.filename().u8string(), verboseLogEnabled, FMOD_OK); // Write log message indicating processing finished
+        asyncLogger.reset(); // Writes the queued messages before the file is closed
         logFile.close(); // Close the log file
     }
     std::cout << std::endl << " ===== '" << inputFilePath.filename().u8string() << "' Processing End =====" << std::endl << std::endl; // Display program processing end message in console
 
-
-    // Delete temporary files after printing the final message.
-    for (const auto& tempFile : tempFilesToDelete) {
-        if (std::filesystem::exists(tempFile)) { // Double-check existence.
-            try {
-                std::filesystem::remove(tempFile);
-            }
-            catch (const std::exception& ex) {
-                std::cerr << std::endl << " Error deleting temporary FSB file: " << tempFile.u8string() << " - " << ex.what() << std::endl;
-            }
-        }
-    }
-
-    return 0; // Return 0 to indicate successful program execution
+    return exitCode; // Return 0 to indicate successful program execution (1 if the selected sound was not found or the bank is damaged)
 }
+#endif // FSB_EXTRACTOR_LIBRARY
 
 
 /**
@@ -638,6 +6426,34 @@ void Usage_Simple() {
     std::cerr << "                       -exe                  : Save wav files in the same folder as program file" << std::endl;
     std::cerr << "                       -o <output_directory> : Save wav files in the user-specified folder" << std::endl;
     std::cerr << "                       -v                    : Enable verbose logging for chunk processing verification" << std::endl;
+    std::cerr << "                       -single-pass          : Stream each sound once and patch the WAV header sizes at the end" << std::endl;
+    std::cerr << "                       -archive <file>       : Write all wav files into one *.tar or store-only *.zip file" << std::endl;
+    std::cerr << "                       -o -                  : Write to standard output (one -sound, or framed sounds)" << std::endl;
+    std::cerr << "                       -sound <number>       : Extract only this sound (1 = first)" << std::endl;
+    std::cerr << "                       -format <type>        : Output file format: wav (default), flac, npy, f32 or pcm" << std::endl;
+    std::cerr << "                       -durability <mode>    : Flush files to disk: none (default), file or batch" << std::endl;
+    std::cerr << "                       -atomic               : Write *.tmp files and rename them when their batch is complete" << std::endl;
+    std::cerr << "                       -sync-files <count>   : Files per durability batch (default 256)" << std::endl;
+    std::cerr << "                       -sync-mb <MB>         : Megabytes per durability batch (default 256)" << std::endl;
+    std::cerr << "                       -planar               : Channel-major sample order for npy/f32 output" << std::endl;
+    std::cerr << "                       -threads <count>      : Number of FLAC encoding threads (default: all hardware threads)" << std::endl;
+    std::cerr << "                       -shards <directory>   : Write WebDataset tar shards (wav + json per sound)" << std::endl;
+    std::cerr << "                       -shard-size <MB>      : Maximum size of each shard (default 1024, 0 for no limit)" << std::endl;
+    std::cerr << "                       -shard-count <count>  : Maximum number of sounds per shard (default 0, no limit)" << std::endl;
+    std::cerr << "                       -shm <name>           : Publish PCM data into a shared-memory ring (POSIX only)" << std::endl;
+    std::cerr << "                       -shm-mb <MB>          : Size of the shared-memory ring (default 64)" << std::endl;
+    std::cerr << "                       -peaks                : Write a *.peaks waveform summary next to every output file" << std::endl;
+    std::cerr << "                       -manifest <file>      : Write the PCM checksum (XXH64) and source offsets of every sound" << std::endl;
+    std::cerr << "                       -trace <file>         : Write a timeline of the extraction phases (Chrome Trace Event JSON)" << std::endl;
+    std::cerr << "                       -summary-json <file>  : Also write the end-of-run throughput summary as JSON" << std::endl;
+    std::cerr << "                       -metrics-file <file>  : Export live metrics in the Prometheus text format (textfile collector)" << std::endl;
+    std::cerr << "                       -metrics-interval <s> : Seconds between two metrics exports (default 15)" << std::endl;
+    std::cerr << "                       -perf-counters        : Report CPU cycles, instructions and cache/branch misses per phase (Linux)" << std::endl;
+    std::cerr << "                       -log-drop             : With -v, drop log messages instead of waiting when the log writer falls behind" << std::endl;
+    std::cerr << "                       -log-relative         : With -v, log seconds since start instead of the date and time" << std::endl;
+    std::cerr << "                       -log-binary           : With -v, write a compact binary log (*.binlog) instead of text" << std::endl;
+    std::cerr << "\n";
+    std::cerr << " Usage: program -decode-log <log_file.binlog> : Print a binary log as text" << std::endl;
 }
 
 /**
@@ -678,12 +6494,142 @@ void Usage_Detail() {
     std::cerr << "\n";
     std::cerr << "             The path can be an absolute path or a relative path based on the current execution location." << std::endl;
     std::cerr << "\n\n";
+    std::cerr << "   -o - [-sound <number>]" << std::endl;
+    std::cerr << "           : Write the decoded audio to standard output, e.g. to pipe it into an encoder. Messages go to standard error." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             With -sound, only that sound (1 = first, counted across all FSBs of a bank) is written, as a plain" << std::endl;
+    std::cerr << "               *.wav (or the -format type). With -single-pass, the WAV sizes are set to the maximum (read until end of stream)." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             Without -sound, every sound is written as a frame: \"FSBX\", metadata length (uint32 LE), metadata JSON," << std::endl;
+    std::cerr << "               data length (uint64 LE) and the file data. This option cannot be combined with -archive or -shards." << std::endl;
+    std::cerr << "\n\n";
     std::cerr << "   -v      : Enable verbose logging to verify chunk processing." << std::endl;
     std::cerr << "\n";
     std::cerr << "             When this option is enabled, detailed information about each audio chunk" << std::endl;
     std::cerr << "               read from the FSB file will be logged to a file (*.log)." << std::endl;
     std::cerr << "\n";
     std::cerr << "             This is helpful for developers to verify if the audio data is being read and processed correctly." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             Log lines are written by a background thread in large blocks. If it falls behind, extraction waits" << std::endl;
+    std::cerr << "               for it; with -log-drop, messages are dropped instead and the number dropped is logged." << std::endl;
+    std::cerr << "             With -log-relative, lines are stamped with the seconds since start (monotonic clock, microseconds)" << std::endl;
+    std::cerr << "               instead of the local date and time." << std::endl;
+    std::cerr << "             With -log-binary, the log is written as '_<name>.binlog': every (level, function) pair and every" << std::endl;
+    std::cerr << "               repeated message text is stored once, and each line is reduced to a few varints (timestamp delta," << std::endl;
+    std::cerr << "               site, FMOD code) plus its text. 'program -decode-log <file.binlog>' prints it in the text format." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -single-pass" << std::endl;
+    std::cerr << "           : Write a placeholder WAV header, stream audio data until FMOD reports the end of the sound," << std::endl;
+    std::cerr << "               and then patch the RIFF and data sizes in the header." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             The up-front PCM length query is skipped, and the header always matches the decoded data," << std::endl;
+    std::cerr << "               even for codecs whose reported length differs from the actual decoded length." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -archive <archive_file>" << std::endl;
+    std::cerr << "           : Write all *.wav files into a single archive instead of thousands of individual files." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             A path ending in *.zip creates a store-only (uncompressed) zip file; any other path creates a *.tar file." << std::endl;
+    std::cerr << "               The folder layout inside the archive matches the normal output, including language folders." << std::endl;
+    std::cerr << "               The archive is written as <archive_file>.tmp and renamed when complete; a failed run deletes it." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             This is useful on network file systems, where creating many small files is slower than decoding." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -durability <none|file|batch> [-atomic] [-sync-files <count>] [-sync-mb <MB>]" << std::endl;
+    std::cerr << "           : Choose when extracted files are flushed to disk." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             'none' (default) leaves write-back to the OS, which is fastest for previews and throwaway runs." << std::endl;
+    std::cerr << "             'file' flushes every file as soon as it is written (fdatasync / FlushFileBuffers)." << std::endl;
+    std::cerr << "             'batch' flushes once per batch of <count> files or <MB> megabytes (one syncfs call on Linux)," << std::endl;
+    std::cerr << "               which is durable at a fraction of the cost of flushing every file." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             With -atomic, files are written as *.tmp and renamed to their final names when their batch is flushed," << std::endl;
+    std::cerr << "               so other programs never see a partially written file. Archives, shards and blobs are flushed when complete" << std::endl;
+    std::cerr << "               (archives and shards are always written as *.tmp and renamed once complete)." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -format <wav|flac|npy|f32|pcm> [-threads <count>]" << std::endl;
+    std::cerr << "           : Choose the output file format. 'flac' stores integer PCM losslessly at roughly half the size of WAV." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             FLAC frames are encoded in parallel on <count> threads (default: all hardware threads)." << std::endl;
+    std::cerr << "               Sounds in 32-bit or PCM float format cannot be stored as FLAC and are written as *.wav files instead." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             'npy' writes one NumPy array of float32 samples per sound, shaped (frames, channels)." << std::endl;
+    std::cerr << "             'f32' writes the float32 samples of all sounds into one raw blob (<input>.f32) with a" << std::endl;
+    std::cerr << "               JSON Lines index (<input>.f32.jsonl) giving the byte offset and shape of each sound." << std::endl;
+    std::cerr << "               Both can be memory-mapped directly by data loaders; 'f32' cannot be combined with -archive or -shards." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             'pcm' writes the decoded samples without any header (*.pcm), in the sound's own sample format." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -planar" << std::endl;
+    std::cerr << "           : For 'npy' and 'f32' output, store all samples of each channel contiguously, shaped (channels, frames)." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             The default is interleaved samples, shaped (frames, channels), as in WAV files." << std::endl;
+    std::cerr << "               Planar output keeps each sound in memory until it has been fully decoded." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -shards <shard_directory> [-shard-size <MB>] [-shard-count <count>]" << std::endl;
+    std::cerr << "           : Write WebDataset-style tar shards for machine learning pipelines." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             Each sound is stored as a <key>.wav file plus a <key>.json file with its format, length and source file." << std::endl;
+    std::cerr << "               A new shard (e.g. 'music-000001.tar') is started when the size or sound count limit is reached." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             Shards are written as *.tar.tmp and renamed only when complete, so readers never see partial shards." << std::endl;
+    std::cerr << "               This option cannot be combined with -archive." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -shm <name> [-shm-mb <MB>]" << std::endl;
+    std::cerr << "           : Publish the decoded PCM data of every sound into the POSIX shared-memory object '/<name>'," << std::endl;
+    std::cerr << "             for a consumer process on the same host. Not available on Windows." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             The object holds a header with write/read positions and a ring of records (sound start with JSON" << std::endl;
+    std::cerr << "               metadata, PCM data, sound end), each with a sound ID and a sequence number. The extractor waits" << std::endl;
+    std::cerr << "               while the ring is full; the consumer removes the object (shm_unlink) when it is done." << std::endl;
+    std::cerr << "               If the consumer does not read for " << Constants::SHM_CONSUMER_TIMEOUT_SECONDS << " seconds while the ring is full, the extraction fails;" << std::endl;
+    std::cerr << "               a sound that fails midway ends with an abort record instead of a sound end record." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -peaks" << std::endl;
+    std::cerr << "           : Write a '<file>.peaks' waveform summary next to every output file (or archive entry)." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             The summary holds the minimum and maximum of every channel per 256, 1024, 4096 and 16384 frames" << std::endl;
+    std::cerr << "               as 16-bit values, computed while the sound is written (no second pass over the file)." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             This option cannot be combined with -o -, -shards, -shm or -format f32." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -manifest <manifest_file>" << std::endl;
+    std::cerr << "           : Write a JSON Lines file with one line per extracted sound: its output name, format, PCM size," << std::endl;
+    std::cerr << "             XXH64 checksum of the decoded PCM data, and the offsets of its FSB and encoded data in the input file." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             The checksum is computed while the sound is written, so verifying or deduplicating the output" << std::endl;
+    std::cerr << "               needs no second pass over the files. It matches 'xxhsum -H1' run on the *.pcm output." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -trace <trace_file>" << std::endl;
+    std::cerr << "           : Write a timeline of the extraction as a Chrome Trace Event file (*.json), written at exit." << std::endl;
+    std::cerr << "             Open it in Perfetto (ui.perfetto.dev) or chrome://tracing." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             Every thread gets a track showing its phases: bank scan, FSB open, getSubSound," << std::endl;
+    std::cerr << "               GetSoundInfo, and readData / convert / write for every chunk, nested in one event per sub-sound." << std::endl;
+    std::cerr << "               FLAC encoding threads appear as separate tracks." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -summary-json <summary_file>" << std::endl;
+    std::cerr << "           : Write the end-of-run summary, which is always printed, to a JSON file as well." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             The summary lists, per codec and in total, the number of sounds, encoded input and output megabytes," << std::endl;
+    std::cerr << "               time spent decoding (FMOD readData) and writing, and MB/s and sounds/s over the time spent on the sounds." << std::endl;
+    std::cerr << "               It ends with the wall time, the number of failed sounds and the 5 slowest sounds." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -metrics-file <metrics_file> [-metrics-interval <seconds>]" << std::endl;
+    std::cerr << "           : Write live metrics in the Prometheus text format every 15 seconds (or the given interval)," << std::endl;
+    std::cerr << "             for the node_exporter textfile collector (name the file *.prom and place it in the collector directory)." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             Metrics: sounds done / failed, PCM bytes decoded, bytes written, FSB files and sub-sounds queued," << std::endl;
+    std::cerr << "               FMOD errors by result code, and histograms of the time and output size per sub-sound." << std::endl;
+    std::cerr << "               The file is replaced atomically (written to *.tmp, then renamed) and updated a last time at exit." << std::endl;
+    std::cerr << "\n\n";
+    std::cerr << "   -perf-counters" << std::endl;
+    std::cerr << "           : (Linux only) Count CPU cycles, instructions, cache misses and branch misses with perf_event_open" << std::endl;
+    std::cerr << "             for each phase (scan, open, decode, convert, write) and print them after the summary," << std::endl;
+    std::cerr << "             with the IPC and the misses per MB of decoded PCM data." << std::endl;
+    std::cerr << "\n";
+    std::cerr << "             Only user-space events are counted, which the default perf_event_paranoid setting (2) allows." << std::endl;
+    std::cerr << "               Counts are attributed to the innermost phase (e.g. FLAC encoding inside a write counts as convert)." << std::endl;
+    std::cerr << "               Reading the counters costs a system call per phase boundary, so use it to compare, not to time." << std::endl;
     std::cerr << "\n\n";
     std::cerr << " Usage Examples:" << std::endl;
     std::cerr << "   program audio.fsb                           (Default option: same as -res)" << std::endl;
@@ -692,6 +6638,13 @@ void Usage_Detail() {
     std::cerr << "   program voices.bank -o \"C:\\output\\audio\"    (Save in the absolute path folder)" << std::endl;
     std::cerr << "   program effects.fsb -o \"output_wav\"         (Save in the relative path folder)" << std::endl;
     std::cerr << "   program music.bank -v                       (Enable verbose logging)" << std::endl;
+    std::cerr << "   program music.bank -single-pass             (Patch WAV header sizes after streaming)" << std::endl;
+    std::cerr << "   program music.bank -archive \"music.tar\"     (Write all wav files into one tar file)" << std::endl;
+    std::cerr << "   program music.bank -shards \"shards\" -shard-count 1000 (Write WebDataset shards of 1000 sounds)" << std::endl;
+    std::cerr << "   program music.bank -format flac -threads 8  (Encode FLAC files on 8 threads)" << std::endl;
+    std::cerr << "   program music.bank -format f32 -planar  (Write one planar float32 blob with an offsets index)" << std::endl;
+    std::cerr << "   program music.bank -o - -sound 3 | ffmpeg -i - out.opus  (Pipe the third sound into an encoder)" << std::endl;
+    std::cerr << "   program music.bank -durability batch -atomic  (Durable output, published in batches of 256 files)" << std::endl;
 }
 
 /**
@@ -704,6 +6657,7 @@ void Usage_Detail() {
  */
 void CheckFMODResult(FMOD_RESULT result, const std::string& message) {
     if (result != FMOD_OK) { // Checks if the FMOD result is not FMOD_OK (indicating an error)
+        Metrics::CountFMODError(result);
         throw std::runtime_error(message + ": " + FMOD_ErrorString(result)); // Throws a runtime error exception with the provided message and FMOD error string
     }
 }
@@ -718,27 +6672,164 @@ void CheckFMODResult(FMOD_RESULT result, const std::string& message) {
  * @details
  * Replaces characters that are typically invalid or problematic in file names (like <, >, :, ", /, \, |, ?, *)
  * with similar-looking but safe Unicode characters. This helps to avoid file system errors when creating output files.
+ * The replacements are looked up in a 256-entry table and written as UTF-8 escapes, so the result does not depend on the
+ * encoding of this source file. Names without any invalid character are returned unchanged after a single scan.
  */
 std::string SanitizeFileName(const std::string& fileName) {
-    static const std::unordered_map<char, std::string> charMap = { // Static map to store invalid characters and their replacements
-        {'<', ""}, {'>', ""}, {':', ""}, {'\"', ""}, {'/', ""},
-        {'\\', ""}, {'|', ""}, {'?', ""}, {'*', ""}
-    };
-    std::string sanitized = fileName; // Creates a copy of the input file name to sanitize
-    for (size_t i = 0; i < sanitized.length(); ++i) { // Iterates through each character in the file name
-        if (auto it = charMap.find(sanitized[i]); it != charMap.end()) { // Checks if the current character is in the invalid characters map
-            sanitized.replace(i, 1, it->second); // Replaces the invalid character with its corresponding safe replacement from the map
-            i += it->second.length() - 1; // Adjusts the loop index to account for the replacement string length (if longer than 1)
+    static const char INVALID_CHARACTERS[] = "<>:\"/\\|?*"; // Characters replaced below
+    static const std::array<const char*, 256> replacementTable = [] { // Replacement (UTF-8) for every byte value, nullptr to keep the byte
+        std::array<const char*, 256> table{};
+        table['<'] = "\xE3\x80\x88";  // U+3008 LEFT ANGLE BRACKET
+        table['>'] = "\xE3\x80\x89";  // U+3009 RIGHT ANGLE BRACKET
+        table[':'] = "\xEF\xBC\x9A";  // U+FF1A FULLWIDTH COLON
+        table['\"'] = "\xEF\xBC\x82"; // U+FF02 FULLWIDTH QUOTATION MARK
+        table['/'] = "\xEF\xBC\x8F";  // U+FF0F FULLWIDTH SOLIDUS
+        table['\\'] = "\xEF\xBC\xBC"; // U+FF3C FULLWIDTH REVERSE SOLIDUS
+        table['|'] = "\xEF\xBD\x9C";  // U+FF5C FULLWIDTH VERTICAL LINE
+        table['?'] = "\xEF\xBC\x9F";  // U+FF1F FULLWIDTH QUESTION MARK
+        table['*'] = "\xEF\xBC\x8A";  // U+FF0A FULLWIDTH ASTERISK
+        return table;
+    }();
+    constexpr size_t REPLACEMENT_LENGTH = 3; // Every replacement is one 3-byte UTF-8 sequence
+
+    size_t firstInvalid = std::strcspn(fileName.c_str(), INVALID_CHARACTERS); // Vectorized by the C library (stops early at an embedded NUL)
+    if (firstInvalid == fileName.size()) {
+        return fileName; // Fast path: nothing to replace
+    }
+
+    std::string sanitized;
+    sanitized.reserve(fileName.size() + (fileName.size() - firstInvalid) * (REPLACEMENT_LENGTH - 1)); // Upper bound, so appending never reallocates
+    sanitized.append(fileName, 0, firstInvalid);
+    for (size_t i = firstInvalid; i < fileName.size(); ++i) { // Single pass over the rest of the name
+        if (const char* replacement = replacementTable[static_cast<unsigned char>(fileName[i])]) {
+            sanitized.append(replacement, REPLACEMENT_LENGTH);
+        }
+        else {
+            sanitized.push_back(fileName[i]);
         }
     }
     return sanitized; // Returns the sanitized file name
 }
+
+
+
+/**
+ * @brief Escapes a string for embedding in a JSON document.
+ *
+ * @param text The original string (UTF-8).
+ * @return std::string The escaped string, without surrounding quotes.
+ *
+ * @details
+ * Escapes quotes, backslashes and control characters as required by RFC 8259. Other bytes are copied unchanged.
+ */
+std::string EscapeJsonString(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size() + 8);
+    for (unsigned char c : text) {
+        switch (c) {
+        case '"':  escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        default:
+            if (c < 0x20) { // Remaining control characters as \u00XX
+                char unicodeEscape[8];
+                std::snprintf(unicodeEscape, sizeof(unicodeEscape), "\\u%04x", c);
+                escaped += unicodeEscape;
+            }
+            else {
+                escaped += static_cast<char>(c);
+            }
+            break;
+        }
+    }
+    return escaped;
+}
+
+
+/**
+ * @brief Parses a non-negative decimal integer given as a command-line option value.
+ *
+ * @param text The option value.
+ * @param value Receives the parsed value on success.
+ * @return bool True if the whole string is a valid non-negative integer, false otherwise.
+ */
+bool ParseUnsignedArgument(const std::string& text, uint64_t& value) {
+    if (text.empty() || !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c) != 0; })) {
+        return false;
+    }
+    try {
+        value = std::stoull(text);
+    }
+    catch (const std::exception&) { // Out of range
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Converts an FMOD sound format to its name (e.g. "PCM16").
+ *
+ * @param format FMOD_SOUND_FORMAT value.
+ * @return const char* Name of the format, or "UNKNOWN" for values not listed here.
+ */
+const char* SoundFormatName(FMOD_SOUND_FORMAT format) {
+    switch (format) {
+    case FMOD_SOUND_FORMAT_NONE:      return "NONE";
+    case FMOD_SOUND_FORMAT_PCM8:      return "PCM8";
+    case FMOD_SOUND_FORMAT_PCM16:     return "PCM16";
+    case FMOD_SOUND_FORMAT_PCM24:     return "PCM24";
+    case FMOD_SOUND_FORMAT_PCM32:     return "PCM32";
+    case FMOD_SOUND_FORMAT_PCMFLOAT:  return "PCMFLOAT";
+    case FMOD_SOUND_FORMAT_BITSTREAM: return "BITSTREAM";
+    default:                          return "UNKNOWN";
+    }
+}
+
+
+/**
+ * @brief Converts an FMOD sound type (codec or container) to its name (e.g. "VORBIS", "FADPCM").
+ *
+ * @param soundType FMOD_SOUND_TYPE value.
+ * @return const char* Name of the sound type, or "UNKNOWN" for values not listed here.
+ */
+const char* SoundTypeName(FMOD_SOUND_TYPE soundType) {
+    switch (soundType) {
+    case FMOD_SOUND_TYPE_AIFF:             return "AIFF";
+    case FMOD_SOUND_TYPE_ASF:              return "ASF";
+    case FMOD_SOUND_TYPE_DLS:              return "DLS";
+    case FMOD_SOUND_TYPE_FLAC:             return "FLAC";
+    case FMOD_SOUND_TYPE_FSB:              return "FSB";
+    case FMOD_SOUND_TYPE_IT:               return "IT";
+    case FMOD_SOUND_TYPE_MIDI:             return "MIDI";
+    case FMOD_SOUND_TYPE_MOD:              return "MOD";
+    case FMOD_SOUND_TYPE_MPEG:             return "MPEG";
+    case FMOD_SOUND_TYPE_OGGVORBIS:        return "OGGVORBIS";
+    case FMOD_SOUND_TYPE_PLAYLIST:         return "PLAYLIST";
+    case FMOD_SOUND_TYPE_RAW:              return "RAW";
+    case FMOD_SOUND_TYPE_S3M:              return "S3M";
+    case FMOD_SOUND_TYPE_USER:             return "USER";
+    case FMOD_SOUND_TYPE_WAV:              return "WAV";
+    case FMOD_SOUND_TYPE_XM:               return "XM";
+    case FMOD_SOUND_TYPE_XMA:              return "XMA";
+    case FMOD_SOUND_TYPE_AUDIOQUEUE:       return "AUDIOQUEUE";
+    case FMOD_SOUND_TYPE_AT9:              return "AT9";
+    case FMOD_SOUND_TYPE_VORBIS:           return "VORBIS";
+    case FMOD_SOUND_TYPE_MEDIA_FOUNDATION: return "MEDIA_FOUNDATION";
+    case FMOD_SOUND_TYPE_MEDIACODEC:       return "MEDIACODEC";
+    case FMOD_SOUND_TYPE_FADPCM:           return "FADPCM";
+    case FMOD_SOUND_TYPE_OPUS:             return "OPUS";
+    default:                               return "UNKNOWN";
+    }
+}
 
 
 /**
  * @brief Writes the WAV file header to the output file stream.
  *
- * @param file Output file stream to write the WAV header to.
+ * @param file Output stream to write the WAV header to (a file, or an in-memory buffer when writing into an archive).
  * @param sampleRate Sample rate of the audio in Hz.
  * @param channels Number of audio channels.
  * @param dataSize Size of the audio data in bytes.
@@ -751,9 +6842,9 @@ std::string SanitizeFileName(const std::string& fileName) {
  * This header contains information about the audio format, sample rate, channels, and data size,
  * which is necessary for WAV files to be correctly recognized and played by audio players.
  */
-bool WriteWAVHeader(std::ofstream& file, int sampleRate, int channels, size_t dataSize, int bitsPerSample, FMOD_SOUND_FORMAT format) {
-    if (!file.is_open()) { // Checks if the output file stream is open
-        std::cerr << " Error: Output file is not open." << std::endl; // Prints error message to std::cerr if file is not open
+bool WriteWAVHeader(std::ostream& file, int sampleRate, int channels, size_t dataSize, int bitsPerSample, FMOD_SOUND_FORMAT format) {
+    if (!file.good()) { // Checks if the output stream is usable (open and without errors)
+        std::cerr << " Error: Output file is not open." << std::endl; // Prints error message to std::cerr if the stream is not usable
         return false; // Returns false to indicate failure
     }
 
@@ -789,6 +6880,43 @@ bool WriteWAVHeader(std::ofstream& file, int sampleRate, int channels, size_t da
 }
 
 
+/**
+ * @brief Rewrites the RIFF chunk size and data chunk size fields of a WAV header that has already been written.
+ *
+ * @param file Output stream containing a header written by WriteWAVHeader.
+ * @param dataSize Actual size of the audio data in bytes.
+ * @return bool True if the header fields were patched successfully, false otherwise.
+ *
+ * @details
+ * Used after streaming audio data when the final data size was not known (single-pass mode) or differs from the size
+ * written up front. Only the two size fields are overwritten in place; the stream position is restored to the end of the file
+ * afterwards so the caller can keep appending if needed.
+ */
+bool PatchWAVHeaderSizes(std::ostream& file, size_t dataSize) {
+    if (!file.good()) { // Checks if the output stream is usable (open and without errors)
+        std::cerr << " Error: Output file is not open." << std::endl; // Prints error message to std::cerr if the stream is not usable
+        return false; // Returns false to indicate failure
+    }
+
+    auto write_data = [&](const auto& data) { // Lambda function to write data to the file stream, handling byte conversion
+        file.write(reinterpret_cast<const char*>(&data), sizeof(data)); // Writes raw data to the file stream, size determined by data type
+        };
+
+    try {
+        file.seekp(Constants::RIFF_SIZE_OFFSET, std::ios::beg); // Moves to the RIFF chunk size field
+        write_data(static_cast<uint32_t>(36 + dataSize)); // Rewrites chunk size (WAV header size + data size), 4 bytes
+        file.seekp(Constants::DATA_SIZE_OFFSET, std::ios::beg); // Moves to the data chunk size field
+        write_data(static_cast<uint32_t>(dataSize)); // Rewrites data chunk size (audio data size), 4 bytes
+        file.seekp(0, std::ios::end); // Restores the write position to the end of the file
+    }
+    catch (const std::exception& e) { // Catches file stream and other standard exceptions
+        std::cerr << " Error patching WAV header: " << e.what() << std::endl; // Prints error message to std::cerr if exception occurred during header patching
+        return false; // Returns false to indicate failure
+    }
+    return file.good(); // Returns true only if all seeks and writes succeeded
+}
+
+
 /**
  * @brief Writes a log message to the log file if verbose logging is enabled.
  *
@@ -803,34 +6931,40 @@ bool WriteWAVHeader(std::ofstream& file, int sampleRate, int channels, size_t da
  * This function writes a formatted log message to the specified log file if verbose logging is enabled.
  * The log message includes a timestamp, log level, function name, and the message itself.
  * If an FMOD error code is provided (not FMOD_OK), it's also included in the log message.
+ * Call sites use the LOG_MESSAGE macro, so that the message is not even built while verbose logging is disabled.
+ * If an AsyncLogger is running for logFile, the message is queued for its writer thread instead of being written here.
  */
-void WriteLogMessage(std::ofstream& logFile, const std::string& level, const std::string& functionName, const std::string& message, bool verboseLogEnabled, FMOD_RESULT errorCode = FMOD_OK) {
+void WriteLogMessage(std::ofstream& logFile, const char* level, const char* functionName, const std::string& message, bool verboseLogEnabled, FMOD_RESULT errorCode = FMOD_OK) {
     if (logFile.is_open() && verboseLogEnabled) { // Checks if log file is open and verbose logging is enabled
-        auto now = std::chrono::system_clock::now(); // Gets current system time
+        const int64_t now = LogTimestamp::Now(); // Gets current time (wall clock, or time since start with -log-relative)
 
-        std::time_t time_t_value = std::chrono::system_clock::to_time_t(now); // Converts system time to time_t (C-style time)
-
-        std::tm time_components; // Struct to store time components (year, month, day, hour, minute, second)
-#ifdef _WIN32
-        localtime_s(&time_components, &time_t_value); // Converts time_t to local time and fills time_components struct (thread-safe version for Windows)
-#else
-        localtime_r(&time_t_value, &time_components); // POSIX version
-#endif
+        AsyncLogger* asyncLogger = AsyncLogger::Active().load(std::memory_order_acquire);
+        if (asyncLogger && asyncLogger->file() == &logFile) { // Formatting and file output happen on the writer thread
+            asyncLogger->Push(now, level, functionName, message, errorCode);
+            return;
+        }
 
-        auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000; // Extracts milliseconds part from current time
+        std::string line; // Formatted log line
+        FormatLogLine(line, now, level, functionName, message, errorCode);
+        logFile << line << std::flush; // Writes the line and flushes, like std::endl
+    }
+}
 
-        std::stringstream timestampStream; // String stream to format the timestamp
-        timestampStream << std::put_time(&time_components, "%Y-%m-%d %H:%M:%S"); // Formats date and time
-        timestampStream << "." << std::setfill('0') << std::setw(3) << milliseconds.count(); // Formats milliseconds with leading zeros
 
-        logFile << "[" << timestampStream.str() << "] "; // Writes timestamp to log file
-        logFile << "[" << level << "] "; // Writes log level to log file
-        logFile << "[" << functionName << "] "; // Writes function name to log file
-        logFile << message; // Writes log message to log file
-        if (errorCode != FMOD_OK) { // If an FMOD error code is provided (not FMOD_OK)
-            logFile << " (Error code: " << errorCode << ")"; // Appends error code to the log message
+/**
+ * @brief Writes an empty separator line to the log file if verbose logging is enabled (through the AsyncLogger, if one is running).
+ *
+ * @param logFile Output file stream for the log file.
+ * @param verboseLogEnabled Flag indicating if verbose logging is enabled.
+ */
+void WriteLogSeparator(std::ofstream& logFile, bool verboseLogEnabled) {
+    if (logFile.is_open() && verboseLogEnabled) {
+        AsyncLogger* asyncLogger = AsyncLogger::Active().load(std::memory_order_acquire);
+        if (asyncLogger && asyncLogger->file() == &logFile) {
+            asyncLogger->Push(LogTimestamp::Now(), nullptr, nullptr, std::string(), FMOD_OK);
+            return;
         }
-        logFile << std::endl; // Writes newline character to log file
+        logFile << std::endl;
     }
 }
 
@@ -841,12 +6975,14 @@ namespace AudioProcessor {
      *
      * @tparam BufferType Data type of the audio buffer (e.g., unsigned char, short, int).
      * @param subSound FMOD Sound object representing the sub-sound.
-     * @param wavFile Output file stream for the WAV file.
-     * @param soundLengthBytes Total length of the sub-sound data in bytes.
+     * @param wavFile Output stream for the WAV file (a file, or an in-memory buffer when writing into an archive).
+     * @param soundLengthBytes Total length of the sub-sound data in bytes, or Constants::UNKNOWN_LENGTH to read until FMOD reports end of stream.
      * @param subSoundIndex Index of the sub-sound being processed.
      * @param chunkCount Counter for chunks processed (for logging).
      * @param verboseLogEnabled Flag indicating if verbose logging is enabled.
      * @param logFile Output file stream for the log file.
+     * @param pcmHasher Checksum updated with every chunk as it is written, or nullptr.
+     * @param timings Receives the time spent decoding and writing, or nullptr.
      * @return bool True if writing data chunks was successful, false otherwise.
      *
      * @details
@@ -856,7 +6992,9 @@ namespace AudioProcessor {
      * PCM float format is handled by WritePCMFloatDataChunk function.
      */
     template <typename BufferType>
-    bool WriteAudioDataChunk(FMOD::Sound* subSound, std::ofstream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile) {
+    bool WriteAudioDataChunk(FMOD::Sound* subSound, std::ostream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile, PcmChecksum::Hasher* pcmHasher, ChunkTimings* timings) {
+        int64_t* decodeTime = timings ? &timings->decodeNanoseconds : nullptr; // Accumulators for the run summary
+        int64_t* writeTime = timings ? &timings->writeNanoseconds : nullptr;
         // Calculate buffer size based on chunk size and data type
         std::vector<BufferType> buffer(Constants::CHUNK_SIZE / sizeof(BufferType));
         unsigned int totalBytesRead = 0; // Initialize total bytes read counter
@@ -869,24 +7007,39 @@ namespace AudioProcessor {
             ++chunkCount; // Increment chunk counter before processing current chunk
             unsigned int bytesRead = 0; // Initialize bytes read for current chunk
             // Read data from FMOD sub-sound into buffer
-            FMOD_RESULT fmodSystemResult = subSound->readData(buffer.data(), bytesToRead, &bytesRead);
-            if (fmodSystemResult != FMOD_OK) {
-                WriteLogMessage(logFile, "INFO", "WriteAudioDataChunk", "Reading chunk " + std::to_string(chunkCount) + " - Bytes to read: " + std::to_string(bytesToRead), verboseLogEnabled, FMOD_OK);
-                WriteLogMessage(logFile, "ERROR", "WriteAudioDataChunk", "FMOD::Sound::readData failed for sub-sound " + std::to_string(subSoundIndex) + ", chunk " + std::to_string(chunkCount) + ": " + FMOD_ErrorString(fmodSystemResult) + " (Result code: " + std::to_string(fmodSystemResult) + ")", verboseLogEnabled, fmodSystemResult);
+            FMOD_RESULT fmodSystemResult;
+            {
+                TraceEvents::Scope readScope("readData", subSoundIndex, decodeTime);
+                PerfCounters::Scope perfScope(PerfCounters::Decode);
+                fmodSystemResult = subSound->readData(buffer.data(), bytesToRead, &bytesRead);
+            }
+            if (fmodSystemResult != FMOD_OK && fmodSystemResult != FMOD_ERR_FILE_EOF) {
+                LOG_MESSAGE(logFile, "INFO", "WriteAudioDataChunk", "Reading chunk " + std::to_string(chunkCount) + " - Bytes to read: " + std::to_string(bytesToRead), verboseLogEnabled, FMOD_OK);
+                LOG_MESSAGE(logFile, "ERROR", "WriteAudioDataChunk", "FMOD::Sound::readData failed for sub-sound " + std::to_string(subSoundIndex) + ", chunk " + std::to_string(chunkCount) + ": " + FMOD_ErrorString(fmodSystemResult) + " (Result code: " + std::to_string(fmodSystemResult) + ")", verboseLogEnabled, fmodSystemResult);
                 std::cerr << " FMOD::Sound::readData failed for sub-sound " << subSoundIndex << ": " << FMOD_ErrorString(fmodSystemResult) << std::endl;
+                Metrics::CountFMODError(fmodSystemResult);
                 return false; // Return false to indicate failure
             }
+            Metrics::Global().bytesDecoded.Add(bytesRead);
 
             try {
+                TraceEvents::Scope writeScope("write", subSoundIndex, writeTime);
+                PerfCounters::Scope perfScope(PerfCounters::Write);
                 // Write the buffer data to the WAV file
                 wavFile.write(reinterpret_cast<const char*>(buffer.data()), bytesRead);
+                if (pcmHasher) {
+                    pcmHasher->Update(buffer.data(), bytesRead); // Hashes the chunk while it is still in cache
+                }
             }
             catch (const std::ios_base::failure& e) {
-                WriteLogMessage(logFile, "ERROR", "WriteAudioDataChunk", "Error writing WAV data for chunk " + std::to_string(chunkCount) + ": " + e.what(), verboseLogEnabled, FMOD_OK);
+                LOG_MESSAGE(logFile, "ERROR", "WriteAudioDataChunk", "Error writing WAV data for chunk " + std::to_string(chunkCount) + ": " + e.what(), verboseLogEnabled, FMOD_OK);
                 std::cerr << " Error writing WAV data: " << e.what() << std::endl;
                 return false; // Return false to indicate failure
             }
             totalBytesRead += bytesRead; // Update total bytes read counter
+            if (fmodSystemResult == FMOD_ERR_FILE_EOF || bytesRead == 0) {
+                break; // End of stream reached (the normal exit in single-pass mode, where soundLengthBytes is Constants::UNKNOWN_LENGTH)
+            }
         }
         return true; // Return true to indicate success after writing all data chunks
     }
@@ -896,12 +7049,14 @@ namespace AudioProcessor {
      * @brief Writes audio data chunks to the WAV file for 24-bit PCM format.
      *
      * @param subSound FMOD Sound object representing the sub-sound.
-     * @param wavFile Output file stream for the WAV file.
-     * @param soundLengthBytes Total length of the sub-sound data in bytes.
+     * @param wavFile Output stream for the WAV file (a file, or an in-memory buffer when writing into an archive).
+     * @param soundLengthBytes Total length of the sub-sound data in bytes, or Constants::UNKNOWN_LENGTH to read until FMOD reports end of stream.
      * @param subSoundIndex Index of the sub-sound being processed.
      * @param chunkCount Counter for chunks processed (for logging).
      * @param verboseLogEnabled Flag indicating if verbose logging is enabled.
      * @param logFile Output file stream for the log file.
+     * @param pcmHasher Checksum updated with every chunk as it is written, or nullptr.
+     * @param timings Receives the time spent decoding and writing, or nullptr.
      * @return bool True if writing data chunks was successful, false otherwise.
      *
      * @details
@@ -910,7 +7065,9 @@ namespace AudioProcessor {
      * This function iterates through the read buffer and writes each 3-byte sample individually to maintain WAV compatibility.
      * WAV format expects 24-bit PCM as 3 bytes per sample in little-endian byte order.
      */
-    bool WritePCM24DataChunk(FMOD::Sound* subSound, std::ofstream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile) {
+    bool WritePCM24DataChunk(FMOD::Sound* subSound, std::ostream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile, PcmChecksum::Hasher* pcmHasher, ChunkTimings* timings) {
+        int64_t* decodeTime = timings ? &timings->decodeNanoseconds : nullptr; // Accumulators for the run summary
+        int64_t* writeTime = timings ? &timings->writeNanoseconds : nullptr;
         std::vector<unsigned char> buffer(Constants::CHUNK_SIZE);
         unsigned int totalBytesRead = 0;
 
@@ -920,24 +7077,39 @@ namespace AudioProcessor {
             ++chunkCount; // Increment chunk counter before processing current chunk
             unsigned int bytesRead = 0; // Initialize bytes read for current chunk
             // Read data from FMOD sub-sound into buffer
-            FMOD_RESULT fmodSystemResult = subSound->readData(buffer.data(), bytesToRead, &bytesRead);
-            if (fmodSystemResult != FMOD_OK) {
-                WriteLogMessage(logFile, "INFO", "WritePCM24DataChunk", "Reading chunk " + std::to_string(chunkCount) + " (PCM24) - Bytes to read: " + std::to_string(bytesToRead), verboseLogEnabled, FMOD_OK);
-                WriteLogMessage(logFile, "ERROR", "WritePCM24DataChunk", "FMOD::Sound::readData failed for sub-sound " + std::to_string(subSoundIndex) + ", chunk " + std::to_string(chunkCount) + " (PCM24): " + FMOD_ErrorString(fmodSystemResult) + " (Result code: " + std::to_string(fmodSystemResult) + ")", verboseLogEnabled, fmodSystemResult);
+            FMOD_RESULT fmodSystemResult;
+            {
+                TraceEvents::Scope readScope("readData", subSoundIndex, decodeTime);
+                PerfCounters::Scope perfScope(PerfCounters::Decode);
+                fmodSystemResult = subSound->readData(buffer.data(), bytesToRead, &bytesRead);
+            }
+            if (fmodSystemResult != FMOD_OK && fmodSystemResult != FMOD_ERR_FILE_EOF) {
+                LOG_MESSAGE(logFile, "INFO", "WritePCM24DataChunk", "Reading chunk " + std::to_string(chunkCount) + " (PCM24) - Bytes to read: " + std::to_string(bytesToRead), verboseLogEnabled, FMOD_OK);
+                LOG_MESSAGE(logFile, "ERROR", "WritePCM24DataChunk", "FMOD::Sound::readData failed for sub-sound " + std::to_string(subSoundIndex) + ", chunk " + std::to_string(chunkCount) + " (PCM24): " + FMOD_ErrorString(fmodSystemResult) + " (Result code: " + std::to_string(fmodSystemResult) + ")", verboseLogEnabled, fmodSystemResult);
                 std::cerr << " FMOD::Sound::readData failed for sub-sound " << subSoundIndex << ": " << FMOD_ErrorString(fmodSystemResult) << std::endl;
+                Metrics::CountFMODError(fmodSystemResult);
                 return false; // Return false to indicate failure
             }
+            Metrics::Global().bytesDecoded.Add(bytesRead);
 
             try {
+                TraceEvents::Scope writeScope("write", subSoundIndex, writeTime);
+                PerfCounters::Scope perfScope(PerfCounters::Write);
                 // Since the data is already packed as 3-byte samples, we can write the buffer directly.
                 wavFile.write(reinterpret_cast<const char*>(buffer.data()), bytesRead);
+                if (pcmHasher) {
+                    pcmHasher->Update(buffer.data(), bytesRead); // Hashes the chunk while it is still in cache
+                }
             }
             catch (const std::ios_base::failure& e) {
-                WriteLogMessage(logFile, "ERROR", "WritePCM24DataChunk", "Error writing WAV data for chunk " + std::to_string(chunkCount) + " (PCM24): " + e.what(), verboseLogEnabled, FMOD_OK);
+                LOG_MESSAGE(logFile, "ERROR", "WritePCM24DataChunk", "Error writing WAV data for chunk " + std::to_string(chunkCount) + " (PCM24): " + e.what(), verboseLogEnabled, FMOD_OK);
                 std::cerr << " Error writing WAV data: " << e.what() << std::endl;
                 return false; // Return false to indicate failure
             }
             totalBytesRead += bytesRead; // Update total bytes read counter
+            if (fmodSystemResult == FMOD_ERR_FILE_EOF || bytesRead == 0) {
+                break; // End of stream reached (the normal exit in single-pass mode, where soundLengthBytes is Constants::UNKNOWN_LENGTH)
+            }
         }
         return true; // Return true to indicate success after writing all data chunks
     }
@@ -947,12 +7119,14 @@ namespace AudioProcessor {
      * @brief Writes audio data chunks to the WAV file for PCM float format.
      *
      * @param subSound FMOD Sound object representing the sub-sound.
-     * @param wavFile Output file stream for the WAV file.
-     * @param soundLengthBytes Total length of the sub-sound data in bytes.
+     * @param wavFile Output stream for the WAV file (a file, or an in-memory buffer when writing into an archive).
+     * @param soundLengthBytes Total length of the sub-sound data in bytes, or Constants::UNKNOWN_LENGTH to read until FMOD reports end of stream.
      * @param subSoundIndex Index of the sub-sound being processed.
      * @param chunkCount Counter for chunks processed (for logging).
      * @param verboseLogEnabled Flag indicating if verbose logging is enabled.
      * @param logFile Output file stream for the log file.
+     * @param pcmHasher Checksum updated with every chunk as it is written, or nullptr.
+     * @param timings Receives the time spent decoding and writing, or nullptr.
      * @return bool True if writing data chunks was successful, false otherwise.
      *
      * @details
@@ -962,7 +7136,9 @@ namespace AudioProcessor {
      * Finally, it writes the clamped float sample data to the WAV file in binary float format.
      * The WAV float format utilizes IEEE 754 single-precision floating-point numbers.
      */
-    bool WritePCMFloatDataChunk(FMOD::Sound* subSound, std::ofstream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile) {
+    bool WritePCMFloatDataChunk(FMOD::Sound* subSound, std::ostream& wavFile, size_t soundLengthBytes, int subSoundIndex, int& chunkCount, bool verboseLogEnabled, std::ofstream& logFile, PcmChecksum::Hasher* pcmHasher, ChunkTimings* timings) {
+        int64_t* decodeTime = timings ? &timings->decodeNanoseconds : nullptr; // Accumulators for the run summary
+        int64_t* writeTime = timings ? &timings->writeNanoseconds : nullptr;
         // Calculate buffer size for float data based on chunk size
         std::vector<float> floatBuffer(Constants::CHUNK_SIZE / sizeof(float));
         unsigned int totalBytesRead = 0;
@@ -975,37 +7151,56 @@ namespace AudioProcessor {
             ++chunkCount; // Increment chunk counter before processing current chunk
             unsigned int bytesRead = 0; // Initialize bytes read for current chunk
             // Read float data from FMOD sub-sound into float buffer
-            FMOD_RESULT fmodSystemResult = subSound->readData(floatBuffer.data(), bytesToRead, &bytesRead);
-            if (fmodSystemResult != FMOD_OK) {
-                WriteLogMessage(logFile, "INFO", "WritePCMFloatDataChunk", "Reading chunk " + std::to_string(chunkCount) + " (PCMFLOAT) - Bytes to read: " + std::to_string(bytesToRead), verboseLogEnabled, FMOD_OK);
-                WriteLogMessage(logFile, "ERROR", "WritePCMFloatDataChunk", "FMOD::Sound::readData failed for sub-sound " + std::to_string(subSoundIndex) + ", chunk " + std::to_string(chunkCount) + " (PCMFLOAT): " + FMOD_ErrorString(fmodSystemResult) + " (Result code: " + std::to_string(fmodSystemResult) + ")", verboseLogEnabled, fmodSystemResult);
+            FMOD_RESULT fmodSystemResult;
+            {
+                TraceEvents::Scope readScope("readData", subSoundIndex, decodeTime);
+                PerfCounters::Scope perfScope(PerfCounters::Decode);
+                fmodSystemResult = subSound->readData(floatBuffer.data(), bytesToRead, &bytesRead);
+            }
+            if (fmodSystemResult != FMOD_OK && fmodSystemResult != FMOD_ERR_FILE_EOF) {
+                LOG_MESSAGE(logFile, "INFO", "WritePCMFloatDataChunk", "Reading chunk " + std::to_string(chunkCount) + " (PCMFLOAT) - Bytes to read: " + std::to_string(bytesToRead), verboseLogEnabled, FMOD_OK);
+                LOG_MESSAGE(logFile, "ERROR", "WritePCMFloatDataChunk", "FMOD::Sound::readData failed for sub-sound " + std::to_string(subSoundIndex) + ", chunk " + std::to_string(chunkCount) + " (PCMFLOAT): " + FMOD_ErrorString(fmodSystemResult) + " (Result code: " + std::to_string(fmodSystemResult) + ")", verboseLogEnabled, fmodSystemResult);
                 std::cerr << " FMOD::Sound::readData failed for sub-sound " << subSoundIndex << ": " << FMOD_ErrorString(fmodSystemResult) << std::endl;
+                Metrics::CountFMODError(fmodSystemResult);
                 return false; // Return false to indicate failure
             }
+            Metrics::Global().bytesDecoded.Add(bytesRead);
 
             // **Clipping Implementation Start**
-            for (size_t i = 0; i < bytesRead / sizeof(float); ++i) {
-                if (floatBuffer[i] > 1.0f) {
-                    WriteLogMessage(logFile, "WARNING", "WritePCMFloatDataChunk", "PCMFLOAT clipping (upper): original=" + std::to_string(floatBuffer[i]) + ", limited=1.0", verboseLogEnabled, FMOD_OK);
-                    floatBuffer[i] = 1.0f;
-                }
-                else if (floatBuffer[i] < -1.0f) {
-                    WriteLogMessage(logFile, "WARNING", "WritePCMFloatDataChunk", "PCMFLOAT clipping (lower): original=" + std::to_string(floatBuffer[i]) + ", limited=-1.0", verboseLogEnabled, FMOD_OK);
-                    floatBuffer[i] = -1.0f;
+            {
+                TraceEvents::Scope convertScope("convert", subSoundIndex, writeTime);
+                PerfCounters::Scope perfScope(PerfCounters::Convert);
+                for (size_t i = 0; i < bytesRead / sizeof(float); ++i) {
+                    if (floatBuffer[i] > 1.0f) {
+                        LOG_MESSAGE(logFile, "WARNING", "WritePCMFloatDataChunk", "PCMFLOAT clipping (upper): original=" + std::to_string(floatBuffer[i]) + ", limited=1.0", verboseLogEnabled, FMOD_OK);
+                        floatBuffer[i] = 1.0f;
+                    }
+                    else if (floatBuffer[i] < -1.0f) {
+                        LOG_MESSAGE(logFile, "WARNING", "WritePCMFloatDataChunk", "PCMFLOAT clipping (lower): original=" + std::to_string(floatBuffer[i]) + ", limited=-1.0", verboseLogEnabled, FMOD_OK);
+                        floatBuffer[i] = -1.0f;
+                    }
                 }
             }
             // **Clipping Implementation End**
 
             try {
+                TraceEvents::Scope writeScope("write", subSoundIndex, writeTime);
+                PerfCounters::Scope perfScope(PerfCounters::Write);
                 // Write the float buffer data directly to the WAV file
                 wavFile.write(reinterpret_cast<const char*>(floatBuffer.data()), bytesRead);
+                if (pcmHasher) {
+                    pcmHasher->Update(floatBuffer.data(), bytesRead); // Hashes the clipped samples, as written
+                }
             }
             catch (const std::ios_base::failure& e) {
-                WriteLogMessage(logFile, "ERROR", "WritePCMFloatDataChunk", "Error writing WAV data for chunk " + std::to_string(chunkCount) + " (PCMFLOAT): " + e.what(), verboseLogEnabled, FMOD_OK);
+                LOG_MESSAGE(logFile, "ERROR", "WritePCMFloatDataChunk", "Error writing WAV data for chunk " + std::to_string(chunkCount) + " (PCMFLOAT): " + e.what(), verboseLogEnabled, FMOD_OK);
                 std::cerr << " Error writing WAV data: " << e.what() << std::endl;
                 return false; // Return false to indicate failure
             }
             totalBytesRead += bytesRead; // Update total bytes read counter
+            if (fmodSystemResult == FMOD_ERR_FILE_EOF || bytesRead == 0) {
+                break; // End of stream reached (the normal exit in single-pass mode, where soundLengthBytes is Constants::UNKNOWN_LENGTH)
+            }
         }
         return true; // Return true to indicate success after writing all data chunks
     }
@@ -1019,70 +7214,79 @@ namespace AudioProcessor {
  * @param subSoundIndex Index of the sub-sound being processed.
  * @param verboseLogEnabled Flag indicating if verbose logging is enabled.
  * @param logFile Output file stream for the log file.
+ * @param singlePassEnabled Flag indicating single-pass mode, in which the PCM byte length query is skipped.
  * @return SoundInfo Structure containing information about the sub-sound.
  *
  * @details
  * This function retrieves various properties of the given FMOD sub-sound, such as format, sound type,
  * sample rate, bits per sample, number of channels, length in bytes and milliseconds, and sub-sound name.
  * It logs each step of information retrieval if verbose logging is enabled and throws an exception if critical FMOD API calls fail.
+ * In single-pass mode soundLengthBytes is left at 0, because some codecs must decode the whole stream to answer that query;
+ * the real size is measured while writing and patched into the WAV header afterwards.
  */
-SoundInfo GetSoundInfo(FMOD::Sound* subSound, int subSoundIndex, bool verboseLogEnabled, std::ofstream& logFile) {
+SoundInfo GetSoundInfo(FMOD::Sound* subSound, int subSoundIndex, bool verboseLogEnabled, std::ofstream& logFile, bool singlePassEnabled) {
+    TraceEvents::Scope infoScope("GetSoundInfo", subSoundIndex);
     SoundInfo info; // Structure to store sound information
     FMOD_RESULT fmodSystemResult; // Variable to store FMOD API call results
     float defaultFrequency; // Variable to store default frequency
     int defaultPriority;    // Variable to store default priority
 
-    WriteLogMessage(logFile, "INFO", "GetSoundInfo", "Getting sound format...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sound format
+    LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "Getting sound format...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sound format
     fmodSystemResult = subSound->getFormat(&info.soundType, &info.format, &info.channels, &info.bitsPerSample); // Gets sound format information from FMOD Sound object
     if (fmodSystemResult != FMOD_OK) { // Checks if getting format failed
-        WriteLogMessage(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getFormat failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
+        LOG_MESSAGE(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getFormat failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
         CheckFMODResult(fmodSystemResult, "FMOD::Sound::getFormat failed for sub-sound " + std::to_string(subSoundIndex)); // Throws exception on error
     }
     else {
         // String conversion for logging is more complex in C++ than C#, so we'll omit the detailed enum-to-string for brevity here, but it can be added with switch statements if needed.
-        WriteLogMessage(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getFormat successful - Channels: " + std::to_string(info.channels) + ", Bits Per Sample: " + std::to_string(info.bitsPerSample), verboseLogEnabled, FMOD_OK); // Logs successful format retrieval (INFO level)
+        LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getFormat successful - Channels: " + std::to_string(info.channels) + ", Bits Per Sample: " + std::to_string(info.bitsPerSample), verboseLogEnabled, FMOD_OK); // Logs successful format retrieval (INFO level)
     }
 
-    WriteLogMessage(logFile, "INFO", "GetSoundInfo", "Getting default sound parameters...", verboseLogEnabled, FMOD_OK); // Logs attempt to get default parameters
+    LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "Getting default sound parameters...", verboseLogEnabled, FMOD_OK); // Logs attempt to get default parameters
     fmodSystemResult = subSound->getDefaults(&defaultFrequency, &defaultPriority); // Gets default frequency and priority from FMOD Sound object
     if (fmodSystemResult != FMOD_OK) { // Checks if getting defaults failed
-        WriteLogMessage(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getDefaults failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
+        LOG_MESSAGE(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getDefaults failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
         CheckFMODResult(fmodSystemResult, "FMOD::Sound::getDefaults failed for sub-sound " + std::to_string(subSoundIndex)); // Throws exception on error
     }
     else {
-        WriteLogMessage(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getDefaults successful - Default Frequency: " + std::to_string(defaultFrequency) + ", Default Priority: " + std::to_string(defaultPriority), verboseLogEnabled, FMOD_OK); // Logs successful defaults retrieval (INFO level)
+        LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getDefaults successful - Default Frequency: " + std::to_string(defaultFrequency) + ", Default Priority: " + std::to_string(defaultPriority), verboseLogEnabled, FMOD_OK); // Logs successful defaults retrieval (INFO level)
     }
 
     info.sampleRate = (defaultFrequency > 0) ? static_cast<int>(defaultFrequency) : 44100; // Sets sample rate, using default frequency if available, otherwise defaults to 44100 Hz
-    WriteLogMessage(logFile, "INFO", "GetSoundInfo", "Final Sample Rate for WAV header: " + std::to_string(info.sampleRate), verboseLogEnabled, FMOD_OK); // Logs final sample rate used for WAV header
+    LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "Final Sample Rate for WAV header: " + std::to_string(info.sampleRate), verboseLogEnabled, FMOD_OK); // Logs final sample rate used for WAV header
 
-    WriteLogMessage(logFile, "INFO", "GetSoundInfo", "Getting sound length in bytes...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sound length in bytes
-    fmodSystemResult = subSound->getLength(&info.soundLengthBytes, FMOD_TIMEUNIT_PCMBYTES); // Gets sound length in bytes
-    if (fmodSystemResult != FMOD_OK) { // Checks if getting length failed
-        WriteLogMessage(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getLength (bytes) failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
-        CheckFMODResult(fmodSystemResult, "FMOD::Sound::getLength (bytes) failed for sub-sound " + std::to_string(subSoundIndex)); // Throws exception on error
+    if (singlePassEnabled) { // In single-pass mode the byte length is measured while streaming instead
+        LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "Single-pass mode: skipping sound length in bytes query", verboseLogEnabled, FMOD_OK); // Logs skipped length query
     }
     else {
-        WriteLogMessage(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getLength (bytes) successful - Length: " + std::to_string(info.soundLengthBytes) + " bytes", verboseLogEnabled, FMOD_OK); // Logs successful length retrieval in bytes (INFO level)
+        LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "Getting sound length in bytes...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sound length in bytes
+        fmodSystemResult = subSound->getLength(&info.soundLengthBytes, FMOD_TIMEUNIT_PCMBYTES); // Gets sound length in bytes
+        if (fmodSystemResult != FMOD_OK) { // Checks if getting length failed
+            LOG_MESSAGE(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getLength (bytes) failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
+            CheckFMODResult(fmodSystemResult, "FMOD::Sound::getLength (bytes) failed for sub-sound " + std::to_string(subSoundIndex)); // Throws exception on error
+        }
+        else {
+            LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getLength (bytes) successful - Length: " + std::to_string(info.soundLengthBytes) + " bytes", verboseLogEnabled, FMOD_OK); // Logs successful length retrieval in bytes (INFO level)
+        }
     }
 
-    WriteLogMessage(logFile, "INFO", "GetSoundInfo", "Getting sound length in milliseconds...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sound length in milliseconds
+    LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "Getting sound length in milliseconds...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sound length in milliseconds
     fmodSystemResult = subSound->getLength(&info.lengthMs, FMOD_TIMEUNIT_MS); // Gets sound length in milliseconds
     if (fmodSystemResult != FMOD_OK) { // Checks if getting length failed
-        WriteLogMessage(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getLength (ms) failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
+        LOG_MESSAGE(logFile, "ERROR", "GetSoundInfo", "FMOD::Sound::getLength (ms) failed for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs FMOD error (ERROR level)
         CheckFMODResult(fmodSystemResult, "FMOD::Sound::getLength (ms) failed for sub-sound " + std::to_string(subSoundIndex)); // Throws exception on error
     }
     else {
-        WriteLogMessage(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getLength (ms) successful - Length: " + std::to_string(info.lengthMs) + " ms", verboseLogEnabled, FMOD_OK); // Logs successful length retrieval in milliseconds (INFO level)
+        LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getLength (ms) successful - Length: " + std::to_string(info.lengthMs) + " ms", verboseLogEnabled, FMOD_OK); // Logs successful length retrieval in milliseconds (INFO level)
     }
 
-    WriteLogMessage(logFile, "INFO", "GetSoundInfo", "Getting sub-sound name...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sub-sound name
+    LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "Getting sub-sound name...", verboseLogEnabled, FMOD_OK); // Logs attempt to get sub-sound name
     fmodSystemResult = subSound->getName(info.subSoundName, sizeof(info.subSoundName)); // Gets sub-sound name
     if (fmodSystemResult != FMOD_OK && fmodSystemResult != FMOD_ERR_TAGNOTFOUND) { // Checks if getting name failed (but ignores FMOD_ERR_TAGNOTFOUND, which is expected if no name tag exists)
-        WriteLogMessage(logFile, "WARNING", "GetSoundInfo", "FMOD::Sound::getName failed or tag not found for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs warning if getting name failed or tag not found (WARNING level)
+        LOG_MESSAGE(logFile, "WARNING", "GetSoundInfo", "FMOD::Sound::getName failed or tag not found for sub-sound " + std::to_string(subSoundIndex) + ": " + FMOD_ErrorString(fmodSystemResult), verboseLogEnabled, fmodSystemResult); // Logs warning if getting name failed or tag not found (WARNING level)
     }
     else {
-        WriteLogMessage(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getName successful - Name: " + std::string(info.subSoundName), verboseLogEnabled, FMOD_OK); // Logs successful name retrieval (INFO level)
+        LOG_MESSAGE(logFile, "INFO", "GetSoundInfo", "FMOD::Sound::getName successful - Name: " + std::string(info.subSoundName), verboseLogEnabled, FMOD_OK); // Logs successful name retrieval (INFO level)
     }
     return info; // Returns the SoundInfo structure containing retrieved information
 }
@@ -1095,87 +7299,387 @@ SoundInfo GetSoundInfo(FMOD::Sound* subSound, int subSoundIndex, bool verboseLog
  * @param subSound FMOD Sound object representing the sub-sound to process.
  * @param subSoundIndex Index of the sub-sound being processed.
  * @param totalSubSounds Total number of sub-sounds in the FSB file.
- * @param baseFileName Base file name (stem of the input FSB file name).
- * @param outputDirectoryPath Path to the output directory where WAV file will be saved.
+ * @param outputDirectoryPath Path to the output directory of the FSB file (archive entry names are relative to its parent).
  * @param verboseLogEnabled Flag indicating if verbose logging is enabled.
  * @param logFile Output file stream for the log file.
- * @param usedFileNames A set to track used filenames and prevent overwrites.
+ * @param outputFilePath Output path of the sub-sound, computed up front by PlanOutputPaths.
+ * @param outputOptions Output settings (single-pass header patching, output format, archive or shard output).
  *
  * @details
  * This function orchestrates the process of extracting audio data from a given FMOD sub-sound and saving it as a WAV file.
  * It retrieves sound information, constructs the output file path, writes the WAV header, and then writes the audio data chunks
  * based on the sound format. It also handles error logging and console output for progress and status.
+ * After the data is written, the header sizes are patched whenever the streamed size differs from the size in the header,
+ * which is always the case in single-pass mode (the header is written with a placeholder size of 0).
+ * When an archive sink is set, the file is streamed into the archive as one entry; when a shard sink is set, it is rendered into
+ * memory and appended to the current shard as a WAV/JSON sample pair. No output or language folders are created in either case.
+ * With FLAC output, the chunk writers stream into a FlacEncoderBuffer instead of the WAV file, which encodes frames in parallel;
+ * sounds FLAC cannot store portably (32-bit and float PCM) are written as WAV files.
+ * With NPY or F32 output, the chunk writers stream into a FloatTensorBuffer that converts every sample to float32;
+ * NPY files get a header whose shape is patched once the frame count is known, F32 samples are appended to the tensor blob and indexed.
+ * With standard output ("-o -"), a single sound is streamed directly and nothing is patched afterwards (the WAV header carries
+ * the reported length, or the maximum in single-pass mode); in framed mode the sound is rendered to memory and written as one frame.
+ * Individual files are written through the durability policy, if one is set: to "*.tmp" in atomic mode, and reported once closed.
  */
-void ProcessSubSound(FMOD::System* fmodSystem, FMOD::Sound* subSound, int subSoundIndex, int totalSubSounds, const std::string& baseFileName, const std::filesystem::path& outputDirectoryPath, bool verboseLogEnabled, std::ofstream& logFile, std::unordered_set<std::string>& usedFileNames) {
+void ProcessSubSound(FMOD::System* fmodSystem, FMOD::Sound* subSound, int subSoundIndex, int totalSubSounds, const std::filesystem::path& outputDirectoryPath, bool verboseLogEnabled, std::ofstream& logFile, const std::filesystem::path& outputFilePath, const OutputOptions& outputOptions) {
+    const bool singlePassEnabled = outputOptions.singlePassEnabled;
+    const bool framedPipeOutput = outputOptions.pipeSink && outputOptions.pipeSink->framed(); // Sound is written to stdout as a frame with metadata
+    const bool directPipeOutput = outputOptions.pipeSink && !outputOptions.pipeSink->framed(); // Sound is streamed to stdout as-is (no seeking)
+    const bool inMemoryOutput = outputOptions.shardSink || framedPipeOutput; // WAV is rendered to memory and handed to a sink
+    const bool archiveOutput = outputOptions.archiveSink != nullptr; // WAV is streamed into the archive as one entry
+    const bool blobOutput = outputOptions.tensorBlobSink != nullptr; // Samples are appended to the tensor blob, no file per sound
+    const bool ringOutput = outputOptions.ringSink != nullptr; // PCM data is published into the shared-memory ring, no file per sound
+    const std::chrono::steady_clock::time_point soundStart = std::chrono::steady_clock::now(); // Start of the sound, for the run summary
 
-    logFile << std::endl; // Adds a newline to the log file for better readability
-    WriteLogMessage(logFile, "INFO", "ProcessSubSound", "Processing sub-sound " + std::to_string(subSoundIndex + 1) + "/" + std::to_string(totalSubSounds), verboseLogEnabled, FMOD_OK); // Logs start of sub-sound processing
+    WriteLogSeparator(logFile, verboseLogEnabled); // Adds a newline to the log file for better readability
+    LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "Processing sub-sound " + std::to_string(subSoundIndex + 1) + "/" + std::to_string(totalSubSounds), verboseLogEnabled, FMOD_OK); // Logs start of sub-sound processing
     CheckFMODResult(subSound->seekData(0), "FMOD::Sound::seekData failed for sub-sound " + std::to_string(subSoundIndex)); // Seeks to the beginning of the sub-sound data
-    WriteLogMessage(logFile, "INFO", "ProcessSubSound", "FMOD::Sound::seekData successful", verboseLogEnabled, FMOD_OK); // Logs successful seek operation
+    LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "FMOD::Sound::seekData successful", verboseLogEnabled, FMOD_OK); // Logs successful seek operation
 
-    SoundInfo soundInfo = GetSoundInfo(subSound, subSoundIndex, verboseLogEnabled, logFile); // Retrieves sound information for the current sub-sound
+    SoundInfo soundInfo = GetSoundInfo(subSound, subSoundIndex, verboseLogEnabled, logFile, singlePassEnabled); // Retrieves sound information for the current sub-sound
 
-    // Added tag-based directory creation
-    std::filesystem::path finalOutputDirectory = outputDirectoryPath;
-    FMOD_TAG tag;
-    if (subSound->getTag("language", 0, &tag) == FMOD_OK) {
-        if (tag.datatype == FMOD_TAGDATATYPE_STRING) {
-            std::string language(static_cast<char*>(tag.data));
-            if (!language.empty()) {
-                std::filesystem::path languageFolder = outputDirectoryPath / SanitizeFileName(language);
-                PrepareOutputDirectory(languageFolder);
-                finalOutputDirectory = languageFolder;
-            }
+    // The output path was planned before extraction started, and its language folder created by main (file output only)
+    if (outputFilePath.empty()) {
+        throw std::runtime_error("No output path planned for sub-sound " + std::to_string(subSoundIndex));
+    }
+    const std::string language = outputOptions.outputPlan ? outputOptions.outputPlan->Language(subSoundIndex) : std::string(); // Language tag from the plan's ID table ("" if none)
+
+    bool flacOutput = false; // True if this sound is encoded as FLAC
+    if (outputOptions.outputFormat == OutputFormat::Flac) {
+        flacOutput = FlacEncoderBuffer::IsSupported(soundInfo);
+        if (!flacOutput) {
+            LOG_MESSAGE(logFile, "WARNING", "ProcessSubSound", std::string("Format ") + SoundFormatName(soundInfo.format) + " cannot be stored as FLAC, writing WAV instead", verboseLogEnabled, FMOD_OK); // Logs FLAC fallback (WARNING level)
+            std::cout << " Warning: " << SoundFormatName(soundInfo.format) << " data cannot be stored as FLAC, writing WAV instead." << std::endl;
         }
     }
 
-    // Using GetOutputFilePath to prevent overwrites
-    std::filesystem::path fullOutputPath = GetOutputFilePath(finalOutputDirectory, baseFileName, soundInfo, subSoundIndex, usedFileNames);
+    const bool tensorOutput = outputOptions.outputFormat == OutputFormat::Npy || outputOptions.outputFormat == OutputFormat::F32; // Samples are converted to float32
+    const bool rawPcmOutput = outputOptions.outputFormat == OutputFormat::Pcm; // PCM data without a header
+    const bool wavOutput = !flacOutput && !tensorOutput && !rawPcmOutput;     // WAV header plus PCM data (also the FLAC fallback)
+    const std::filesystem::path& fullOutputPath = outputFilePath; // Unique name, resolved by PlanOutputPaths
+    std::string archiveEntryName; // Entry path inside the archive or shard (archive and in-memory output only), e.g. "music/ko/voice.wav"
+    if (inMemoryOutput || archiveOutput || blobOutput || ringOutput) { // For the blob and the ring, the name (without extension) identifies the sound
+        archiveEntryName = (outputDirectoryPath.filename() / fullOutputPath.lexically_relative(outputDirectoryPath)).generic_u8string();
+    }
 
     std::cout << std::endl << " Processing sub-sound " << subSoundIndex + 1 << "/" << totalSubSounds << ":" << std::endl; // Prints processing start message to console
     std::cout << " Name: " << (std::strlen(soundInfo.subSoundName) > 0 ? soundInfo.subSoundName : "<no name>") << std::endl; // Prints sub-sound name to console (if available)
     std::cout << " Channels: " << soundInfo.channels << std::endl; // Prints number of channels to console
     std::cout << " Sample Rate: " << soundInfo.sampleRate << " Hz" << std::endl; // Prints sample rate to console
     std::cout << " Length: " << soundInfo.lengthMs << " ms" << std::endl; // Prints length in milliseconds to console
-    std::cout << " Output: " << fullOutputPath.u8string() << std::endl; // Show final output path
+    if (outputOptions.archiveSink) {
+        std::cout << " Output: " << outputOptions.archiveSink->path().u8string() << " : " << archiveEntryName << std::endl; // Show archive and entry path
+    }
+    else if (outputOptions.pipeSink) {
+        std::cout << " Output: <stdout> : " << (framedPipeOutput ? archiveEntryName : fullOutputPath.filename().u8string()) << std::endl; // Show that the sound goes to standard output
+    }
+    else if (outputOptions.shardSink) {
+        std::cout << " Output: " << outputOptions.shardSink->directory().u8string() << " : " << archiveEntryName << std::endl; // Show shard directory and sample path
+    }
+    else if (blobOutput) {
+        std::cout << " Output: " << outputOptions.tensorBlobSink->path().u8string() << " : " << archiveEntryName << std::endl; // Show blob and sound name
+    }
+    else if (ringOutput) {
+        std::cout << " Output: shared memory " << outputOptions.ringSink->name() << " : " << archiveEntryName << std::endl; // Show ring and sound name
+    }
+    else {
+        std::cout << " Output: " << fullOutputPath.u8string() << std::endl; // Show final output path
+    }
+
+    std::ofstream wavFile;         // Output WAV file (file output)
+    std::ostringstream wavBuffer;  // In-memory WAV file (shard or framed standard output)
+    std::ostream* ringStream = nullptr; // Stream publishing PCM data records (ring output only)
+    if (ringOutput) { // The start record tells the consumer how to interpret the PCM data that follows
+        std::ostringstream json;
+        json << "{\"name\":\"" << EscapeJsonString(archiveEntryName.substr(0, archiveEntryName.size() - fullOutputPath.extension().u8string().size())) << "\""
+            << ",\"sub_sound_index\":" << subSoundIndex
+            << ",\"format\":\"" << SoundFormatName(soundInfo.format) << "\""
+            << ",\"sample_rate\":" << soundInfo.sampleRate
+            << ",\"bits_per_sample\":" << soundInfo.bitsPerSample
+            << ",\"channels\":" << soundInfo.channels
+            << ",\"length_ms\":" << soundInfo.lengthMs
+            << "}";
+        ringStream = &outputOptions.ringSink->BeginSound(json.str());
+    }
+    SharedMemoryRingSink::SoundGuard ringSoundGuard(ringOutput ? outputOptions.ringSink : nullptr); // Abort record if the sound fails before EndSound
+    std::ostream& wavStream = inMemoryOutput ? static_cast<std::ostream&>(wavBuffer) : (archiveOutput ? outputOptions.archiveSink->BeginEntry(archiveEntryName) :
+        (blobOutput ? outputOptions.tensorBlobSink->stream() : (directPipeOutput ? outputOptions.pipeSink->stream() : (ringOutput ? *ringStream : static_cast<std::ostream&>(wavFile)))));
+    const std::streamoff outputStartOffset = (blobOutput || directPipeOutput || ringOutput) ? static_cast<std::streamoff>(wavStream.tellp()) : 0; // Where this sound starts (non-zero in the tensor blob)
+    if (!inMemoryOutput && !archiveOutput && !blobOutput && !directPipeOutput && !ringOutput) {
+        std::filesystem::path writePath = outputOptions.durability ? outputOptions.durability->WritePath(fullOutputPath) : fullOutputPath; // "*.tmp" in atomic mode
+        wavFile.open(writePath, std::ios::binary | std::ios::trunc); // Opens output WAV file in binary truncate mode (overwrite if exists)
+        if (!wavFile.is_open()) { // Checks if WAV file opening failed
+            LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error opening output WAV file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs file open error (ERROR level)
+            std::cerr << " Error opening output WAV file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
+            throw std::runtime_error("Failed to open output WAV file"); // Throws exception on error
+        }
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "WAV file opened successfully: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs successful file open (INFO level)
+    }
+
+    std::unique_ptr<FlacEncoderBuffer> flacEncoder; // FLAC encoder fed by the chunk writers (FLAC output only)
+    std::unique_ptr<std::ostream> flacStream;        // Stream wrapping flacEncoder
+    std::unique_ptr<FloatTensorBuffer> tensorBuffer; // Float32 converter fed by the chunk writers (NPY/F32 output only)
+    std::unique_ptr<std::ostream> tensorStream;      // Stream wrapping tensorBuffer
+    std::ostream* pcmStream = &wavStream;            // Stream the chunk writers write PCM data into
+    if (tensorOutput) {
+        if (outputOptions.outputFormat == OutputFormat::Npy && !TensorFormat::WriteNpyHeader(wavStream, 0, 0)) { // Provisional header, the shape is patched after streaming
+            LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error writing NPY header to file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs header write error (ERROR level)
+            std::cerr << " Error writing NPY header to file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
+            throw std::runtime_error("Failed to write NPY header"); // Throws exception on error
+        }
+        tensorBuffer = std::make_unique<FloatTensorBuffer>(wavStream, soundInfo, outputOptions.planarLayout);
+        tensorStream = std::make_unique<std::ostream>(tensorBuffer.get());
+        pcmStream = tensorStream.get();
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", std::string("Float32 conversion started - Layout: ") + (outputOptions.planarLayout ? "planar" : "interleaved"), verboseLogEnabled, FMOD_OK); // Logs conversion start (INFO level)
+    }
+    else if (flacOutput) {
+        flacEncoder = std::make_unique<FlacEncoderBuffer>(wavStream, soundInfo, outputOptions.flacEncoderPool, !directPipeOutput); // Writes the FLAC marker and STREAMINFO block
+        flacStream = std::make_unique<std::ostream>(flacEncoder.get());
+        pcmStream = flacStream.get();
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "FLAC encoder started with " + std::to_string(outputOptions.encoderThreads) + " thread(s)", verboseLogEnabled, FMOD_OK); // Logs FLAC encoder start (INFO level)
+    }
+    else if (wavOutput) {
+        size_t headerDataSize = (directPipeOutput && singlePassEnabled) ? Constants::STREAMING_WAV_DATA_SIZE : soundInfo.soundLengthBytes; // A pipe cannot be patched, so an unknown size is announced as "until end of stream"
+        if (!WriteWAVHeader(wavStream, soundInfo.sampleRate, soundInfo.channels, headerDataSize, soundInfo.bitsPerSample, soundInfo.format)) { // Writes WAV header to the file
+            LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error writing WAV header to file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs header write error (ERROR level)
+            std::cerr << " Error writing WAV header to file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
+            throw std::runtime_error("Failed to write WAV header"); // Throws exception on error
+        }
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "WAV header written successfully", verboseLogEnabled, FMOD_OK); // Logs successful header write (INFO level)
+    }
 
-    std::ofstream wavFile(fullOutputPath, std::ios::binary | std::ios::trunc); // Opens output WAV file in binary truncate mode (overwrite if exists)
-    if (!wavFile.is_open()) { // Checks if WAV file opening failed
-        WriteLogMessage(logFile, "ERROR", "ProcessSubSound", "Error opening output WAV file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs file open error (ERROR level)
-        std::cerr << " Error opening output WAV file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
-        throw std::runtime_error("Failed to open output WAV file"); // Throws exception on error
+    std::unique_ptr<PeakSummaryBuffer> peakBuffer; // Waveform peak summary computed from the PCM data on its way to pcmStream (-peaks only)
+    std::unique_ptr<std::ostream> peakStream;      // Stream wrapping peakBuffer
+    if (outputOptions.peaksEnabled) {
+        peakBuffer = std::make_unique<PeakSummaryBuffer>(*pcmStream, soundInfo);
+        peakStream = std::make_unique<std::ostream>(peakBuffer.get());
+        pcmStream = peakStream.get();
     }
-    WriteLogMessage(logFile, "INFO", "ProcessSubSound", "WAV file opened successfully: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs successful file open (INFO level)
 
-    if (!WriteWAVHeader(wavFile, soundInfo.sampleRate, soundInfo.channels, soundInfo.soundLengthBytes, soundInfo.bitsPerSample, soundInfo.format)) { // Writes WAV header to the file
-        WriteLogMessage(logFile, "ERROR", "ProcessSubSound", "Error writing WAV header to file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs header write error (ERROR level)
-        std::cerr << " Error writing WAV header to file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
-        throw std::runtime_error("Failed to write WAV header"); // Throws exception on error
+    std::unique_ptr<PcmChecksum::Hasher> pcmHasher; // Checksum of the decoded PCM data, updated by the chunk writers (-manifest only)
+    if (outputOptions.manifestSink) {
+        pcmHasher = std::make_unique<PcmChecksum::Hasher>();
     }
-    WriteLogMessage(logFile, "INFO", "ProcessSubSound", "WAV header written successfully", verboseLogEnabled, FMOD_OK); // Logs successful header write (INFO level)
 
     int chunkCount = 0; // Initializes chunk counter for logging
+    AudioProcessor::ChunkTimings chunkTimings; // Decode and write time, for the run summary
     bool writeSuccess = false; // Flag to track success of audio data writing
+    unsigned int streamLengthBytes = singlePassEnabled ? Constants::UNKNOWN_LENGTH : soundInfo.soundLengthBytes; // Number of bytes to stream (unknown in single-pass mode)
 
     switch (soundInfo.format) { // Switch statement based on sound format to determine data writing function
-    case FMOD_SOUND_FORMAT_PCM8:   writeSuccess = AudioProcessor::WriteAudioDataChunk<unsigned char>(subSound, wavFile, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile)); break; // Writes 8-bit PCM data
-    case FMOD_SOUND_FORMAT_PCM16:  writeSuccess = AudioProcessor::WriteAudioDataChunk<short>(subSound, wavFile, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile)); break; // Writes 16-bit PCM data
-    case FMOD_SOUND_FORMAT_PCM24:  writeSuccess = AudioProcessor::WritePCM24DataChunk(subSound, wavFile, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile)); break; // Writes 24-bit PCM data
-    case FMOD_SOUND_FORMAT_PCM32:  writeSuccess = AudioProcessor::WriteAudioDataChunk<int>(subSound, wavFile, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile)); break; // Writes 32-bit PCM data
-    case FMOD_SOUND_FORMAT_PCMFLOAT: writeSuccess = AudioProcessor::WritePCMFloatDataChunk(subSound, wavFile, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile)); break; // Writes PCM float data
+    case FMOD_SOUND_FORMAT_PCM8:   writeSuccess = AudioProcessor::WriteAudioDataChunk<unsigned char>(subSound, *pcmStream, streamLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile), pcmHasher.get(), &chunkTimings); break; // Writes 8-bit PCM data
+    case FMOD_SOUND_FORMAT_PCM16:  writeSuccess = AudioProcessor::WriteAudioDataChunk<short>(subSound, *pcmStream, streamLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile), pcmHasher.get(), &chunkTimings); break; // Writes 16-bit PCM data
+    case FMOD_SOUND_FORMAT_PCM24:  writeSuccess = AudioProcessor::WritePCM24DataChunk(subSound, *pcmStream, streamLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile), pcmHasher.get(), &chunkTimings); break; // Writes 24-bit PCM data
+    case FMOD_SOUND_FORMAT_PCM32:  writeSuccess = AudioProcessor::WriteAudioDataChunk<int>(subSound, *pcmStream, streamLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile), pcmHasher.get(), &chunkTimings); break; // Writes 32-bit PCM data
+    case FMOD_SOUND_FORMAT_PCMFLOAT: writeSuccess = AudioProcessor::WritePCMFloatDataChunk(subSound, *pcmStream, streamLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile), pcmHasher.get(), &chunkTimings); break; // Writes PCM float data
     default:
-        WriteLogMessage(logFile, "WARNING", "ProcessSubSound", "Unsupported format detected: " + std::to_string(soundInfo.format) + ". Processing as PCM16 (potentially incorrect).", verboseLogEnabled, FMOD_OK); // Logs warning for unsupported format (WARNING level)
+        LOG_MESSAGE(logFile, "WARNING", "ProcessSubSound", "Unsupported format detected: " + std::to_string(soundInfo.format) + ". Processing as PCM16 (potentially incorrect).", verboseLogEnabled, FMOD_OK); // Logs warning for unsupported format (WARNING level)
         std::cout << " Warning: Unsupported format, attempting to extract as PCM16." << std::endl;
-        writeSuccess = AudioProcessor::WriteAudioDataChunk<short>(subSound, wavFile, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile)); // Falls back to writing as 16-bit PCM (potential data loss or incorrect output)
+        writeSuccess = AudioProcessor::WriteAudioDataChunk<short>(subSound, *pcmStream, streamLengthBytes, subSoundIndex, chunkCount, verboseLogEnabled, std::ref(logFile), pcmHasher.get(), &chunkTimings); // Falls back to writing as 16-bit PCM (potential data loss or incorrect output)
         break;
     }
 
     if (!writeSuccess) { // Checks if audio data writing failed
-        WriteLogMessage(logFile, "ERROR", "ProcessSubSound", "Error writing audio data to WAV file for sub-sound " + std::to_string(subSoundIndex), verboseLogEnabled, FMOD_OK); // Logs data write error (ERROR level)
+        LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error writing audio data to WAV file for sub-sound " + std::to_string(subSoundIndex), verboseLogEnabled, FMOD_OK); // Logs data write error (ERROR level)
         std::cerr << " Error writing audio data to WAV file for sub-sound " << subSoundIndex << std::endl; // Prints error to std::cerr
         throw std::runtime_error("Failed to write audio data to WAV file"); // Throws exception on error
     }
 
-    WriteLogMessage(logFile, "INFO", "ProcessSubSound", "Sub-sound processing finished successfully", verboseLogEnabled, FMOD_OK); // Logs successful sub-sound processing (INFO level)
+    std::string peakFile; // Contents of the "*.peaks" sidecar (-peaks only)
+    if (peakBuffer) {
+        if (!peakStream->good()) {
+            LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error writing audio data through peak summary for sub-sound " + std::to_string(subSoundIndex), verboseLogEnabled, FMOD_OK); // Logs tee write error (ERROR level)
+            std::cerr << " Error writing audio data for sub-sound " << subSoundIndex << std::endl; // Prints error to std::cerr
+            throw std::runtime_error("Failed to write audio data"); // Throws exception on error
+        }
+        peakFile = peakBuffer->Finish();
+    }
+
+    size_t writtenDataBytes = 0; // Audio data bytes actually decoded and written
+    if (tensorOutput) {
+        writtenDataBytes = static_cast<size_t>(tensorBuffer->pcmBytes());
+        const uint64_t frames = tensorBuffer->frames();
+        const uint64_t channels = tensorBuffer->channels();
+        bool finished = tensorBuffer->Finish(); // Writes the channel planes (planar layout)
+        if (finished && outputOptions.outputFormat == OutputFormat::Npy) { // Rewrites the NPY header with the final shape
+            std::streampos end = wavStream.tellp();
+            wavStream.seekp(0, std::ios::beg);
+            finished = outputOptions.planarLayout ? TensorFormat::WriteNpyHeader(wavStream, channels, frames) : TensorFormat::WriteNpyHeader(wavStream, frames, channels);
+            wavStream.seekp(end);
+        }
+        if (!finished) {
+            LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error finishing float32 output: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs finish error (ERROR level)
+            std::cerr << " Error finishing float32 output: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
+            throw std::runtime_error("Failed to finish float32 output"); // Throws exception on error
+        }
+        if (blobOutput) { // Records where the sound's samples are in the blob
+            std::string name = archiveEntryName.substr(0, archiveEntryName.size() - fullOutputPath.extension().u8string().size()); // Drops ".f32"
+            std::ostringstream json;
+            json << "{\"name\":\"" << EscapeJsonString(name) << "\""
+                << ",\"sub_sound_index\":" << subSoundIndex
+                << ",\"offset\":" << outputStartOffset
+                << ",\"shape\":[" << (outputOptions.planarLayout ? channels : frames) << "," << (outputOptions.planarLayout ? frames : channels) << "]"
+                << ",\"layout\":\"" << (outputOptions.planarLayout ? "planar" : "interleaved") << "\""
+                << ",\"sample_rate\":" << soundInfo.sampleRate
+                << ",\"source_format\":\"" << SoundFormatName(soundInfo.format) << "\""
+                << "}\n";
+            outputOptions.tensorBlobSink->AddIndexLine(json.str());
+        }
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "Float32 conversion finished - Frames: " + std::to_string(frames) + ", Channels: " + std::to_string(channels), verboseLogEnabled, FMOD_OK); // Logs conversion result (INFO level)
+    }
+    else if (flacOutput) {
+        writtenDataBytes = static_cast<size_t>(flacEncoder->pcmBytes());
+        if (!flacEncoder->Finish()) { // Encodes the remaining samples and patches STREAMINFO with the final totals
+            LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error finishing FLAC file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs FLAC finish error (ERROR level)
+            std::cerr << " Error finishing FLAC file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
+            throw std::runtime_error("Failed to finish FLAC file"); // Throws exception on error
+        }
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "FLAC encoding finished - PCM bytes: " + std::to_string(writtenDataBytes) + ", FLAC bytes: " + std::to_string(static_cast<std::streamoff>(wavStream.tellp())), verboseLogEnabled, FMOD_OK); // Logs FLAC result (INFO level)
+    }
+    else {
+        writtenDataBytes = static_cast<size_t>(static_cast<std::streamoff>(wavStream.tellp()) - outputStartOffset - (wavOutput ? Constants::WAV_HEADER_SIZE : 0)); // Measures the audio data actually written after the header
+    }
+    if (wavOutput && writtenDataBytes != soundInfo.soundLengthBytes) { // Header size is a placeholder (single-pass) or the decoded length differs from the reported length
+        if (!singlePassEnabled) {
+            LOG_MESSAGE(logFile, "WARNING", "ProcessSubSound", "Decoded length " + std::to_string(writtenDataBytes) + " bytes differs from reported length " + std::to_string(soundInfo.soundLengthBytes) + " bytes", verboseLogEnabled, FMOD_OK); // Logs length mismatch (WARNING level)
+        }
+        if (directPipeOutput) { // Standard output cannot be rewound; the header keeps the size written up front
+            LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "WAV header sizes not patched (standard output)", verboseLogEnabled, FMOD_OK);
+        }
+        else {
+            if (!PatchWAVHeaderSizes(wavStream, writtenDataBytes)) { // Rewrites the RIFF and data sizes with the measured length
+                LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error patching WAV header sizes in file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs header patch error (ERROR level)
+                std::cerr << " Error patching WAV header sizes in file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
+                throw std::runtime_error("Failed to patch WAV header"); // Throws exception on error
+            }
+            LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "WAV header sizes patched - Data size: " + std::to_string(writtenDataBytes) + " bytes", verboseLogEnabled, FMOD_OK); // Logs successful header patch (INFO level)
+        }
+    }
+
+    const uint64_t outputBytes = directPipeOutput ? writtenDataBytes : static_cast<uint64_t>(static_cast<std::streamoff>(wavStream.tellp()) - outputStartOffset); // Bytes written for the sound (PCM bytes on a pipe, which has no position)
+
+    if (wavFile.is_open()) { // Closes the output file and hands it to the durability policy (flush, batched rename)
+        uint64_t fileBytes = static_cast<uint64_t>(static_cast<std::streamoff>(wavFile.tellp()));
+        wavFile.close();
+        if (wavFile.fail()) {
+            LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error closing output file: " + fullOutputPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs file close error (ERROR level)
+            std::cerr << " Error closing output file: " << fullOutputPath.u8string() << std::endl; // Prints error to std::cerr
+            throw std::runtime_error("Failed to close output file"); // Throws exception on error
+        }
+        if (outputOptions.durability) {
+            outputOptions.durability->FileWritten(fullOutputPath, fileBytes);
+        }
+
+        if (peakBuffer) { // Writes the peak sidecar next to the output file
+            std::filesystem::path peakPath = fullOutputPath;
+            peakPath += ".peaks";
+            std::ofstream peakOutput(outputOptions.durability ? outputOptions.durability->WritePath(peakPath) : peakPath, std::ios::binary | std::ios::trunc);
+            peakOutput.write(peakFile.data(), static_cast<std::streamsize>(peakFile.size()));
+            peakOutput.close();
+            if (peakOutput.fail()) {
+                LOG_MESSAGE(logFile, "ERROR", "ProcessSubSound", "Error writing peak file: " + peakPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs peak file error (ERROR level)
+                std::cerr << " Error writing peak file: " << peakPath.u8string() << std::endl; // Prints error to std::cerr
+                throw std::runtime_error("Failed to write peak file"); // Throws exception on error
+            }
+            if (outputOptions.durability) {
+                outputOptions.durability->FileWritten(peakPath, peakFile.size());
+            }
+            LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "Peak file written: " + peakPath.u8string(), verboseLogEnabled, FMOD_OK); // Logs successful peak file (INFO level)
+        }
+    }
+
+    if (ringOutput) { // Publishes the remaining data and the end record
+        outputOptions.ringSink->EndSound();
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "Sound published to shared memory: " + archiveEntryName, verboseLogEnabled, FMOD_OK); // Logs successful ring output (INFO level)
+    }
+    else if (archiveOutput) { // Writes the final size (and CRC-32) of the streamed entry
+        outputOptions.archiveSink->EndEntry();
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "WAV file added to archive: " + archiveEntryName, verboseLogEnabled, FMOD_OK); // Logs successful archive entry (INFO level)
+        if (peakBuffer) { // The peak sidecar follows its sound in the archive
+            outputOptions.archiveSink->AddEntry(archiveEntryName + ".peaks", peakFile);
+        }
+    }
+    else if (outputOptions.shardSink || framedPipeOutput) { // Appends the file and its metadata sidecar to the current shard, or writes both as one stdout frame
+        std::string audioExtension = fullOutputPath.extension().u8string(); // ".wav", ".flac", ".npy", ".f32" or ".pcm"
+        std::string sampleKey = archiveEntryName.substr(0, archiveEntryName.size() - audioExtension.size()); // Drops the extension (the planner already replaced '.' in the file name, see GetOutputFilePath)
+
+        std::ostringstream json; // Per-sample SoundInfo metadata plus bank provenance
+        json << "{\"key\":\"" << EscapeJsonString(sampleKey) << "\""
+            << ",\"name\":\"" << EscapeJsonString(soundInfo.subSoundName) << "\""
+            << ",\"sub_sound_index\":" << subSoundIndex
+            << ",\"format\":\"" << SoundFormatName(soundInfo.format) << "\""
+            << ",\"sound_type\":\"" << SoundTypeName(soundInfo.soundType) << "\""
+            << ",\"sample_rate\":" << soundInfo.sampleRate
+            << ",\"bits_per_sample\":" << soundInfo.bitsPerSample
+            << ",\"channels\":" << soundInfo.channels
+            << ",\"length_bytes\":" << writtenDataBytes
+            << ",\"length_ms\":" << soundInfo.lengthMs
+            << ",\"source_file\":\"" << EscapeJsonString(outputOptions.sourceFileName) << "\""
+            << ",\"container_file\":\"" << EscapeJsonString(outputOptions.containerFileName) << "\"";
+        if (!language.empty()) { // Language tag of localized sounds, e.g. "ko"
+            json << ",\"language\":\"" << EscapeJsonString(language) << "\"";
+        }
+        if (framedPipeOutput) { // Tells the reading tool what the payload is
+            json << ",\"file\":\"" << EscapeJsonString(archiveEntryName) << "\"";
+        }
+        json << "}\n";
+        if (framedPipeOutput) {
+            outputOptions.pipeSink->AddFrame(json.str(), wavBuffer.str());
+            LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "Frame written to standard output: " + archiveEntryName, verboseLogEnabled, FMOD_OK); // Logs successful frame (INFO level)
+        }
+        else {
+            outputOptions.shardSink->AddSample(sampleKey, audioExtension, wavBuffer.str(), json.str());
+            LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "Sample added to shard: " + sampleKey, verboseLogEnabled, FMOD_OK); // Logs successful shard sample (INFO level)
+        }
+    }
+
+    if (outputOptions.manifestSink) { // Records the checksum and where the sound came from
+        std::string outputName = archiveEntryName.empty() ? (outputDirectoryPath.filename() / fullOutputPath.lexically_relative(outputDirectoryPath)).generic_u8string() : archiveEntryName;
+        std::ostringstream json;
+        json << "{\"name\":\"" << EscapeJsonString(soundInfo.subSoundName) << "\""
+            << ",\"sub_sound_index\":" << subSoundIndex
+            << ",\"output\":\"" << EscapeJsonString(outputName) << "\""
+            << ",\"format\":\"" << SoundFormatName(soundInfo.format) << "\""
+            << ",\"sample_rate\":" << soundInfo.sampleRate
+            << ",\"channels\":" << soundInfo.channels
+            << ",\"pcm_bytes\":" << pcmHasher->length()
+            << ",\"xxh64\":\"" << pcmHasher->HexDigest() << "\""
+            << ",\"source_file\":\"" << EscapeJsonString(outputOptions.sourceFileName) << "\""
+            << ",\"container_file\":\"" << EscapeJsonString(outputOptions.containerFileName) << "\"";
+        if (!language.empty()) {
+            json << ",\"language\":\"" << EscapeJsonString(language) << "\"";
+        }
+        if (outputOptions.containerOffset >= 0) {
+            json << ",\"container_offset\":" << outputOptions.containerOffset;
+            if (static_cast<size_t>(subSoundIndex) < outputOptions.sampleDataOffsets.size()) { // Encoded data position in the input file
+                json << ",\"data_offset\":" << static_cast<uint64_t>(outputOptions.containerOffset) + outputOptions.sampleDataOffsets[subSoundIndex];
+            }
+        }
+        json << "}\n";
+        outputOptions.manifestSink->AddLine(json.str());
+        LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "PCM checksum (XXH64): " + pcmHasher->HexDigest(), verboseLogEnabled, FMOD_OK); // Logs checksum (INFO level)
+    }
+
+    if (outputOptions.runSummary) { // Reports the sound's throughput figures
+        RunSummary::SoundRecord record;
+        record.name = archiveEntryName.empty() ? (outputDirectoryPath.filename() / fullOutputPath.lexically_relative(outputDirectoryPath)).generic_u8string() : archiveEntryName;
+        record.codec = SoundTypeName(soundInfo.soundType);
+        unsigned int rawBytes = 0;
+        if (subSound->getLength(&rawBytes, FMOD_TIMEUNIT_RAWBYTES) == FMOD_OK) { // Encoded size, available without decoding
+            record.inputBytes = rawBytes;
+        }
+        record.outputBytes = outputBytes;
+        record.decodeNanoseconds = chunkTimings.decodeNanoseconds;
+        record.writeNanoseconds = chunkTimings.writeNanoseconds;
+        record.totalNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - soundStart).count();
+        outputOptions.runSummary->AddSound(std::move(record));
+    }
+    Metrics::Registry& metrics = Metrics::Global();
+    metrics.soundsDone.Add(1);
+    metrics.bytesWritten.Add(outputBytes);
+    metrics.soundSeconds.Observe(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - soundStart).count()));
+    metrics.soundBytes.Observe(outputBytes);
+
+    LOG_MESSAGE(logFile, "INFO", "ProcessSubSound", "Sub-sound processing finished successfully", verboseLogEnabled, FMOD_OK); // Logs successful sub-sound processing (INFO level)
     std::cout << " Status: Success" << std::endl; // Prints success status to console
 }
\ No newline at end of file
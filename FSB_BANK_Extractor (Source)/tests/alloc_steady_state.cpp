@@ -0,0 +1,168 @@
+/**
+ * @file alloc_steady_state.cpp
+ * @brief Fails if the steady-state decode loop allocates heap memory.
+ *
+ * @details
+ * Builds the extractor as a library with the allocation-counting operator new (FSB_EXTRACTOR_COUNT_ALLOCATIONS and
+ * FSB_EXTRACTOR_LIBRARY, set by alloc_steady_state.vcxproj) and decodes every sub-sound of the given *.fsb or *.bank file
+ * twice:
+ * - through the command line's chunk writers (AudioProcessor::WriteAudioDataChunk, WritePCM24DataChunk and
+ *   WritePCMFloatDataChunk) into a stream that discards its data, so FMOD::Sound::readData (Decode phase), the float
+ *   clipping (Convert phase) and the stream write (Write phase) are the ones the extractor runs for every chunk;
+ * - through FSBExtractorAPI::Extractor with both Decode functions, which must deliver the same data.
+ * The test fails if anything was allocated in the Decode, Convert or Write phase.
+ * Buffers sized per sound are allocated outside these phases, as the chunk writers do.
+ *
+ * Usage: alloc_steady_state <file.fsb|file.bank>
+ * Exit code: 0 if no allocation was counted, 1 if one was (or decoding failed), 2 if no input file was given.
+ */
+#ifndef FSB_EXTRACTOR_COUNT_ALLOCATIONS
+#define FSB_EXTRACTOR_COUNT_ALLOCATIONS
+#endif
+#ifndef FSB_EXTRACTOR_LIBRARY
+#define FSB_EXTRACTOR_LIBRARY
+#endif
+#include "../FSB_BANK_Extractor_CPP/FSB_BANK_Extractor_CPP.cpp"
+
+/**
+ * @class NullBuffer
+ * @brief Stream buffer that accepts and discards everything written to it (the output stage is not under test).
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+    int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+};
+
+/**
+ * @brief Decodes one sub-sound through the chunk writer the command line selects for its format.
+ *
+ * @return uint64_t Number of bytes written. Throws std::runtime_error if the chunk writer fails.
+ */
+uint64_t WriteThroughChunkWriter(FMOD::Sound* subSound, int subSoundIndex, std::ofstream& noLog) {
+    SoundInfo soundInfo = GetSoundInfo(subSound, subSoundIndex, false, noLog, false);
+    CheckFMODResult(subSound->seekData(0), "FMOD::Sound::seekData failed for sub-sound " + std::to_string(subSoundIndex));
+
+    NullBuffer nullBuffer;
+    std::ostream output(&nullBuffer);
+    int chunkCount = 0;
+    bool writeSuccess = false;
+    switch (soundInfo.format) {
+    case FMOD_SOUND_FORMAT_PCM8:     writeSuccess = AudioProcessor::WriteAudioDataChunk<unsigned char>(subSound, output, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, false, noLog); break;
+    case FMOD_SOUND_FORMAT_PCM24:    writeSuccess = AudioProcessor::WritePCM24DataChunk(subSound, output, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, false, noLog); break;
+    case FMOD_SOUND_FORMAT_PCM32:    writeSuccess = AudioProcessor::WriteAudioDataChunk<int>(subSound, output, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, false, noLog); break;
+    case FMOD_SOUND_FORMAT_PCMFLOAT: writeSuccess = AudioProcessor::WritePCMFloatDataChunk(subSound, output, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, false, noLog); break;
+    default:                         writeSuccess = AudioProcessor::WriteAudioDataChunk<short>(subSound, output, soundInfo.soundLengthBytes, subSoundIndex, chunkCount, false, noLog); break;
+    }
+    if (!writeSuccess || !output.good()) {
+        throw std::runtime_error("Chunk writer failed for sub-sound " + std::to_string(subSoundIndex));
+    }
+    return soundInfo.soundLengthBytes;
+}
+
+/**
+ * @brief Decodes every sub-sound of the input file through the chunk writers.
+ *
+ * @return size_t Number of sub-sounds decoded; decodedBytes is increased by the bytes written.
+ */
+size_t DecodeWithChunkWriters(const std::filesystem::path& inputFilePath, uint64_t& decodedBytes) {
+    FMODSystem system;
+    std::vector<std::unique_ptr<FMODSound>> containers;
+    std::string extension = inputFilePath.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".bank") {
+        std::string error;
+        std::vector<BANKtoFSBExtractor::EmbeddedFSB> embeddedFsbs = BANKtoFSBExtractor::FindFSBsInBankFile(inputFilePath, &error);
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+        for (const BANKtoFSBExtractor::EmbeddedFSB& fsb : embeddedFsbs) {
+            containers.push_back(std::make_unique<FMODSound>(system.get(), inputFilePath.u8string(), fsb.offset, fsb.size));
+        }
+    }
+    else {
+        containers.push_back(std::make_unique<FMODSound>(system.get(), inputFilePath.u8string()));
+    }
+
+    std::ofstream noLog; // Never opened: verbose logging is off
+    size_t soundCount = 0;
+    for (const std::unique_ptr<FMODSound>& container : containers) {
+        int numSubSounds = 0;
+        CheckFMODResult(container->get()->getNumSubSounds(&numSubSounds), "FMOD::Sound::getNumSubSounds failed");
+        for (int i = 0; i < numSubSounds; ++i) {
+            FMOD::Sound* subSound = nullptr;
+            CheckFMODResult(container->get()->getSubSound(i, &subSound), "FMOD::Sound::getSubSound failed for sub-sound " + std::to_string(i));
+            decodedBytes += WriteThroughChunkWriter(subSound, i, noLog);
+            ++soundCount;
+        }
+    }
+    return soundCount;
+}
+
+int main(int argc, const char** argv) {
+    if (argc != 2 || argv[1][0] == '\0') {
+        std::cerr << "Usage: alloc_steady_state <file.fsb|file.bank>" << std::endl;
+        std::cerr << " FAILED: no input file configured (build with /p:AllocTestInput=<file> or set FSB_ALLOC_TEST_INPUT)" << std::endl;
+        return 2;
+    }
+    const std::filesystem::path inputFilePath = std::filesystem::u8path(argv[1]);
+
+    uint64_t decodedBytes = 0;
+    size_t soundCount = 0;
+    try {
+        soundCount = DecodeWithChunkWriters(inputFilePath, decodedBytes);
+
+        FSBExtractorAPI::Extractor extractor;
+        if (extractor.Open(inputFilePath) != soundCount) {
+            std::cerr << " FSBExtractorAPI::Extractor found a different number of sub-sounds than the chunk writers" << std::endl;
+            return 1;
+        }
+        for (size_t soundNumber = 0; soundNumber < soundCount; ++soundNumber) {
+            // First pass through the callback: measures the decoded size (soundLengthBytes is not exact for every codec)
+            const uint64_t soundBytes = extractor.Decode(soundNumber, [](const char*, size_t) { return true; });
+            std::vector<char> decoded(static_cast<size_t>(soundBytes));
+            if (extractor.Decode(soundNumber, decoded.data(), decoded.size()) != decoded.size()) {
+                std::cerr << " Sound " << soundNumber << ": buffer decode returned a different size than the chunk decode" << std::endl;
+                return 1;
+            }
+
+            // Second pass through the callback: must deliver the same data
+            size_t offset = 0;
+            bool identical = true;
+            extractor.Decode(soundNumber, [&decoded, &offset, &identical](const char* data, size_t size) {
+                identical = offset + size <= decoded.size() && std::memcmp(decoded.data() + offset, data, size) == 0;
+                offset += size;
+                return identical;
+            });
+            if (!identical || offset != decoded.size()) {
+                std::cerr << " Sound " << soundNumber << ": chunk decode differs from the buffer decode" << std::endl;
+                return 1;
+            }
+            decodedBytes += soundBytes * 3; // Decoded three times
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << " Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    PerfCounters::PrintAllocations(std::cout, soundCount * 2, decodedBytes);
+
+    if (soundCount == 0 || decodedBytes == 0) {
+        std::cerr << " FAILED: " << argv[1] << " has no decodable sub-sounds" << std::endl;
+        return 1;
+    }
+    bool passed = true;
+    for (PerfCounters::Phase phase : { PerfCounters::Decode, PerfCounters::Convert, PerfCounters::Write }) {
+        const uint64_t allocations = PerfCounters::allocationTotals.allocations[phase].load(std::memory_order_relaxed);
+        if (allocations != 0) {
+            std::cerr << " FAILED: " << allocations << " allocation(s) in the " << PerfCounters::PhaseName(phase) << " phase" << std::endl;
+            passed = false;
+        }
+    }
+    if (!passed) {
+        return 1;
+    }
+    std::cout << " PASSED: " << soundCount << " sub-sound(s), no allocations in the Decode, Convert and Write phases" << std::endl;
+    return 0;
+}